@@ -0,0 +1,93 @@
+// Microbenchmark of the parent-link updates: every node is hidden in a
+// shuffled order and then unhidden in reverse (LIFO) order, for each of the
+// hide_node / unhide_node variants. Prints ns per hide/unhide pair and
+// checks that the structure is equal to an untouched replica afterwards.
+//
+// usage: link_bench zdd_file [rounds]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "dancing_on_zdd.h"
+#include "dp_manager.h"
+#include "zdd_loader.h"
+
+using namespace std;
+
+template <typename L>
+class LinkBench {
+public:
+    using Zdd = ZddWithLinks<L>;
+    using node_t = typename L::node_t;
+    using Hide = void (Zdd::*)(const node_t);
+
+    struct Variant {
+        const char *name;
+        Hide hide;
+        Hide unhide;
+    };
+
+    /**
+     * runs every variant on zdd for rounds rounds.
+     * @return false if the structure was not restored.
+     */
+    static bool run(Zdd &zdd, int rounds) {
+        const Zdd reference(zdd);
+        const Variant variants[] = {
+            {"hide_node", &Zdd::hide_node, &Zdd::unhide_node},
+            {"cover_down", &Zdd::hide_node_cover_down,
+             &Zdd::unhide_node_cover_down},
+            {"cover_up", &Zdd::hide_node_cover_up,
+             &Zdd::unhide_node_cover_up},
+            {"upperzero", &Zdd::hide_node_upperzero,
+             &Zdd::unhide_node_upperzero},
+            {"lowerzero", &Zdd::hide_node_lowerzero,
+             &Zdd::unhide_node_lowerzero},
+        };
+
+        vector<node_t> order(zdd.table_.size());
+        iota(order.begin(), order.end(), 0);
+        mt19937_64 rng(1);
+        bool restored = true;
+        for (const Variant &variant : variants) {
+            double best = 0.0;
+            for (int round = 0; round < rounds; round++) {
+                shuffle(order.begin(), order.end(), rng);
+                const auto start = chrono::steady_clock::now();
+                for (node_t node_id : order) (zdd.*variant.hide)(node_id);
+                for (auto it = order.rbegin(); it != order.rend(); ++it) {
+                    (zdd.*variant.unhide)(*it);
+                }
+                const chrono::duration<double, nano> elapsed =
+                    chrono::steady_clock::now() - start;
+                const double per_pair = elapsed.count() / order.size();
+                if (round == 0 || per_pair < best) best = per_pair;
+            }
+            const bool equal = zdd == reference;
+            restored = restored && equal;
+            printf("%-10s %8.2f ns per hide/unhide pair%s\n", variant.name,
+                   best, equal ? "" : " (NOT RESTORED)");
+        }
+        return restored;
+    }
+};
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s zdd_file [rounds]\n", argv[0]);
+        return 2;
+    }
+    const int rounds = argc > 2 ? atoi(argv[2]) : 50;
+
+    ZddLoader loader(argv[1], 1);
+    ZddWithLinks<Layout32> zdd(loader.num_vars());
+    zdd.load_zdd(loader, 1);
+    printf("%s: %llu nodes, best of %d rounds\n", argv[1],
+           (unsigned long long)loader.nodes().size(), rounds);
+    return LinkBench<Layout32>::run(zdd, rounds) ? 0 : 1;
+}
@@ -0,0 +1,137 @@
+#include "arena.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <new>
+
+using namespace std;
+
+// mbind(2) mode; the syscall is used directly to avoid linking libnuma.
+constexpr int NUMA_MPOL_PREFERRED = 1;
+
+static size_t round_up(size_t n, size_t unit) {
+    return (n + unit - 1) / unit * unit;
+}
+
+// the size class of a free block: every block in it has at least 2^k bytes.
+static int floor_log2(size_t n) { return 63 - __builtin_clzl(n); }
+
+// the first size class whose blocks all hold n bytes.
+static int ceil_log2(size_t n) { return n <= 1 ? 0 : 64 - __builtin_clzl(n - 1); }
+
+Arena::Arena(const Options &options)
+    : options_(options),
+      chunks_(),
+      free_(),
+      current_(0),
+      offset_(0),
+      bytes_used_(0),
+      bytes_mapped_(0) {}
+
+Arena::~Arena() {
+    for (const auto &chunk : chunks_) {
+        munmap(chunk.base, chunk.size);
+    }
+}
+
+void Arena::reset() {
+    std::fill(std::begin(free_), std::end(free_), nullptr);
+    current_ = 0;
+    offset_ = 0;
+    bytes_used_ = 0;
+}
+
+void *Arena::do_allocate(size_t bytes, size_t alignment) {
+    // a freed block large enough; only the head of each class is looked at.
+    for (int k = ceil_log2(max(bytes, sizeof(FreeBlock)));
+         k < NUM_SIZE_CLASSES; k++) {
+        FreeBlock *block = free_[k];
+        if (block != nullptr &&
+            reinterpret_cast<uintptr_t>(block) % alignment == 0) {
+            free_[k] = block->next;
+            bytes_used_ += bytes;
+            return block;
+        }
+    }
+
+    // the first chunk from the current one with enough room; chunks kept by
+    // reset() are reused in order before mapping a new one.
+    for (; current_ < chunks_.size(); current_++, offset_ = 0) {
+        const Chunk &chunk = chunks_[current_];
+        const size_t start = round_up(offset_, alignment);
+        if (start + bytes <= chunk.size) {
+            offset_ = start + bytes;
+            bytes_used_ += bytes;
+            return chunk.base + start;
+        }
+    }
+
+    chunks_.push_back(map_chunk(max(bytes + alignment, options_.chunk_size)));
+    current_ = chunks_.size() - 1;
+    offset_ = bytes;
+    bytes_used_ += bytes;
+    return chunks_.back().base;
+}
+
+void Arena::do_deallocate(void *p, size_t bytes, size_t) {
+    bytes_used_ -= bytes;
+    char *block = static_cast<char *>(p);
+    if (current_ < chunks_.size() &&
+        block + bytes == chunks_[current_].base + offset_) {
+        offset_ = block - chunks_[current_].base;
+        return;
+    }
+    if (bytes < sizeof(FreeBlock) ||
+        reinterpret_cast<uintptr_t>(p) % alignof(FreeBlock) != 0) {
+        return;
+    }
+    FreeBlock *free_block = new (p) FreeBlock{free_[floor_log2(bytes)]};
+    free_[floor_log2(bytes)] = free_block;
+}
+
+Arena::Chunk Arena::map_chunk(size_t bytes) {
+    const size_t align = options_.huge_pages
+                             ? HUGE_PAGE_SIZE
+                             : static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t size = round_up(bytes, align);
+
+    // over-map by one alignment unit so that the chunk can start on a huge
+    // page boundary, then give the slack back.
+    const size_t mapped = options_.huge_pages ? size + align : size;
+    void *p = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    char *base = static_cast<char *>(p);
+    if (options_.huge_pages) {
+        char *aligned = reinterpret_cast<char *>(
+            round_up(reinterpret_cast<uintptr_t>(base), align));
+        if (aligned > base) {
+            munmap(base, aligned - base);
+        }
+        if (aligned + size < base + mapped) {
+            munmap(aligned + size, base + mapped - (aligned + size));
+        }
+        base = aligned;
+        // only a hint; kernels without THP keep base pages.
+        madvise(base, size, MADV_HUGEPAGE);
+    }
+    if (options_.numa_local) {
+        unsigned cpu = 0, node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0 &&
+            node < 8 * sizeof(unsigned long)) {
+            unsigned long nodemask = 1UL << node;
+            // best effort: fails harmlessly on kernels without NUMA.
+            syscall(SYS_mbind, base, size, NUMA_MPOL_PREFERRED, &nodemask,
+                    8 * sizeof(unsigned long), 0);
+        }
+    }
+    bytes_mapped_ += size;
+    return {base, size};
+}
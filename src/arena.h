@@ -0,0 +1,78 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+constexpr size_t HUGE_PAGE_SIZE = 2UL << 20;
+
+/**
+ * A monotonic memory resource holding the storage of one instance.
+ *  Memory is taken from the OS in chunks with mmap and handed out by bumping
+ *  a pointer. deallocate() gives the last allocation back to the pointer and
+ *  keeps any other block on a free list by power of two size class, so the
+ *  buffers a growing vector leaves behind are reused by later allocations.
+ *  reset() drops every allocation at once but keeps the chunks, so the next
+ *  instance of a batch is built in the same memory without calling malloc
+ *  or mmap again. The arena must outlive every container allocated from it
+ *  and must not be shared by threads.
+ */
+class Arena : public std::pmr::memory_resource {
+   public:
+    struct Options {
+        // back the chunks with 2 MB transparent huge pages (madvise).
+        bool huge_pages = false;
+        // prefer the NUMA node of the thread that maps a chunk.
+        bool numa_local = false;
+        size_t chunk_size = 8 * HUGE_PAGE_SIZE;
+    };
+
+    explicit Arena(const Options &options);
+    Arena(const Arena &obj) = delete;
+    ~Arena() override;
+
+    /**
+     * Makes all the memory of the arena available again. Containers still
+     * using it must not be touched afterwards.
+     */
+    void reset();
+
+    const Options &options() const { return options_; }
+    size_t bytes_used() const { return bytes_used_; }
+    size_t bytes_mapped() const { return bytes_mapped_; }
+
+   private:
+    struct Chunk {
+        char *base;
+        size_t size;
+    };
+
+    // a deallocated block, stored in the block itself.
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    // free_[k] holds blocks of at least 2^k bytes.
+    static constexpr int NUM_SIZE_CLASSES = 64;
+
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource &other) const
+        noexcept override {
+        return this == &other;
+    }
+
+    // maps a chunk of at least bytes and applies the placement options.
+    Chunk map_chunk(size_t bytes);
+
+    const Options options_;
+    std::vector<Chunk> chunks_;
+    FreeBlock *free_[NUM_SIZE_CLASSES];
+    size_t current_;  // chunk allocations are taken from
+    size_t offset_;   // first free byte of the current chunk
+    size_t bytes_used_;
+    size_t bytes_mapped_;
+};
+
+#endif  // ARENA_H_
@@ -0,0 +1,304 @@
+#include "batch_runner.h"
+
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "dancing_on_zdd.h"
+#include "dp_manager.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// a child is killed when it runs this long past its time limit.
+constexpr long KILL_GRACE_SECONDS = 30;
+
+// rough per-node footprint of a loaded instance: the node table and its
+// links, the dp slots and queues of DpManager and the id conversion table
+// of the loader, in the compact layout most instances load in.
+constexpr size_t BYTES_PER_NODE = sizeof(ZddWithLinks<Layout32>::Node) +
+                                  sizeof(ZddWithLinks<Layout32>::Links) +
+                                  sizeof(DpManager<Layout32>::Slot) +
+                                  3 * sizeof(Layout32::node_t) + 32;
+
+BatchRunner::BatchRunner(const Config &config, SolveFunc solve)
+    : config_(config), solve_(std::move(solve)) {}
+
+vector<BatchRunner::Instance> BatchRunner::collect_instances(
+    const string &input_directory) const {
+    vector<Instance> instances;
+    for (const auto &entry : fs::directory_iterator(input_directory)) {
+        if (!entry.is_regular_file()) continue;
+
+        Instance instance;
+        instance.path = entry.path().string();
+        instance.name = entry.path().stem().string();
+        instance.num_nodes = 0;
+        if (config_.largest_first ||
+            config_.isolation == Isolation::Thread) {
+            // one node per line, except for the terminal line "."
+            ifstream ifs(instance.path);
+            string line;
+            while (getline(ifs, line)) {
+                if (!line.empty() && line[0] != '.' && line[0] != '#') {
+                    instance.num_nodes++;
+                }
+            }
+        }
+        instances.emplace_back(std::move(instance));
+    }
+    if (config_.largest_first) {
+        stable_sort(instances.begin(), instances.end(),
+                    [](const Instance &a, const Instance &b) {
+                        return a.num_nodes > b.num_nodes;
+                    });
+    }
+    return instances;
+}
+
+void BatchRunner::run(const string &input_directory, ostream &csv) {
+    auto instances = collect_instances(input_directory);
+    if (config_.isolation == Isolation::Fork) {
+        run_forked(instances, csv);
+    } else {
+        run_threaded(instances, csv);
+    }
+}
+
+BatchResult BatchRunner::solve_guarded(const string &file_name) const {
+    BatchResult result;
+    try {
+        result = solve_(file_name, config_.time_limit);
+    } catch (const std::bad_alloc &e) {
+        result = BatchResult();
+        result.error = "out of memory";
+    } catch (const std::exception &e) {
+        result = BatchResult();
+        result.error = e.what();
+    }
+    return result;
+}
+
+void BatchRunner::report(const Instance &instance, const BatchResult &result,
+                         ostream &csv) const {
+    csv << instance.name << ",";
+    if (result.success) {
+        csv << result.num_search_tree_nodes << "," << result.num_solutions
+            << "," << result.num_updates << "," << result.time << ","
+            << "SUCCESS";
+        printf("%s: num_nodes: %llu, sols: %s, num_updates: %llu, "
+               "time: %.4fs%s%s",
+               instance.name.c_str(),
+               static_cast<unsigned long long>(result.num_search_tree_nodes),
+               count_to_string(result.num_solutions).c_str(),
+               static_cast<unsigned long long>(result.num_updates), result.time,
+               result.config.empty() ? "" : ", config: ",
+               result.config.c_str());
+        if (result.first_solution_time >= 0) {
+            printf(", first solution: %.4fs", result.first_solution_time);
+        }
+        printf("\n");
+    } else {
+        csv << "-,"
+            << "-,"
+            << "-,"
+            << "-,"
+            << "FAILED";
+        printf("%s: FAILED (%s)", instance.name.c_str(),
+               result.error.c_str());
+        if (result.approx_solutions >= 0) {
+            printf(", approximate sols: %.4g [%.4g, %.4g]",
+                   result.approx_solutions, result.approx_low,
+                   result.approx_high);
+        }
+        printf("\n");
+    }
+    if (config_.report_config) {
+        csv << "," << (result.success ? result.config : "-");
+    }
+    if (config_.report_first_solution) {
+        csv << ",";
+        if (result.success && result.first_solution_time >= 0) {
+            csv << result.first_solution_time;
+        } else {
+            csv << "-";
+        }
+    }
+    if (config_.approx_time > 0) {
+        if (result.approx_solutions >= 0) {
+            csv << "," << result.approx_solutions << "," << result.approx_low
+                << "," << result.approx_high;
+        } else {
+            csv << ",-,-,-";
+        }
+    }
+    csv << "\n";
+    csv.flush();
+    fflush(stdout);
+}
+
+void BatchRunner::run_threaded(const vector<Instance> &instances,
+                               ostream &csv) {
+    atomic<size_t> next(0);
+    mutex csv_mtx;
+
+    auto worker = [&]() {
+        for (size_t i = next++; i < instances.size(); i = next++) {
+            const Instance &instance = instances[i];
+            BatchResult result;
+            const size_t estimated_mb = instance.num_nodes * BYTES_PER_NODE *
+                                        max(config_.num_search_threads, 1) >>
+                                        20;
+            if (config_.memory_limit_mb > 0 &&
+                estimated_mb > config_.memory_limit_mb) {
+                result.error = "estimated memory " + to_string(estimated_mb) +
+                               " MB exceeds the limit";
+            } else {
+                result = solve_guarded(instance.path);
+            }
+            lock_guard<mutex> lock(csv_mtx);
+            report(instance, result, csv);
+        }
+    };
+
+    vector<thread> threads;
+    for (int i = 0; i < max(config_.num_jobs, 1); i++) {
+        threads.emplace_back(worker);
+    }
+    for (auto &th : threads) {
+        th.join();
+    }
+}
+
+void BatchRunner::run_forked(const vector<Instance> &instances,
+                             ostream &csv) {
+    struct Running {
+        pid_t pid;
+        int fd;
+        size_t index;
+        chrono::steady_clock::time_point start;
+        bool killed;
+    };
+    vector<Running> running;
+    size_t next = 0;
+
+    while (next < instances.size() || !running.empty()) {
+        while ((int)running.size() < max(config_.num_jobs, 1) &&
+               next < instances.size()) {
+            int fds[2];
+            if (pipe(fds) != 0) {
+                throw std::runtime_error("pipe failed");
+            }
+            fflush(stdout);
+            fflush(stderr);
+            pid_t pid = fork();
+            if (pid < 0) {
+                throw std::runtime_error("fork failed");
+            }
+            if (pid == 0) {
+                // child: solve one instance and send the result to the parent.
+                close(fds[0]);
+                if (config_.memory_limit_mb > 0) {
+                    struct rlimit limit;
+                    limit.rlim_cur = limit.rlim_max =
+                        (rlim_t)config_.memory_limit_mb << 20;
+                    setrlimit(RLIMIT_AS, &limit);
+                }
+                BatchResult result = solve_guarded(instances[next].path);
+                ostringstream oss;
+                oss << result.success << " " << result.num_search_tree_nodes
+                    << " " << result.num_solutions << " " << result.num_updates
+                    << " " << result.time << " "
+                    << result.first_solution_time << " "
+                    << result.approx_solutions << " " << result.approx_low
+                    << " " << result.approx_high << " "
+                    << (result.config.empty() ? "-" : result.config) << " "
+                    << result.error << "\n";
+                const string msg = oss.str();
+                if (write(fds[1], msg.data(), msg.size()) < 0) {
+                    _exit(1);
+                }
+                close(fds[1]);
+                _exit(0);
+            }
+            close(fds[1]);
+            running.push_back(
+                {pid, fds[0], next, chrono::steady_clock::now(), false});
+            next++;
+        }
+
+        int status;
+        pid_t pid = waitpid(-1, &status, WNOHANG);
+        if (pid > 0) {
+            auto it = find_if(running.begin(), running.end(),
+                              [pid](const Running &r) { return r.pid == pid; });
+            if (it == running.end()) continue;
+
+            string msg;
+            char buf[4096];
+            ssize_t len;
+            while ((len = read(it->fd, buf, sizeof(buf))) > 0) {
+                msg.append(buf, len);
+            }
+            close(it->fd);
+
+            BatchResult result;
+            istringstream iss(msg);
+            // the approximate bounds can be "inf", which >> does not read.
+            string approx[3];
+            if (WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+                (iss >> result.success >> result.num_search_tree_nodes >>
+                 result.num_solutions >> result.num_updates >> result.time >>
+                 result.first_solution_time >> approx[0] >> approx[1] >>
+                 approx[2] >> result.config)) {
+                result.approx_solutions = strtod(approx[0].c_str(), nullptr);
+                result.approx_low = strtod(approx[1].c_str(), nullptr);
+                result.approx_high = strtod(approx[2].c_str(), nullptr);
+                if (result.config == "-") result.config.clear();
+                getline(iss >> ws, result.error);
+            } else {
+                result = BatchResult();
+                if (it->killed) {
+                    result.error = "killed after time limit";
+                } else if (WIFSIGNALED(status)) {
+                    result.error = "terminated by signal " +
+                                   to_string(WTERMSIG(status));
+                } else {
+                    result.error = "exit status " +
+                                   to_string(WEXITSTATUS(status));
+                }
+            }
+            report(instances[it->index], result, csv);
+            running.erase(it);
+            continue;
+        }
+
+        // kill children that ignore their time limit and the approximate
+        // count after it.
+        const auto now = chrono::steady_clock::now();
+        const long deadline = config_.time_limit +
+                              (long)ceil(config_.approx_time) +
+                              KILL_GRACE_SECONDS;
+        for (auto &r : running) {
+            if (!r.killed && now - r.start > chrono::seconds(deadline)) {
+                kill(r.pid, SIGKILL);
+                r.killed = true;
+            }
+        }
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+}
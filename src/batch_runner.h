@@ -0,0 +1,92 @@
+#ifndef BATCH_RUNNER_H_
+#define BATCH_RUNNER_H_
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "count_types.h"
+
+/**
+ * result of solving one instance of a batch.
+ */
+struct BatchResult {
+    uint64_t num_search_tree_nodes = 0ULL;
+    count128_t num_solutions = 0;
+    uint64_t num_updates = 0ULL;
+    double time = 0.0;
+    double first_solution_time = -1.0;  // seconds, -1 if none was found
+    std::string config;  // name of the search configuration that finished
+    // approximate count of an instance out of time, -1 if none
+    double approx_solutions = -1.0;
+    double approx_low = 0.0;
+    double approx_high = 0.0;
+    bool success = false;
+    std::string error;
+};
+
+/**
+ * Runs the instances of a directory with up to num_jobs instances at once.
+ *  With Isolation::Fork every instance runs in its own child process under
+ *  an address space limit, so a crash or an exit() only fails that
+ *  instance. With Isolation::Thread the instances run in worker threads of
+ *  this process; instances whose estimated size exceeds the memory limit
+ *  are not started. Rows are written to the csv as the instances finish.
+ */
+class BatchRunner {
+   public:
+    enum class Isolation { Fork, Thread };
+
+    struct Config {
+        int num_jobs = 1;
+        Isolation isolation = Isolation::Fork;
+        long time_limit = 1200;      // seconds per instance
+        size_t memory_limit_mb = 0;  // per instance, 0 means no limit
+        bool largest_first = false;  // start the instances with most nodes first
+        int num_search_threads = 1;  // threads used by each instance
+        bool report_config = false;  // add a Config column to the csv
+        // add a FirstSolution(s) column to the csv
+        bool report_first_solution = false;
+        // seconds of approximate counting after a timeout; adds the
+        // ApproxSols, ApproxLow and ApproxHigh columns to the csv if > 0
+        double approx_time = 0.0;
+    };
+
+    /**
+     * solves one instance within the time limit (in seconds). Failures are
+     * reported by throwing an exception.
+     */
+    using SolveFunc =
+        std::function<BatchResult(const std::string &file_name, long time_limit)>;
+
+    BatchRunner(const Config &config, SolveFunc solve);
+
+    /**
+     * Solves every regular file of input_directory and writes one row per
+     * instance to csv.
+     */
+    void run(const std::string &input_directory, std::ostream &csv);
+
+   private:
+    struct Instance {
+        std::string path;
+        std::string name;
+        size_t num_nodes;
+    };
+
+    std::vector<Instance> collect_instances(
+        const std::string &input_directory) const;
+
+    void run_forked(const std::vector<Instance> &instances, std::ostream &csv);
+    void run_threaded(const std::vector<Instance> &instances, std::ostream &csv);
+
+    BatchResult solve_guarded(const std::string &file_name) const;
+    void report(const Instance &instance, const BatchResult &result,
+                std::ostream &csv) const;
+
+    const Config config_;
+    SolveFunc solve_;
+};
+
+#endif  // BATCH_RUNNER_H_
@@ -0,0 +1,187 @@
+#include "column_select.h"
+
+#include <algorithm>
+#include <string>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+uint32_t min_count_column_scalar(const uint32_t *counts,
+                                 const uint32_t *columns, size_t n,
+                                 bool last_tie) {
+    return min_count_column<uint32_t>(counts, columns, n, last_tie);
+}
+
+#if defined(__x86_64__)
+
+// the minimum (maximum) of the lanes of a vector.
+uint32_t reduce_min(const uint32_t *lanes, size_t k) {
+    return *min_element(lanes, lanes + k);
+}
+
+uint32_t reduce_max(const uint32_t *lanes, size_t k) {
+    return *max_element(lanes, lanes + k);
+}
+
+// SSE2 has no unsigned 32-bit compare: flip the sign bits and compare signed.
+inline __m128i min_epu32_sse2(__m128i a, __m128i b) {
+    const __m128i sign = _mm_set1_epi32((int)0x80000000u);
+    const __m128i a_gt_b =
+        _mm_cmpgt_epi32(_mm_xor_si128(a, sign), _mm_xor_si128(b, sign));
+    return _mm_or_si128(_mm_and_si128(a_gt_b, b), _mm_andnot_si128(a_gt_b, a));
+}
+
+inline __m128i max_epu32_sse2(__m128i a, __m128i b) {
+    const __m128i sign = _mm_set1_epi32((int)0x80000000u);
+    const __m128i a_gt_b =
+        _mm_cmpgt_epi32(_mm_xor_si128(a, sign), _mm_xor_si128(b, sign));
+    return _mm_or_si128(_mm_and_si128(a_gt_b, a), _mm_andnot_si128(a_gt_b, b));
+}
+
+uint32_t min_count_column_sse2(const uint32_t *counts,
+                               const uint32_t *columns, size_t n,
+                               bool last_tie) {
+    constexpr size_t W = 4;
+    const size_t nv = n / W * W;
+    if (nv == 0) return min_count_column_scalar(counts, columns, n, last_tie);
+
+    // the minimum count.
+    __m128i vmin = _mm_loadu_si128((const __m128i *)counts);
+    for (size_t i = W; i < nv; i += W) {
+        vmin = min_epu32_sse2(vmin,
+                              _mm_loadu_si128((const __m128i *)(counts + i)));
+    }
+    alignas(16) uint32_t lanes[W];
+    _mm_store_si128((__m128i *)lanes, vmin);
+    uint32_t min_count = reduce_min(lanes, W);
+    for (size_t i = nv; i < n; i++) min_count = min(min_count, counts[i]);
+    if (min_count == 0) return 0;
+
+    // the smallest (largest) column among those of the minimum count; the
+    // other columns are replaced by ~0 (by 0).
+    const __m128i vcount = _mm_set1_epi32((int)min_count);
+    const __m128i ones = _mm_set1_epi32(-1);
+    __m128i vbest = last_tie ? _mm_setzero_si128() : ones;
+    for (size_t i = 0; i < nv; i += W) {
+        const __m128i eq = _mm_cmpeq_epi32(
+            _mm_loadu_si128((const __m128i *)(counts + i)), vcount);
+        const __m128i col = _mm_loadu_si128((const __m128i *)(columns + i));
+        if (last_tie) {
+            vbest = max_epu32_sse2(vbest, _mm_and_si128(eq, col));
+        } else {
+            vbest = min_epu32_sse2(
+                vbest, _mm_or_si128(col, _mm_andnot_si128(eq, ones)));
+        }
+    }
+    _mm_store_si128((__m128i *)lanes, vbest);
+    uint32_t best = last_tie ? reduce_max(lanes, W) : reduce_min(lanes, W);
+    for (size_t i = nv; i < n; i++) {
+        if (counts[i] == min_count) {
+            best = last_tie ? max(best, columns[i]) : min(best, columns[i]);
+        }
+    }
+    return best;
+}
+
+__attribute__((target("avx2"))) uint32_t min_count_column_avx2(
+    const uint32_t *counts, const uint32_t *columns, size_t n,
+    bool last_tie) {
+    constexpr size_t W = 8;
+    const size_t nv = n / W * W;
+    if (nv == 0) return min_count_column_sse2(counts, columns, n, last_tie);
+
+    __m256i vmin = _mm256_loadu_si256((const __m256i *)counts);
+    for (size_t i = W; i < nv; i += W) {
+        vmin = _mm256_min_epu32(
+            vmin, _mm256_loadu_si256((const __m256i *)(counts + i)));
+    }
+    alignas(32) uint32_t lanes[W];
+    _mm256_store_si256((__m256i *)lanes, vmin);
+    uint32_t min_count = reduce_min(lanes, W);
+    for (size_t i = nv; i < n; i++) min_count = min(min_count, counts[i]);
+    if (min_count == 0) return 0;
+
+    const __m256i vcount = _mm256_set1_epi32((int)min_count);
+    __m256i vbest = _mm256_set1_epi32(last_tie ? 0 : -1);
+    for (size_t i = 0; i < nv; i += W) {
+        const __m256i eq = _mm256_cmpeq_epi32(
+            _mm256_loadu_si256((const __m256i *)(counts + i)), vcount);
+        const __m256i col =
+            _mm256_loadu_si256((const __m256i *)(columns + i));
+        if (last_tie) {
+            vbest = _mm256_max_epu32(vbest, _mm256_and_si256(eq, col));
+        } else {
+            vbest = _mm256_min_epu32(vbest, _mm256_blendv_epi8(vbest, col, eq));
+        }
+    }
+    _mm256_store_si256((__m256i *)lanes, vbest);
+    uint32_t best = last_tie ? reduce_max(lanes, W) : reduce_min(lanes, W);
+    for (size_t i = nv; i < n; i++) {
+        if (counts[i] == min_count) {
+            best = last_tie ? max(best, columns[i]) : min(best, columns[i]);
+        }
+    }
+    return best;
+}
+
+#endif  // __x86_64__
+
+using min_count_column_fn = uint32_t (*)(const uint32_t *, const uint32_t *,
+                                         size_t, bool);
+
+struct Dispatch {
+    min_count_column_fn fn;
+    const char *isa;
+};
+
+Dispatch select_dispatch() {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {min_count_column_avx2, "avx2"};
+    }
+    return {min_count_column_sse2, "sse2"};
+#else
+    return {min_count_column_scalar, "scalar"};
+#endif
+}
+
+const Dispatch dispatch = select_dispatch();
+
+}  // namespace
+
+uint32_t min_count_column(const uint32_t *counts, const uint32_t *columns,
+                          size_t n, bool last_tie) {
+    // a few columns are faster without the call and the reductions.
+    if (n < 32) {
+        return min_count_column<uint32_t>(counts, columns, n, last_tie);
+    }
+    return dispatch.fn(counts, columns, n, last_tie);
+}
+
+const char *min_count_column_isa() { return dispatch.isa; }
+
+bool min_count_column_with(const char *isa, const uint32_t *counts,
+                           const uint32_t *columns, size_t n, bool last_tie,
+                           uint32_t &column) {
+    min_count_column_fn fn = nullptr;
+    const string name = isa;
+    if (name == "scalar") {
+        fn = min_count_column_scalar;
+    }
+#if defined(__x86_64__)
+    if (name == "sse2") {
+        fn = min_count_column_sse2;
+    } else if (name == "avx2" && __builtin_cpu_supports("avx2")) {
+        fn = min_count_column_avx2;
+    }
+#endif
+    if (fn == nullptr) return false;
+    column = fn(counts, columns, n, last_tie);
+    return true;
+}
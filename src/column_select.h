@@ -0,0 +1,47 @@
+#ifndef COLUMN_SELECT_H_
+#define COLUMN_SELECT_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * The choice of the column to branch on, over a dense array of the counts
+ * of the uncovered columns and the array of their columns.
+ *  The 32-bit counts are scanned with AVX2 or SSE2, picked once at run time
+ *  by the CPU; wider counts and other targets use the scalar loop.
+ */
+
+/**
+ * The column of the smallest of counts[0..n), n > 0, or 0 if that count is
+ * 0. Among equal counts, the smallest column wins, or the largest if
+ * last_tie. Columns are distinct and not 0.
+ */
+uint32_t min_count_column(const uint32_t *counts, const uint32_t *columns,
+                          size_t n, bool last_tie);
+
+template <typename Count>
+uint32_t min_count_column(const Count *counts, const uint32_t *columns,
+                          size_t n, bool last_tie) {
+    size_t best = 0;
+    for (size_t i = 1; i < n; i++) {
+        if (counts[i] < counts[best] ||
+            (counts[i] == counts[best] &&
+             (columns[i] < columns[best]) != last_tie)) {
+            best = i;
+        }
+    }
+    return counts[best] == 0 ? 0 : columns[best];
+}
+
+// the name of the scan used for 32-bit counts: "avx2", "sse2" or "scalar".
+const char *min_count_column_isa();
+
+/**
+ * min_count_column with the scan named isa, for any n > 0, in column.
+ * Returns false if this CPU or target has no such scan. For tests.
+ */
+bool min_count_column_with(const char *isa, const uint32_t *counts,
+                           const uint32_t *columns, size_t n, bool last_tie,
+                           uint32_t &column);
+
+#endif  // COLUMN_SELECT_H_
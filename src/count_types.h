@@ -0,0 +1,61 @@
+#ifndef COUNT_TYPES_H_
+#define COUNT_TYPES_H_
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+
+/**
+ * 128-bit counts.
+ *  Numbers of solutions are kept in 128 bits, and the widest layout of the
+ *  structure counts paths in 128 bits. The standard streams and to_string
+ *  do not know the type, so these helpers read and write it in decimal.
+ */
+using count128_t = unsigned __int128;
+
+constexpr count128_t COUNT128_MAX = ~(count128_t)0;
+
+// a + b, or COUNT128_MAX if the sum does not fit.
+inline count128_t saturating_add(count128_t a, count128_t b) {
+    count128_t sum;
+    return __builtin_add_overflow(a, b, &sum) ? COUNT128_MAX : sum;
+}
+
+inline std::string count_to_string(count128_t count) {
+    if (count == 0) return "0";
+    std::string digits;
+    for (; count > 0; count /= 10) {
+        digits.insert(digits.begin(), (char)('0' + (int)(count % 10)));
+    }
+    return digits;
+}
+
+// parses a decimal count; false if text is not one or does not fit.
+inline bool parse_count(const std::string &text, count128_t &count) {
+    if (text.empty()) return false;
+    count128_t value = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9' ||
+            __builtin_mul_overflow(value, (count128_t)10, &value) ||
+            __builtin_add_overflow(value, (count128_t)(c - '0'), &value)) {
+            return false;
+        }
+    }
+    count = value;
+    return true;
+}
+
+inline std::ostream &operator<<(std::ostream &os, count128_t count) {
+    return os << count_to_string(count);
+}
+
+inline std::istream &operator>>(std::istream &is, count128_t &count) {
+    std::string text;
+    if (is >> text && !parse_count(text, count)) {
+        is.setstate(std::ios::failbit);
+    }
+    return is;
+}
+
+#endif  // COUNT_TYPES_H_
@@ -0,0 +1,331 @@
+#include "cube_and_conquer.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <stdexcept>
+
+#include "dp_manager.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+template <typename L>
+CubeAndConquer<L>::CubeAndConquer(ZddWithLinks<L> &zdd)
+    : zdd_(zdd), current_(nullptr), option_buf_() {}
+
+template <typename L>
+CubeAndConquerBase::CubeFile CubeAndConquer<L>::split(int depth) {
+    CubeFile cube_file;
+    cube_file.num_var = zdd_.num_var_;
+    cube_file.depth = depth;
+
+    const auto num_solutions = zdd_.num_solutions;
+    const auto num_search_tree_nodes = zdd_.num_search_tree_nodes;
+    const auto num_updates = zdd_.num_updates;
+
+    current_ = &cube_file;
+    zdd_.cube_splitter_ = this;
+    zdd_.cube_depth_ = depth;
+    typename ZddWithLinks<L>::Solution solution;
+    try {
+        zdd_.search(solution, 0);
+    } catch (...) {
+        zdd_.cube_splitter_ = nullptr;
+        zdd_.cube_depth_ = -1;
+        current_ = nullptr;
+        throw;
+    }
+    zdd_.cube_splitter_ = nullptr;
+    zdd_.cube_depth_ = -1;
+    current_ = nullptr;
+
+    cube_file.num_solutions = zdd_.num_solutions - num_solutions;
+    cube_file.num_search_tree_nodes =
+        zdd_.num_search_tree_nodes - num_search_tree_nodes;
+    cube_file.num_updates = zdd_.num_updates - num_updates;
+    return cube_file;
+}
+
+template <typename L>
+CubeAndConquerBase::CubeFile CubeAndConquer<L>::split_to_count(
+    size_t num_cubes, int max_depth) {
+    CubeFile cube_file = split(0);
+    for (int depth = 1; depth <= max_depth; depth++) {
+        if (cube_file.cubes.size() >= num_cubes) break;
+        CubeFile deeper = split(depth);
+        if (deeper.cubes.empty()) break;  // finished above depth
+        cube_file = std::move(deeper);
+    }
+    return cube_file;
+}
+
+template <typename L>
+void CubeAndConquer<L>::emit_cube(int depth) {
+    Cube cube;
+    cube.id = current_->cubes.size();
+    for (int d = 0; d < depth; d++) {
+        zdd_.depth_option(d, option_buf_);
+        cube.options.emplace_back(option_buf_.cbegin(), option_buf_.cend());
+    }
+    current_->cubes.emplace_back(std::move(cube));
+}
+
+template <typename L>
+void CubeAndConquer<L>::solve(const Cube &cube, int depth) {
+    vector<vector<column_t>> options;
+    for (const auto &option : cube.options) {
+        options.emplace_back(option.cbegin(), option.cend());
+        zdd_.batch_cover(options.back().cbegin(), options.back().cend());
+    }
+    if (zdd_.sanity_check_ && zdd_.sanity()) {
+        cerr << "inconsistent after replaying cube " << cube.id << endl;
+        exit(1);
+    }
+
+    typename ZddWithLinks<L>::Solution solution;
+    zdd_.search(solution, depth);
+
+    for (auto it = options.crbegin(); it != options.crend(); ++it) {
+        zdd_.batch_uncover(it->cbegin(), it->cend());
+    }
+}
+
+// claims a cube by creating its claim file. fails if the file exists.
+static bool claim_cube(const string &claims_dir, uint64_t cube_id) {
+    const string path = claims_dir + "/" + to_string(cube_id);
+    int fd = open(path.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644);
+    if (fd < 0) return false;
+    const string pid = to_string(getpid()) + "\n";
+    if (write(fd, pid.data(), pid.size()) < 0) {
+        cerr << "can't write " << path << endl;
+    }
+    close(fd);
+    return true;
+}
+
+// ids of the cubes having a result in results_file.
+static set<uint64_t> solved_cube_ids(const string &results_file) {
+    set<uint64_t> ids;
+    ifstream ifs(results_file);
+    string line;
+    while (getline(ifs, line)) {
+        istringstream iss(line);
+        string tag;
+        uint64_t id;
+        if (iss >> tag >> id && tag == "result") {
+            ids.insert(id);
+        }
+    }
+    return ids;
+}
+
+template <typename L>
+size_t CubeAndConquer<L>::solve_queue(const CubeFile &cube_file,
+                                      const string &cube_file_name,
+                                      const string &results_file,
+                                      int64_t cube_id, bool retry_missing) {
+    if (cube_file.num_var != zdd_.num_var_) {
+        throw std::runtime_error("cube file does not match the zdd");
+    }
+    const string claims_dir = cube_file_name + ".claims";
+    fs::create_directories(claims_dir);
+    set<uint64_t> solved;
+    if (retry_missing) {
+        solved = solved_cube_ids(results_file);
+    }
+
+    size_t num_solved = 0;
+    for (const auto &cube : cube_file.cubes) {
+        if (cube_id >= 0) {
+            if (cube.id != (uint64_t)cube_id) continue;
+        } else if (retry_missing) {
+            if (solved.count(cube.id)) continue;
+        } else if (!claim_cube(claims_dir, cube.id)) {
+            continue;  // taken by another process
+        }
+
+        const auto num_solutions = zdd_.num_solutions;
+        const auto num_search_tree_nodes = zdd_.num_search_tree_nodes;
+        const auto num_updates = zdd_.num_updates;
+        zdd_.stopwatch.reset();
+        zdd_.stopwatch.markStartTime();
+        auto start_time = std::chrono::high_resolution_clock::now();
+        try {
+            solve(cube, cube_file.depth);
+        } catch (const std::runtime_error &e) {
+            // the structure is left covered; the cube stays without a result.
+            cerr << "cube " << cube.id << " failed: " << e.what() << endl;
+            throw;
+        }
+        auto end_time = std::chrono::high_resolution_clock::now();
+        zdd_.stopwatch.markStopTime();
+
+        ostringstream oss;
+        oss << "result " << cube.id << " "
+            << zdd_.num_solutions - num_solutions << " "
+            << zdd_.num_search_tree_nodes - num_search_tree_nodes << " "
+            << zdd_.num_updates - num_updates << " "
+            << std::chrono::duration_cast<std::chrono::duration<double>>(
+                   end_time - start_time)
+                   .count()
+            << "\n";
+        ofstream ofs(results_file, ios::app);
+        if (!ofs) {
+            cerr << "can't open " << results_file << endl;
+            exit(1);
+        }
+        ofs << oss.str();
+        ofs.flush();
+        num_solved++;
+    }
+    return num_solved;
+}
+
+void CubeAndConquerBase::write_cubes(const string &file_name,
+                                     const CubeFile &cubes) {
+    ofstream ofs(file_name);
+    if (!ofs) {
+        cerr << "can't open " << file_name << endl;
+        exit(1);
+    }
+    ofs << "# d3x cubes\n";
+    ofs << "zdd " << cubes.zdd_file << "\n";
+    ofs << "vars " << cubes.num_var << "\n";
+    ofs << "depth " << cubes.depth << "\n";
+    ofs << "above " << cubes.num_solutions << " "
+        << cubes.num_search_tree_nodes << " " << cubes.num_updates << "\n";
+    for (const auto &cube : cubes.cubes) {
+        ofs << "cube " << cube.id;
+        for (const auto &option : cube.options) {
+            ofs << " ";
+            for (size_t i = 0; i < option.size(); i++) {
+                if (i > 0) ofs << ",";
+                ofs << option[i];
+            }
+        }
+        ofs << "\n";
+    }
+}
+
+CubeAndConquerBase::CubeFile CubeAndConquerBase::read_cubes(
+    const string &file_name) {
+    ifstream ifs(file_name);
+    if (!ifs) {
+        cerr << "can't open " << file_name << endl;
+        exit(1);
+    }
+    CubeFile cubes;
+    string line;
+    while (getline(ifs, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        istringstream iss(line);
+        string tag;
+        iss >> tag;
+        if (tag == "zdd") {
+            iss >> cubes.zdd_file;
+        } else if (tag == "vars") {
+            iss >> cubes.num_var;
+        } else if (tag == "depth") {
+            iss >> cubes.depth;
+        } else if (tag == "above") {
+            iss >> cubes.num_solutions >> cubes.num_search_tree_nodes >>
+                cubes.num_updates;
+        } else if (tag == "cube") {
+            Cube cube;
+            iss >> cube.id;
+            string option_str;
+            while (iss >> option_str) {
+                vector<uint32_t> option;
+                istringstream option_iss(option_str);
+                string col;
+                while (getline(option_iss, col, ',')) {
+                    option.push_back(stoul(col));
+                }
+                cube.options.emplace_back(std::move(option));
+            }
+            if ((int)cube.options.size() != cubes.depth) {
+                throw std::runtime_error("bad cube " + to_string(cube.id) +
+                                         " in " + file_name);
+            }
+            cubes.cubes.emplace_back(std::move(cube));
+        } else {
+            throw std::runtime_error("bad line in " + file_name + ": " + line);
+        }
+    }
+    return cubes;
+}
+
+bool CubeAndConquerBase::merge(const CubeFile &cube_file,
+                               const string &results_file) {
+    struct Result {
+        count128_t num_solutions;
+        uint64_t num_search_tree_nodes, num_updates;
+    };
+    map<uint64_t, Result> results;
+
+    ifstream ifs(results_file);
+    if (!ifs) {
+        cerr << "can't open " << results_file << endl;
+        exit(1);
+    }
+    string line;
+    while (getline(ifs, line)) {
+        istringstream iss(line);
+        string tag;
+        uint64_t id;
+        Result r;
+        if (!(iss >> tag >> id >> r.num_solutions >> r.num_search_tree_nodes >>
+              r.num_updates) ||
+            tag != "result") {
+            continue;
+        }
+        auto it = results.find(id);
+        if (it != results.end()) {
+            // a rerun cube; the counts must agree.
+            if (it->second.num_solutions != r.num_solutions) {
+                cerr << "cube " << id << " has inconsistent results" << endl;
+            }
+            continue;
+        }
+        results.emplace(id, r);
+    }
+
+    count128_t num_solutions = cube_file.num_solutions;
+    uint64_t num_search_tree_nodes = cube_file.num_search_tree_nodes;
+    uint64_t num_updates = cube_file.num_updates;
+    vector<uint64_t> missing;
+    for (const auto &cube : cube_file.cubes) {
+        auto it = results.find(cube.id);
+        if (it == results.end()) {
+            missing.push_back(cube.id);
+            continue;
+        }
+        num_solutions += it->second.num_solutions;
+        num_search_tree_nodes += it->second.num_search_tree_nodes;
+        num_updates += it->second.num_updates;
+    }
+
+    printf("cubes: %zu, solved: %zu, missing: %zu\n", cube_file.cubes.size(),
+           cube_file.cubes.size() - missing.size(), missing.size());
+    if (!missing.empty()) {
+        printf("missing cubes:");
+        for (auto id : missing) {
+            printf(" %llu", (unsigned long long)id);
+        }
+        printf("\n");
+    }
+    printf("Nodes: %llu, Solutions: %s%s, Updates: %llu\n",
+           (unsigned long long)num_search_tree_nodes,
+           count_to_string(num_solutions).c_str(),
+           missing.empty() ? "" : " (partial)",
+           (unsigned long long)num_updates);
+    return missing.empty();
+}
+
+#define INSTANTIATE(L) template class CubeAndConquer<L>;
+FOR_EACH_LAYOUT(INSTANTIATE)
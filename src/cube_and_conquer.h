@@ -0,0 +1,105 @@
+#ifndef CUBE_AND_CONQUER_H_
+#define CUBE_AND_CONQUER_H_
+
+#include <string>
+#include <vector>
+
+#include "dancing_on_zdd.h"
+
+/**
+ * Cube and result files of CubeAndConquer, common to the layouts.
+ */
+class CubeAndConquerBase {
+   public:
+    struct Cube {
+        uint64_t id;
+        vector<vector<uint32_t>> options;  // columns of any layout
+    };
+
+    struct CubeFile {
+        string zdd_file;
+        int num_var = 0;
+        int depth = 0;
+        // counters of the search above the split depth.
+        count128_t num_solutions = 0;
+        uint64_t num_search_tree_nodes = 0ULL;
+        uint64_t num_updates = 0ULL;
+        vector<Cube> cubes;
+    };
+
+    static void write_cubes(const string &file_name, const CubeFile &cubes);
+    static CubeFile read_cubes(const string &file_name);
+
+    /**
+     * Sums the results of all cubes and reports the cubes without a result.
+     * @return true if every cube has a result.
+     */
+    static bool merge(const CubeFile &cube_file, const string &results_file);
+};
+
+/**
+ * Cube-and-conquer over independent processes.
+ *  The split step runs the search down to a fixed depth and records every
+ *  frame reaching that depth as a cube: the column lists of the options
+ *  chosen on the way. A cube is solved by covering its options with
+ *  batch_cover and searching the remaining subtree. Cubes are shared
+ *  through a work file; processes claim them by creating
+ *  <cube_file>.claims/<id> and append their counts to a results file, which
+ *  the merge step sums up.
+ *
+ * cube file format:
+ *   # d3x cubes
+ *   zdd <zdd file name>
+ *   vars <number of columns>
+ *   depth <split depth>
+ *   above <solutions> <search tree nodes> <updates>
+ *   cube <id> <option> <option> ...    (an option is "c1,c2,...")
+ * results file format:
+ *   result <id> <solutions> <search tree nodes> <updates> <time>
+ */
+template <typename L>
+class CubeAndConquer : public CubeAndConquerBase {
+   public:
+    using column_t = typename L::column_t;
+
+    explicit CubeAndConquer(ZddWithLinks<L> &zdd);
+    CubeAndConquer(const CubeAndConquer &obj) = delete;
+
+    /**
+     * Searches down to depth and collects the frames reaching it.
+     */
+    CubeFile split(int depth);
+
+    /**
+     * Increases the split depth until at least num_cubes frames are open,
+     * the search finishes above the depth, or max_depth is reached.
+     */
+    CubeFile split_to_count(size_t num_cubes, int max_depth = INT_MAX);
+
+    /**
+     * Counts the subtree of a cube. The counters of the search are added to
+     * the counters of the structure.
+     */
+    void solve(const Cube &cube, int depth);
+
+    /**
+     * Solves the cubes of cube_file and appends the counts to results_file.
+     * If cube_id is non-negative, only that cube is solved. If
+     * retry_missing is true, the cubes without a result are solved
+     * regardless of their claims; otherwise the unclaimed cubes are taken.
+     * @return number of cubes solved by this process.
+     */
+    size_t solve_queue(const CubeFile &cube_file, const string &cube_file_name,
+                       const string &results_file, int64_t cube_id,
+                       bool retry_missing);
+
+    // called from ZddWithLinks::search when a frame reaches the split depth.
+    void emit_cube(int depth);
+
+   private:
+    ZddWithLinks<L> &zdd_;
+    CubeFile *current_;
+    vector<column_t> option_buf_;
+};
+
+#endif  // CUBE_AND_CONQUER_H_
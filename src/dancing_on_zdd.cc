@@ -7,23 +7,55 @@
 #include <unordered_map>
 #include <unordered_set>
 
+#include "column_select.h"
 #include "dp_manager.h"
+#include "cube_and_conquer.h"
+#include "parallel_for.h"
+#include "work_stealing_search.h"
+#include "zdd_loader.h"
 
 
-ZddWithLinks::ZddWithLinks(int num_var, bool sanity_check)
+template <typename L>
+ZddWithLinks<L>::ZddWithLinks(int num_var, bool sanity_check,
+                              std::pmr::memory_resource *resource)
     : num_var_(num_var),
-      table_(),
+      work_stealing_(nullptr),
+      worker_id_(0),
+      steal_depth_(0),
+      cancel_flag_(nullptr),
+      cube_splitter_(nullptr),
+      cube_depth_(-1),
+      config_(),
+      rng_(0),
+      solution_limit_(UINT64_MAX),
+      found_solutions_(),
+      search_start_(std::chrono::steady_clock::now()),
+      first_solution_time_(-1.0),
+      memo_(nullptr),
+      memo_key_(),
+      output_(nullptr),
+      option_index_(nullptr),
+      output_result_(OutputZdd::ZERO),
+      output_option_buf_(),
+      writer_(nullptr),
+      writer_shared_(0),
+      resource_(resource),
+      table_(resource),
+      links_(resource),
+      header_(resource),
+      active_counts_(resource),
+      active_columns_(resource),
+      active_pos_(resource),
+      num_active_(0),
       dp_mgr_(nullptr),
-      hidden_node_stack_(make_unique<HiddenNodeStack>(HiddenNodeStack())),
+      hidden_node_stack_(make_unique<HiddenNodeStack<node_t>>(resource)),
       sanity_check_(sanity_check),
-      depth_choice_buf_(MAX_DEPTH, std::vector<uint16_t>()),
-      depth_upper_choice_buf_(MAX_DEPTH, std::vector<uint16_t>()),
-      depth_lower_choice_buf_(MAX_DEPTH, std::vector<uint16_t>()),
-      depth_lower_trace_buf_(MAX_DEPTH, std::vector<uint32_t>()),
-      depth_lower_change_pts_buf_(MAX_DEPTH, std::vector<size_t>()),
-      depth_upper_trace_buf_(MAX_DEPTH, std::vector<uint32_t>()),
-      depth_upper_change_pts_buf_(MAX_DEPTH, std::vector<size_t>()),
-      depth_upper_change_node_ids_buf_(MAX_DEPTH, std::vector<int32_t>()) {
+      frames_(),
+      replay_depth_(0),
+      base_depth_(0),
+      search_depth_(0),
+      search_step_(SearchStep::Enter),
+      up_rank_choice_buf_() {
     
     num_inactive_updates = 0ULL;
     num_search_tree_nodes = 0ULL;
@@ -32,7 +64,12 @@ ZddWithLinks::ZddWithLinks(int num_var, bool sanity_check)
     num_solutions = 0ULL;
     num_hides = 0ULL;
     num_failure_backtracks = 0ULL;
-    
+
+    if (num_var_ > L::MAX_COLUMNS) {
+        throw std::overflow_error(to_string(num_var_) +
+                                  " columns overflow the column type");
+    }
+    header_.reserve(num_var_ + 1);
     header_.emplace_back(num_var_, 1, -1, -1, 0, 0);  // the head of header cells
     for (int i = 0; i < num_var_; i++) {
         header_.emplace_back(i, i + 2, -1, -1, i + 1, 0);
@@ -42,25 +79,389 @@ ZddWithLinks::ZddWithLinks(int num_var, bool sanity_check)
     stopwatch.setTimeBound(1200); 
 }
 
-ZddWithLinks::ZddWithLinks(const ZddWithLinks &obj)
-    : num_var_(obj.num_var_),
-      table_(obj.table_),
-      header_(obj.header_),
+template <typename L>
+ZddWithLinks<L>::ZddWithLinks(const ZddWithLinks &obj,
+                              std::pmr::memory_resource *resource)
+    : num_search_tree_nodes(0ULL),
+      num_solutions(0ULL),
+      num_updates(0ULL),
+      num_head_updates(0ULL),
+      num_inactive_updates(0ULL),
+      num_hides(0ULL),
+      num_failure_backtracks(0ULL),
+      num_var_(obj.num_var_),
+      work_stealing_(nullptr),
+      worker_id_(0),
+      steal_depth_(0),
+      cancel_flag_(nullptr),
+      cube_splitter_(nullptr),
+      cube_depth_(-1),
+      config_(obj.config_),
+      rng_(obj.config_.seed),
+      solution_limit_(obj.solution_limit_),
+      found_solutions_(),
+      search_start_(obj.search_start_),
+      first_solution_time_(-1.0),
+      memo_(nullptr),
+      memo_key_(),
+      output_(nullptr),
+      option_index_(nullptr),
+      output_result_(OutputZdd::ZERO),
+      output_option_buf_(),
+      writer_(nullptr),
+      writer_shared_(0),
+      resource_(resource),
+      table_(obj.table_, resource),
+      links_(obj.links_, resource),
+      header_(obj.header_, resource),
+      active_counts_(obj.active_counts_, resource),
+      active_columns_(obj.active_columns_, resource),
+      active_pos_(obj.active_pos_, resource),
+      num_active_(obj.num_active_),
       dp_mgr_(nullptr),
-      hidden_node_stack_(nullptr),
-      sanity_check_(false),
-      depth_choice_buf_(MAX_DEPTH, std::vector<uint16_t>()),
-      depth_upper_choice_buf_(MAX_DEPTH, std::vector<uint16_t>()),
-      depth_lower_choice_buf_(MAX_DEPTH, std::vector<uint16_t>()) {}
+      hidden_node_stack_(make_unique<HiddenNodeStack<node_t>>(resource)),
+      sanity_check_(obj.sanity_check_),
+      frames_(),
+      replay_depth_(0),
+      base_depth_(0),
+      search_depth_(0),
+      search_step_(SearchStep::Enter),
+      up_rank_choice_buf_() {
+    if (!table_.empty()) {
+        dp_mgr_ = make_unique<DpManager<L>>(table_, num_var_, resource_);
+    }
+    stopwatch.setTimeBound(1200);
+}
+
+template <typename L>
+void ZddWithLinks<L>::mark_search_start() {
+    search_start_ = std::chrono::steady_clock::now();
+    first_solution_time_ = -1.0;
+}
+
+template <typename L>
+void ZddWithLinks<L>::add_solutions(const int depth,
+                                    const count128_t count) {
+    if (count == 0) return;
+    if (first_solution_time_ < 0) {
+        first_solution_time_ =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                          search_start_)
+                .count();
+    }
+    num_solutions += count;
+    if (solution_limit_ != UINT64_MAX) {
+        Solution solution(depth);
+        for (int d = 0; d < depth; d++) {
+            depth_option(d, solution[d]);
+        }
+        found_solutions_.emplace_back(std::move(solution));
+    }
+}
+
+template <typename L>
+void ZddWithLinks<L>::rank_column_nodes(const int depth, const int column) {
+    Frame &frame = frames_[depth];
+    auto &order = frame.node_order;
+    order.clear();
+    for (node_t node_id = header_[column].down; node_id >= 0;
+         node_id = table_[node_id].down) {
+        order.push_back(node_id);
+    }
+    // the options of a node can exceed count_t, as in the column counts.
+    stable_sort(order.begin(), order.end(), [this](node_t a, node_t b) {
+        return (wide_count_t)table_[a].count_upper * table_[a].count_hi >
+               (wide_count_t)table_[b].count_upper * table_[b].count_hi;
+    });
+    frame.node_pos = 0;
+}
+
+template <typename L>
+typename ZddWithLinks<L>::node_t ZddWithLinks<L>::next_ranked_node(
+    const int depth) {
+    const Frame &frame = frames_[depth];
+    const auto &order = frame.node_order;
+    return frame.node_pos + 1 < order.size() ? order[frame.node_pos + 1] : -1;
+}
+
+template <typename L>
+typename ZddWithLinks<L>::wide_count_t ZddWithLinks<L>::upper_choice_score(
+    const vector<column_t> &upper_choice) const {
+    // the options of the columns covered by the upper choice.
+    wide_count_t score = 0;
+    for (const auto col : upper_choice) {
+        score += header_[col].count;
+    }
+    return score;
+}
+
+template <typename L>
+void ZddWithLinks<L>::rank_upper_choices(const int depth) {
+    Frame &frame = frames_[depth];
+    frame.up_order.clear();
+    frame.up_order_start = frame.up_pos;
+    if (frame.resumed) {
+        // continue after the choice another replica has searched.
+        frame.up_order.emplace_back(upper_choice_score(frame.upper_choice),
+                                    frame.up_id);
+    }
+}
+
+template <typename L>
+typename ZddWithLinks<L>::count_t ZddWithLinks<L>::ranked_upper_choice(
+    const int depth) {
+    Frame &frame = frames_[depth];
+    auto &order = frame.up_order;
+    while (frame.up_pos - frame.up_order_start >= order.size()) {
+        // the next batch, twice the last one: the smallest (score, up_id)
+        // after the last one, kept in a max-heap.
+        const size_t batch =
+            min(max(2 * order.size(), UP_RANK_BATCH), UP_RANK_BATCH_MAX);
+        const bool after = !order.empty();
+        const auto last = after ? order.back()
+                                : make_pair(wide_count_t(0), count_t(0));
+        frame.up_order_start += order.size();
+        order.clear();
+        const count_t up_end = table_[frame.node_id].count_upper;
+        for (count_t up_id = 0; up_id < up_end; up_id++) {
+            compute_upper_choice(frame.node_id, up_id, up_rank_choice_buf_);
+            const auto score_id =
+                make_pair(upper_choice_score(up_rank_choice_buf_), up_id);
+            if (after && !(last < score_id)) continue;
+            if (order.size() < batch) {
+                order.push_back(score_id);
+                push_heap(order.begin(), order.end());
+            } else if (score_id < order.front()) {
+                pop_heap(order.begin(), order.end());
+                order.back() = score_id;
+                push_heap(order.begin(), order.end());
+            }
+        }
+        sort_heap(order.begin(), order.end());
+    }
+    return order[frame.up_pos - frame.up_order_start].second;
+}
+
+template <typename L>
+void ZddWithLinks<L>::push_solution(const Solution &solution,
+                                    const size_t size) {
+    writer_->push(solution, size, writer_shared_);
+    writer_shared_ = size;
+}
+
+template <typename L>
+void ZddWithLinks<L>::count_leaf_solutions(Solution &solution,
+                                           const int depth, const int column,
+                                           const int remain_cols) {
+    const count_t count = header_[column].count;
+    if (writer_ != nullptr && solution.size() < (size_t)depth + 2) {
+        solution.resize(depth + 2);
+    }
+    if (remain_cols == 1) {
+        // every option left is {column}, and each one is a solution.
+        add_solutions(depth, count);
+        num_search_tree_nodes += count;
+        for (count_t i = 0; writer_ != nullptr && i < count; i++) {
+            solution[depth].assign(1, (column_t)column);
+            writer_shared_ = min(writer_shared_, (size_t)depth);
+            push_solution(solution, depth + 1);
+        }
+        return;
+    }
+
+    // two columns a and b, with options {a}, {b} and {a, b}. covering a
+    // leaves the options {b}, the rest of b's count are the options {a, b}.
+    const int other =
+        header_[0].right == column ? header_[column].right : header_[0].right;
+    const count_t count_other = header_[other].count;
+    auto &choice = frame_at(depth).column;
+    choice.assign(1, (column_t)column);
+    batch_cover(choice.cbegin(), choice.cend());
+    const wide_count_t num_b = header_[other].count;
+    batch_uncover(choice.cbegin(), choice.cend());
+    const wide_count_t num_ab = count_other - num_b;
+    const wide_count_t num_a = count - num_ab;
+
+    add_solutions(depth, num_ab + num_a * num_b);
+    // a child per option of a, and below each {a} a leaf per option {b}.
+    num_search_tree_nodes += num_ab + num_a + num_a * num_b;
+    if (num_b == 0) {
+        num_failure_backtracks += num_a;
+    }
+    if (writer_ != nullptr) {
+        const column_t a = min(column, other), b = max(column, other);
+        for (wide_count_t i = 0; i < num_ab; i++) {
+            solution[depth] = {a, b};
+            writer_shared_ = min(writer_shared_, (size_t)depth);
+            push_solution(solution, depth + 1);
+        }
+        for (wide_count_t i = 0; i < num_a * num_b; i++) {
+            solution[depth].assign(1, (column_t)column);
+            solution[depth + 1].assign(1, (column_t)other);
+            writer_shared_ = min(writer_shared_, (size_t)depth);
+            push_solution(solution, depth + 2);
+        }
+    }
+}
+
+template <typename L>
+void ZddWithLinks<L>::set_output_zdd(OutputZdd *output) {
+    output_ = output;
+    if (output_ != nullptr) {
+        option_index_ = make_unique<OptionIndex>(table_);
+    } else {
+        option_index_.reset();
+    }
+}
+
+template <typename L>
+void ZddWithLinks<L>::add_output_option(const int depth) {
+    if (output_result_ == OutputZdd::ZERO) return;
+    depth_option(depth, output_option_buf_);
+    frames_[depth].output_options.emplace_back(
+        option_index_->rank(output_option_buf_) + 1, output_result_);
+}
+
+template <typename L>
+OutputZdd::node_t ZddWithLinks<L>::unite_output_options(const int depth) {
+    // from the largest option down, so that each option becomes the new
+    // root of the union instead of being merged below the others.
+    auto &options = frames_[depth].output_options;
+    sort(options.begin(), options.end(), greater<>());
+    OutputZdd::node_t family = OutputZdd::ZERO;
+    for (const auto &[var, below] : options) {
+        family = output_->unite(family, output_->change(below, var));
+    }
+    return family;
+}
+
+template <typename L>
+const SubproblemCache::Key &ZddWithLinks<L>::uncovered_columns_key() {
+    memo_key_.assign((num_var_ >> 6) + 1, 0ULL);
+    for (int head_pos = header_[0].right; head_pos != 0;
+         head_pos = header_[head_pos].right) {
+        memo_key_[head_pos >> 6] |= 1ULL << (head_pos & 63);
+    }
+    return memo_key_;
+}
 
-bool ZddWithLinks::operator==(const ZddWithLinks &obj) const {
+string SearchConfig::name() const {
+    string tie;
+    switch (tie_break) {
+        case TieBreak::First:
+            tie = "first";
+            break;
+        case TieBreak::Last:
+            tie = "last";
+            break;
+        case TieBreak::Random:
+            tie = "random" + to_string(seed);
+            break;
+    }
+    string nodes;
+    switch (node_order) {
+        case NodeOrder::Down:
+            nodes = "-down";
+            break;
+        case NodeOrder::Up:
+            nodes = "-up";
+            break;
+        case NodeOrder::Count:
+            nodes = "-count";
+            break;
+    }
+    string upper;
+    switch (upper_order) {
+        case UpperOrder::Ascending:
+            upper = "-asc";
+            break;
+        case UpperOrder::Descending:
+            upper = "-desc";
+            break;
+        case UpperOrder::Lookahead:
+            upper = "-look";
+            break;
+    }
+    string rule;
+    switch (column_rule) {
+        case ColumnRule::Mrv:
+            break;
+        case ColumnRule::Nodes:
+            rule = "-nodes";
+            break;
+        case ColumnRule::Cost:
+            rule = "-cost";
+            break;
+        case ColumnRule::Lookahead:
+            rule = "-lookahead";
+            break;
+    }
+    return tie + nodes + upper + rule;
+}
+
+SearchConfig SearchConfig::parse(const string &name) {
+    SearchConfig config;
+    istringstream iss(name);
+    string tie, nodes, upper, rule;
+    getline(iss, tie, '-');
+    getline(iss, nodes, '-');
+    getline(iss, upper, '-');
+    getline(iss, rule, '-');
+
+    if (tie == "first") {
+        config.tie_break = TieBreak::First;
+    } else if (tie == "last") {
+        config.tie_break = TieBreak::Last;
+    } else if (tie.compare(0, 6, "random") == 0) {
+        config.tie_break = TieBreak::Random;
+        config.seed = tie.size() > 6 ? stoull(tie.substr(6)) : 0;
+    } else {
+        throw std::invalid_argument("unknown search config: " + name);
+    }
+
+    if (nodes.empty() || nodes == "down") {
+        config.node_order = NodeOrder::Down;
+    } else if (nodes == "up") {
+        config.node_order = NodeOrder::Up;
+    } else if (nodes == "count") {
+        config.node_order = NodeOrder::Count;
+    } else {
+        throw std::invalid_argument("unknown search config: " + name);
+    }
+
+    if (upper.empty() || upper == "asc") {
+        config.upper_order = UpperOrder::Ascending;
+    } else if (upper == "desc") {
+        config.upper_order = UpperOrder::Descending;
+    } else if (upper == "look") {
+        config.upper_order = UpperOrder::Lookahead;
+    } else {
+        throw std::invalid_argument("unknown search config: " + name);
+    }
+
+    if (rule.empty() || rule == "mrv") {
+        config.column_rule = ColumnRule::Mrv;
+    } else if (rule == "nodes") {
+        config.column_rule = ColumnRule::Nodes;
+    } else if (rule == "cost") {
+        config.column_rule = ColumnRule::Cost;
+    } else if (rule == "lookahead") {
+        config.column_rule = ColumnRule::Lookahead;
+    } else {
+        throw std::invalid_argument("unknown search config: " + name);
+    }
+    return config;
+}
+
+template <typename L>
+bool ZddWithLinks<L>::operator==(const ZddWithLinks &obj) const {
     // intended to be used for debugging.
     if (num_var_ != obj.num_var_) return false;
 
     if (table_.size() != obj.table_.size()) return false;
     bool equals = true;
     for (size_t i = 0; i < table_.size(); i++) {
-        if (table_[i] != obj.table_[i]) {
+        if (table_[i] != obj.table_[i] || links_[i] != obj.links_[i]) {
             fprintf(stderr, "node %lu differs\n", i);
             equals = false;
         }
@@ -75,119 +476,679 @@ bool ZddWithLinks::operator==(const ZddWithLinks &obj) const {
     return equals;
 }
 
-void ZddWithLinks::search(vector<vector<uint16_t>> &solution, const int depth) {
+template <typename L>
+void ZddWithLinks<L>::search(Solution &solution, const int depth) {
+    start_search(depth);
+    resume_search(solution);
+}
+
+template <typename L>
+void ZddWithLinks<L>::start_search(const int depth) {
+    replay_depth_ = depth;
+    base_depth_ = depth;
+    search_depth_ = depth;
+    search_step_ = SearchStep::Enter;
+}
+
+template <typename L>
+bool ZddWithLinks<L>::resume_search(Solution &solution, uint64_t max_nodes) {
+    const uint64_t pause_nodes =
+        max_nodes > UINT64_MAX - num_search_tree_nodes
+            ? UINT64_MAX
+            : num_search_tree_nodes + max_nodes;
+    int depth = search_depth_;
+    SearchStep step = search_step_;
+    // a step of the recursion of the search tree: enter a node, go down into
+    // the next option of its frame, or leave the frame and go up.
+    for (;;) {
+        bool frame_open = true;
+        bool has_option;
+        if (step == SearchStep::Enter) {
+            if (num_search_tree_nodes >= pause_nodes) {
+                search_depth_ = depth;
+                search_step_ = step;
+                return false;
+            }
+            frame_open = enter_frame(solution, depth);
+            has_option = frame_open && next_option(solution, depth);
+        } else if (step == SearchStep::Return) {
+            has_option =
+                return_to_frame(depth) && next_option(solution, depth);
+        } else {
+            has_option = next_option(solution, depth);
+        }
+
+        if (has_option) {
+            depth++;
+            step = SearchStep::Enter;
+            continue;
+        }
+        if (frame_open) {
+            leave_frame(depth);
+        }
+        if (depth == base_depth_) break;
+        depth--;
+        step = SearchStep::Return;
+    }
+
+    // the frames of a split above its last one.
+    for (int d = base_depth_ - 1; d >= replay_depth_; d--) {
+        uncover_depth_option(d);
+        batch_uncover(frames_[d].column.cbegin(), frames_[d].column.cend());
+    }
+    search_depth_ = base_depth_;
+    search_step_ = SearchStep::Enter;
+    return true;
+}
+
+template <typename L>
+bool ZddWithLinks<L>::split_search(SearchSplit &split) {
+    for (int depth = base_depth_; depth < search_depth_; depth++) {
+        Frame &frame = frames_[depth];
+        if (frame.split_off || !frame_has_more(frame)) continue;
+
+        frame.split_off = true;
+        split.depth = replay_depth_;
+        split.frames.resize(depth - replay_depth_ + 1);
+        for (int d = replay_depth_; d <= depth; d++) {
+            save_frame(d, split.frames[d - replay_depth_]);
+        }
+        return true;
+    }
+    return false;
+}
+
+template <typename L>
+void ZddWithLinks<L>::start_split(const SearchSplit &split) {
+    // the frames above the last one are replayed as they are, the last
+    // frame only has its column covered; next_option covers its option.
+    const int depth = split.depth + (int)split.frames.size() - 1;
+    for (int d = split.depth; d <= depth; d++) {
+        const FrameState &state = split.frames[d - split.depth];
+        Frame &frame = frame_at(d);
+        frame.column.assign(1, state.column);
+        frame.upper_choice = state.upper_choice;
+        frame.lower_trace = state.lower_trace;
+        frame.lower_change_pts = state.lower_change_pts;
+        batch_cover(frame.column.cbegin(), frame.column.cend());
+        if (d < depth) {
+            cover_depth_option(d);
+        }
+    }
+    if (config_.node_order == SearchConfig::NodeOrder::Count) {
+        // the same state as the other replica's, so the same order.
+        rank_column_nodes(depth, frames_[depth].column[0]);
+    }
+
+    Frame &frame = frames_[depth];
+    frame.node_id = split.frames.back().node_id;
+    frame.node_pos = split.frames.back().node_pos;
+    frame.up_pos = split.frames.back().up_pos;
+    frame.up_id = split.frames.back().up_id;
+    frame.in_node = false;
+    frame.in_option = false;
+    frame.resumed = true;
+    frame.split_off = false;
+    frame.memoize = false;
+    frame.output_options.clear();
+
+    replay_depth_ = split.depth;
+    base_depth_ = depth;
+    search_depth_ = depth;
+    search_step_ = SearchStep::Next;
+}
+
+template <typename L>
+bool ZddWithLinks<L>::enter_frame(Solution &solution, const int depth) {
     if (stopwatch.timeBoundBroken()) {
         throw std::runtime_error("time limit exceeded");
     }
+    if (cancel_flag_ != nullptr &&
+        cancel_flag_->load(std::memory_order_relaxed)) {
+        throw std::runtime_error("search cancelled");
+    }
+    if (depth == cube_depth_) {
+        cube_splitter_->emit_cube(depth);
+        return false;
+    }
    
     num_search_tree_nodes++;
 
 
     if (header_[0].right == 0)  // all columns are covered
     {
-        num_solutions += 1;
+        add_solutions(depth, 1);
+        output_result_ = OutputZdd::ONE;
+        if (writer_ != nullptr) {
+            push_solution(solution, depth);
+        }
 
-        return;
+        return false;
+    }
+
+    int remain_cols;
+    int min_count_column = choose_column(remain_cols);
+    if (min_count_column < 0) {
+        // cannot cover column, backtrack.
+        num_failure_backtracks++;
+        output_result_ = OutputZdd::ZERO;
+        return false;
+    }
+
+    if (remain_cols <= 2 && output_ == nullptr &&
+        solution_limit_ == UINT64_MAX) {
+        count_leaf_solutions(solution, depth, min_count_column, remain_cols);
+        return false;
+    }
+    if (output_ != nullptr) {
+        // an option covering the smallest uncovered column precedes the
+        // options below it, so its family is a new root and not changed in
+        // place. The chosen column is kept only if it branches much less.
+        const int first = header_[0].right;
+        if (header_[first].count / OUTPUT_BRANCH_FACTOR <=
+            header_[min_count_column].count) {
+            min_count_column = first;
+        }
+    }
+
+    // look up the uncovered columns; only whole subtrees are memoized.
+    Frame &frame = frame_at(depth);
+    frame.memoize = memo_ != nullptr && work_stealing_ == nullptr &&
+                    cube_splitter_ == nullptr && writer_ == nullptr &&
+                    solution_limit_ == UINT64_MAX;
+    frame.num_solutions_before = num_solutions;
+    frame.num_nodes_before = num_search_tree_nodes;
+    if (frame.memoize) {
+        if (const auto *result = memo_->find(uncovered_columns_key())) {
+            num_solutions += result->num_solutions;
+            output_result_ = result->family;
+            return false;
+        }
+    }
+    if (output_ != nullptr) {
+        frame.output_options.clear();
+    }
+
+    frame.column.assign(1, (column_t)min_count_column);
+    batch_cover(frame.column.cbegin(), frame.column.cend());
+
+    if (config_.node_order == SearchConfig::NodeOrder::Count) {
+        rank_column_nodes(depth, min_count_column);
+        frame.node_id = frame.node_order.empty() ? -1 : frame.node_order[0];
+    } else {
+        frame.node_id = config_.node_order == SearchConfig::NodeOrder::Down
+                            ? header_[min_count_column].down
+                            : header_[min_count_column].up;
+    }
+    frame.up_pos = 0;
+    frame.in_node = false;
+    frame.in_option = false;
+    frame.resumed = false;
+    frame.split_off = false;
+    return true;
+}
+
+template <typename L>
+void ZddWithLinks<L>::leave_frame(const int depth) {
+    Frame &frame = frames_[depth];
+    if (depth < steal_depth_) {
+        work_stealing_->close_frame(worker_id_, depth);
+    }
+    batch_uncover(frame.column.cbegin(), frame.column.cend());
+
+    if (sanity_check_ && sanity()) {
+        cerr << "inconsistent after uncover" << endl;
+    }
+
+    if (output_ != nullptr) {
+        output_result_ = unite_output_options(depth);
     }
+    if (frame.memoize) {
+        // the key buffer was reused below; rebuild it for this node.
+        memo_->insert(uncovered_columns_key(), depth,
+                      {num_solutions - frame.num_solutions_before,
+                       num_search_tree_nodes - frame.num_nodes_before + 1,
+                       output_result_});
+    }
+}
 
+template <typename L>
+int ZddWithLinks<L>::choose_column(int &remain_cols) {
+    switch (config_.column_rule) {
+        case SearchConfig::ColumnRule::Mrv:
+            break;
+        case SearchConfig::ColumnRule::Nodes:
+        case SearchConfig::ColumnRule::Cost:
+            return choose_scored_column(remain_cols);
+        case SearchConfig::ColumnRule::Lookahead:
+            return choose_lookahead_column(remain_cols);
+    }
     // choose the column with minimum count
-    count_t min_count = UINT32_MAX;
+    const auto tie_break = config_.tie_break;
+    if (tie_break != SearchConfig::TieBreak::Random) {
+        // one scan of the active column set; the header list is ordered by
+        // column, so First and Last pick the smallest and largest column.
+        remain_cols = num_active_;
+        if (num_active_ == 0) return -1;
+        const uint32_t col = min_count_column(
+            active_counts_.data(), active_columns_.data(), num_active_,
+            tie_break == SearchConfig::TieBreak::Last);
+        return col == 0 ? -1 : (int)col;
+    }
+    // Random draws from rng_ in the order of the header list.
+    count_t min_count = ~(count_t)0;
     int min_count_column = -1;
-    int remain_cols = 0;
+    int num_ties = 0;
+    remain_cols = 0;
     for (int head_pos = header_[0].right; head_pos != 0;
          head_pos = header_[head_pos].right) {
         const Header &header = header_[head_pos];
         remain_cols++;
 
         if (header.count == 0) {
-            // cannot cover column, backtrack.
-            num_failure_backtracks++;
-            return;
+            return -1;
         }
 
         if (header.count < min_count) {
             min_count_column = head_pos;
             min_count = header.count;
+            num_ties = 1;
+        } else if (header.count == min_count && rng_() % ++num_ties == 0) {
+            // reservoir sampling among the ties.
+            min_count_column = head_pos;
         }
     }
+    return min_count_column;
+}
+
+template <typename L>
+int ZddWithLinks<L>::choose_scored_column(int &remain_cols) {
+    // Nodes ranks by (count, nodes), Cost by count * nodes, which only
+    // approximates the updates of the covers (see SearchConfig): the real
+    // number is known only after covering, as choose_lookahead_column does.
+    // The nodes of a column are counted only as far as they can beat the
+    // best column.
+    const bool by_cost = config_.column_rule == SearchConfig::ColumnRule::Cost;
+    const auto tie_break = config_.tie_break;
+    const uint64_t no_limit = numeric_limits<uint64_t>::max();
+    count_t best_count = 0;
+    wide_count_t best_score = 0;
+    int best_column = -1;
+    int num_ties = 0;
+    remain_cols = 0;
+    for (int col = header_[0].right; col != 0; col = header_[col].right) {
+        remain_cols++;
+        const count_t count = header_[col].count;
+        if (count == 0) {
+            return -1;
+        }
 
-    depth_choice_buf_[depth].clear();
-    depth_choice_buf_[depth].push_back((uint16_t)min_count_column);
-    batch_cover(std::cbegin(depth_choice_buf_[depth]),
-                std::cend(depth_choice_buf_[depth]));
-    int node_id = header_[min_count_column].down;
+        bool better;
+        wide_count_t score;
+        if (best_column < 0) {
+            better = true;
+            score = column_nodes(col, no_limit);
+            if (by_cost) score *= count;
+        } else if (by_cost) {
+            if (count > best_score) continue;  // a column has a node
+            score = (wide_count_t)count *
+                    column_nodes(col, (uint64_t)(best_score / count) + 1);
+            if (score > best_score) continue;
+            better = score < best_score;
+        } else {
+            if (count > best_count) continue;
+            better = count < best_count;
+            score = column_nodes(col, better ? no_limit
+                                             : (uint64_t)best_score + 1);
+            if (!better && score > best_score) continue;
+            better = better || score < best_score;
+        }
 
-    int lower_change_idx = -1;
+        if (better) {
+            best_column = col;
+            best_count = count;
+            best_score = score;
+            num_ties = 1;
+        } else if (tie_break != SearchConfig::TieBreak::First) {
+            // Last: the later column wins. Random: reservoir sampling.
+            if (tie_break == SearchConfig::TieBreak::Last ||
+                rng_() % ++num_ties == 0) {
+                best_column = col;
+            }
+        }
+    }
+    return best_column;
+}
 
-    while (node_id >= 0) {
-        // choose an option and cover columns
+template <typename L>
+int ZddWithLinks<L>::choose_lookahead_column(int &remain_cols) {
+    // the columns with the fewest options, in column order.
+    auto &candidates = lookahead_candidates_;
+    candidates.clear();
+    count_t min_count = ~(count_t)0;
+    remain_cols = 0;
+    for (int col = header_[0].right; col != 0; col = header_[col].right) {
+        remain_cols++;
+        const count_t count = header_[col].count;
+        if (count == 0) {
+            return -1;
+        }
+        if (count < min_count) {
+            min_count = count;
+            candidates.assign(1, (column_t)col);
+        } else if (count == min_count) {
+            candidates.push_back(col);
+        }
+    }
+    if (candidates.empty()) {
+        return -1;
+    }
+
+    // the candidates in the order of the tie break; the first of the least
+    // branching wins.
+    switch (config_.tie_break) {
+        case SearchConfig::TieBreak::First:
+            break;
+        case SearchConfig::TieBreak::Last:
+            reverse(candidates.begin(), candidates.end());
+            break;
+        case SearchConfig::TieBreak::Random:
+            for (size_t i = candidates.size(); i > 1; i--) {
+                swap(candidates[i - 1], candidates[rng_() % i]);
+            }
+            break;
+    }
+    // the leaves of two columns are counted in closed form.
+    if (candidates.size() == 1 || remain_cols <= 2) {
+        return candidates[0];
+    }
+    if (candidates.size() > LOOKAHEAD_COLUMNS) {
+        candidates.resize(LOOKAHEAD_COLUMNS);
+    }
+
+    int best_column = candidates[0];
+    wide_count_t best_score = ~(wide_count_t)0;
+    for (const auto col : candidates) {
+        const wide_count_t score = lookahead_branching(col, best_score);
+        if (score < best_score) {
+            best_column = col;
+            best_score = score;
+        }
+    }
+    return best_column;
+}
+
+template <typename L>
+uint64_t ZddWithLinks<L>::column_nodes(int col, uint64_t limit) const {
+    uint64_t num_nodes = 0;
+    for (node_t node_id = header_[col].down; node_id >= 0 && num_nodes < limit;
+         node_id = table_[node_id].down) {
+        num_nodes++;
+    }
+    return num_nodes;
+}
+
+template <typename L>
+typename ZddWithLinks<L>::wide_count_t ZddWithLinks<L>::lookahead_branching(
+    int col, wide_count_t limit) {
+    // the options of the column, as next_option enumerates them.
+    wide_count_t score = 0;
+    lookahead_column_buf_.assign(1, (column_t)col);
+    batch_cover(lookahead_column_buf_.cbegin(), lookahead_column_buf_.cend());
+    for (node_t node_id = header_[col].down; node_id >= 0 && score < limit;) {
         const Node &node = table_[node_id];
+        const node_t next_node_id = node.down;
+        const count_t up_end = node.count_upper;
+        const count_t down_end = node.count_hi;
+        for (count_t up_id = 0; up_id < up_end && score < limit; up_id++) {
+            compute_upper_choice(node_id, up_id, lookahead_upper_buf_);
+            reverse(lookahead_upper_buf_.begin(), lookahead_upper_buf_.end());
+            for (count_t down_id = 0; down_id < down_end && score < limit;
+                 down_id++) {
+                compute_lower_choice(node.hi, down_id, lookahead_lower_buf_);
+                auto &option = lookahead_option_buf_;
+                option.assign(lookahead_upper_buf_.cbegin(),
+                              lookahead_upper_buf_.cend());
+                option.insert(option.end(), lookahead_lower_buf_.cbegin(),
+                              lookahead_lower_buf_.cend());
+                batch_cover(option.cbegin(), option.cend());
+                if (num_active_ == 0) {
+                    score += 1;
+                } else {
+                    const uint32_t next = min_count_column(
+                        active_counts_.data(), active_columns_.data(),
+                        num_active_, false);
+                    if (next != 0) score += header_[next].count;
+                }
+                batch_uncover(option.cbegin(), option.cend());
+            }
+        }
+        node_id = next_node_id;
+    }
+    batch_uncover(lookahead_column_buf_.cbegin(),
+                  lookahead_column_buf_.cend());
+    return score;
+}
 
-        for (auto up_id = 0; up_id < node.count_upper; ++up_id) {
-            compute_upper_choice(node_id, up_id,
-                                 depth_upper_choice_buf_[depth]);
-            reverse(depth_upper_choice_buf_[depth].begin(),
-                    depth_upper_choice_buf_[depth].end());
-            batch_cover(depth_upper_choice_buf_[depth].begin(),
-                        depth_upper_choice_buf_[depth].end());
-
-            compute_lower_initial_choice(node.hi, depth_lower_trace_buf_[depth],
-                                         depth_lower_change_pts_buf_[depth],
-                                         depth_lower_choice_buf_[depth]);
-            for (;;) {
-                search(solution, depth + 1);
-
-                bool finished = compute_lower_next_choice(
-                    depth_lower_trace_buf_[depth],
-                    depth_lower_change_pts_buf_[depth],
-                    depth_lower_choice_buf_[depth]);
-                if (finished) break;
+template <typename L>
+void ZddWithLinks<L>::setup_active_columns() {
+    active_counts_.assign(num_var_, 0);
+    active_columns_.assign(num_var_, 0);
+    active_pos_.assign(num_var_ + 1, 0);
+    num_active_ = 0;
+    for (int col = header_[0].right; col != 0; col = header_[col].right) {
+        active_counts_[num_active_] = header_[col].count;
+        active_columns_[num_active_] = col;
+        active_pos_[col] = num_active_++;
+    }
+}
+
+template <typename L>
+bool ZddWithLinks<L>::next_option(Solution &solution, const int depth) {
+    Frame &frame = frames_[depth];
+    const bool nodes_down = config_.node_order == SearchConfig::NodeOrder::Down;
+    const bool nodes_ranked =
+        config_.node_order == SearchConfig::NodeOrder::Count;
+    const bool upper_ascending =
+        config_.upper_order == SearchConfig::UpperOrder::Ascending;
+    const bool upper_ranked =
+        config_.upper_order == SearchConfig::UpperOrder::Lookahead;
+
+    for (;;) {
+        if (frame.in_option) {
+            if (frame.split_off) {
+                uncover_depth_option(depth);
+                frame.in_option = false;
+                return false;
+            }
+            bool finished = compute_lower_next_choice(
+                frame.lower_trace, frame.lower_change_pts, frame.lower_choice);
+            if (!finished) break;
+            batch_uncover(frame.upper_choice.cbegin(),
+                          frame.upper_choice.cend());
+            frame.in_option = false;
+            frame.up_pos++;
+        }
+
+        if (!frame.in_node) {
+            if (frame.node_id < 0) return false;
+            const Node &node = table_[frame.node_id];
+            frame.up_end = node.count_upper;
+            if (nodes_ranked) {
+                frame.next_node_id = next_ranked_node(depth);
+            } else {
+                frame.next_node_id = nodes_down ? node.down : node.up;
             }
-            batch_uncover(depth_upper_choice_buf_[depth].begin(),
-                          depth_upper_choice_buf_[depth].end());
+            if (upper_ranked) {
+                rank_upper_choices(depth);
+            }
+            frame.in_node = true;
+        }
+        if (frame.up_pos >= frame.up_end) {
+            frame.in_node = false;
+            frame.up_pos = 0;
+            frame.node_id = frame.next_node_id;
+            frame.node_pos++;
+            continue;
+        }
+
+        // choose an option and cover columns
+        frame.in_option = true;
+        if (frame.resumed) {
+            // the current choice has been searched by another replica.
+            cover_depth_option(depth);
+            frame.resumed = false;
+            continue;
+        }
+        if (upper_ranked) {
+            frame.up_id = ranked_upper_choice(depth);
+        } else {
+            frame.up_id = upper_ascending ? frame.up_pos
+                                          : frame.up_end - 1 - frame.up_pos;
+        }
+        compute_upper_choice(frame.node_id, frame.up_id, frame.upper_choice);
+        reverse(frame.upper_choice.begin(), frame.upper_choice.end());
+        batch_cover(frame.upper_choice.cbegin(), frame.upper_choice.cend());
+
+        compute_lower_initial_choice(table_[frame.node_id].hi,
+                                     frame.lower_trace, frame.lower_change_pts,
+                                     frame.lower_choice);
+        break;
+    }
+
+    if (depth < steal_depth_ &&
+        !work_stealing_->publish_frame(worker_id_, depth,
+                                       frame_has_more(frame))) {
+        // the remaining options were stolen.
+        uncover_depth_option(depth);
+        frame.in_option = false;
+        return false;
+    }
+    if (writer_ != nullptr) {
+        if ((int)solution.size() <= depth) {
+            solution.resize(depth + 1);
         }
+        depth_option(depth, solution[depth]);
+        writer_shared_ = min(writer_shared_, (size_t)depth);
+    }
+    return true;
+}
 
-        node_id = node.down;
+template <typename L>
+bool ZddWithLinks<L>::return_to_frame(const int depth) {
+    if (output_ != nullptr) {
+        add_output_option(depth);
     }
+    if (num_solutions >= solution_limit_) {
+        uncover_depth_option(depth);
+        frames_[depth].in_option = false;
+        return false;
+    }
+    return true;
+}
+
+template <typename L>
+void ZddWithLinks<L>::save_frame(const int depth, FrameState &state) const {
+    const Frame &frame = frames_[depth];
+    state.column = frame.column[0];
+    state.node_id = frame.node_id;
+    state.up_pos = frame.up_pos;
+    state.up_id = frame.up_id;
+    state.node_pos = frame.node_pos;
+    state.upper_choice = frame.upper_choice;
+    state.lower_trace = frame.lower_trace;
+    state.lower_change_pts = frame.lower_change_pts;
+}
 
-    batch_uncover(std::cbegin(depth_choice_buf_[depth]),
-                  std::cend(depth_choice_buf_[depth]));
+template <typename L>
+void ZddWithLinks<L>::depth_option(const int depth,
+                                   vector<column_t> &option) const {
+    // upper vars < the chosen column < lower vars
+    const Frame &frame = frames_[depth];
+    trace2choice(frame.lower_trace.cbegin(), frame.lower_trace.cend(), option);
+    option.insert(option.begin(), frame.column[0]);
+    option.insert(option.begin(), frame.upper_choice.cbegin(),
+                  frame.upper_choice.cend());
+}
 
-    if (sanity_check_ && sanity()) {
-        cerr << "inconsistent after uncover" << endl;
+template <typename L>
+void ZddWithLinks<L>::cover_depth_option(const int depth) {
+    Frame &frame = frames_[depth];
+    batch_cover(frame.upper_choice.cbegin(), frame.upper_choice.cend());
+    cover_lower_segments(frame.lower_trace, frame.lower_change_pts,
+                         frame.lower_choice);
+}
+
+template <typename L>
+void ZddWithLinks<L>::uncover_depth_option(const int depth) {
+    Frame &frame = frames_[depth];
+    uncover_lower_segments(frame.lower_trace, frame.lower_change_pts,
+                           frame.lower_choice);
+    batch_uncover(frame.upper_choice.cbegin(), frame.upper_choice.cend());
+}
+
+template <typename L>
+void ZddWithLinks<L>::cover_lower_segments(const vector<plink_t> &visited,
+                                           const vector<size_t> &diff_choices,
+                                           vector<column_t> &choice_buf) {
+    size_t prev_choice = 0;
+    for (auto idx : diff_choices) {
+        trace2choice(visited.begin() + prev_choice, visited.begin() + idx,
+                     choice_buf);
+        prev_choice = idx;
+        batch_cover(choice_buf.cbegin(), choice_buf.cend());
     }
+    trace2choice(visited.begin() + prev_choice, visited.end(), choice_buf);
+    batch_cover(choice_buf.cbegin(), choice_buf.cend());
+}
 
-    return;
+template <typename L>
+void ZddWithLinks<L>::uncover_lower_segments(const vector<plink_t> &visited,
+                                             const vector<size_t> &diff_choices,
+                                             vector<column_t> &choice_buf) {
+    size_t next_choice = visited.size();
+    for (auto it = diff_choices.rbegin(); it != diff_choices.rend(); ++it) {
+        trace2choice(visited.begin() + *it, visited.begin() + next_choice,
+                     choice_buf);
+        next_choice = *it;
+        batch_uncover(choice_buf.cbegin(), choice_buf.cend());
+    }
+    trace2choice(visited.begin(), visited.begin() + next_choice, choice_buf);
+    batch_uncover(choice_buf.cbegin(), choice_buf.cend());
 }
 
 // 从文件中加载ZDD
-void ZddWithLinks::load_zdd_from_file(const string &file_name) {
+template <typename L>
+void ZddWithLinks<L>::load_zdd_from_file(const string &file_name) {
     ifstream ifs(file_name);
 
     if (!ifs) {
-        cerr << "can't open " << file_name << endl;
-        exit(1);
+        throw std::runtime_error("can't open " + file_name);
     }
 
     string line;
 
-    unordered_map<int, int> id_convert_table;
+    unordered_map<int64_t, node_t> id_convert_table;
 
     // 按行读取文件
     while (getline(ifs, line)) {
         if (line[0] == '.' || line[0] == '\n' || line[0] == '#' || line.size() == 0) continue;
 
         istringstream iss(line);
-        int nid;
+        int64_t nid;
         int var;
         string lo_str;
-        int lo_id;
+        node_t lo_id;
         string hi_str;
-        int hi_id;
+        node_t hi_id;
         iss >> nid; // 节点编号
         iss >> var; // 变量序号
         iss >> lo_str; // 低变量节点编号字符串
         iss >> hi_str; // 高变量节点编号字符串
+        if (var < 1 || var > num_var_ || lo_str.empty() || hi_str.empty()) {
+            throw std::runtime_error("bad node line in " + file_name + ": " +
+                                     line);
+        }
 
         id_convert_table[nid] = table_.size();
         if (lo_str[0] == 'B') {
@@ -195,14 +1156,14 @@ void ZddWithLinks::load_zdd_from_file(const string &file_name) {
         } else if (lo_str[0] == 'T') {
             lo_id = DD_ONE_TERM;
         } else {
-            lo_id = id_convert_table[stoi(lo_str)];
+            lo_id = id_convert_table[stoll(lo_str)];
         }
         if (hi_str[0] == 'B') {
             hi_id = DD_ZERO_TERM;
         } else if (hi_str[0] == 'T') {
             hi_id = DD_ONE_TERM;
         } else {
-            hi_id = id_convert_table[stoi(hi_str)];
+            hi_id = id_convert_table[stoll(hi_str)];
         }
         table_.emplace_back(var, hi_id, lo_id);
     }
@@ -210,9 +1171,89 @@ void ZddWithLinks::load_zdd_from_file(const string &file_name) {
     setup_dancing_links();
 }
 
-void ZddWithLinks::batch_cover(
-    const std::vector<uint16_t>::const_iterator col_begin,
-    const std::vector<uint16_t>::const_iterator col_end) {
+template <typename L>
+void ZddWithLinks<L>::load_zdd(const ZddLoader &loader, int num_threads) {
+    const auto &nodes = loader.nodes();
+    table_.reserve(nodes.size());
+    for (const auto &node : nodes) {
+        if (node.var > static_cast<uint32_t>(num_var_)) {
+            throw std::runtime_error("variable " + to_string(node.var) +
+                                     " out of range");
+        }
+        table_.emplace_back(node.var, node.hi, node.lo);
+    }
+
+    setup_dancing_links(num_threads);
+}
+
+template <typename L>
+void ZddWithLinks<L>::renumber_nodes(int num_threads) {
+    const size_t n = table_.size();
+    if (n == 0) return;
+
+    // the nodes of each level in the order of the walk. A child is on a
+    // deeper level, so a level is complete before the walk reaches it.
+    vector<vector<node_t>> levels(num_var_ + 1);
+    vector<char> reached(n, 0);
+    reached[n - 1] = 1;
+    levels[table_[n - 1].var].push_back(n - 1);
+    for (int var = 1; var <= num_var_; var++) {
+        for (size_t k = 0; k < levels[var].size(); k++) {
+            const Node &node = table_[levels[var][k]];
+            for (node_t child : {node.hi, node.lo}) {
+                if (child < 0) continue;
+                if (table_[child].var <= node.var) {
+                    throw std::runtime_error(
+                        "can't renumber: node " + to_string(child) +
+                        " is not below its parent");
+                }
+                if (!reached[child]) {
+                    reached[child] = 1;
+                    levels[table_[child].var].push_back(child);
+                }
+            }
+        }
+    }
+    // nodes not below the root go before the walk of their level, which
+    // keeps the root last.
+    vector<vector<node_t>> unreached(num_var_ + 1);
+    for (size_t i = 0; i < n; i++) {
+        if (!reached[i]) unreached[table_[i].var].push_back(i);
+    }
+
+    // deepest level first, so children stay before their parents.
+    vector<node_t> order;
+    order.reserve(n);
+    for (int var = num_var_; var >= 1; var--) {
+        order.insert(order.end(), unreached[var].cbegin(),
+                     unreached[var].cend());
+        order.insert(order.end(), levels[var].cbegin(), levels[var].cend());
+    }
+    vector<node_t> new_id(n);
+    for (size_t i = 0; i < n; i++) {
+        new_id[order[i]] = i;
+    }
+
+    std::pmr::vector<Node> table(resource_);
+    table.reserve(n);
+    for (node_t node_id : order) {
+        const Node &node = table_[node_id];
+        table.emplace_back(node.var, node.hi >= 0 ? new_id[node.hi] : node.hi,
+                           node.lo >= 0 ? new_id[node.lo] : node.lo);
+    }
+    table_ = std::move(table);
+
+    for (size_t var = 1; var < header_.size(); var++) {
+        header_[var].down = -1;
+        header_[var].up = -1;
+        header_[var].count = 0;
+    }
+    setup_dancing_links(num_threads);
+}
+
+template <typename L>
+void ZddWithLinks<L>::batch_cover(const column_iterator col_begin,
+                                  const column_iterator col_end) {
     assert(is_sorted(col_begin, col_end));
     if (col_begin == col_end) {
         return;
@@ -224,12 +1265,13 @@ void ZddWithLinks::batch_cover(
         auto cleft = header_[col].left, cright = header_[col].right;
         header_[cleft].right = cright;
         header_[cright].left = cleft;
+        deactivate_column(col);
     }
 
     hidden_node_stack_->push_checkpoint();
     {
         auto next_cover_column = col_begin;
-        auto var = *next_cover_column;
+        dp_mgr_->begin_pass();
         for (auto it = col_begin; it != col_end; ++it) {
             const auto col = *it;
             dp_mgr_->add_lower_var(col);
@@ -254,8 +1296,7 @@ void ZddWithLinks::batch_cover(
                                                      node.count_upper);
                     }
 
-                    const auto count_diff_upper =
-                        dp_mgr_->get_count_and_clear(node_id);
+                    const auto count_diff_upper = dp_mgr_->count_at(node_id);
                     if (count_diff_upper > 0 && nlo >= 0) {
                         dp_mgr_->add_node_diff_count(table_[nlo].var, nlo,
                                                      count_diff_upper);
@@ -276,11 +1317,7 @@ void ZddWithLinks::batch_cover(
                         } else {
                             var_head.up = nup;
                         }
-                        if (nlo >= 0) {
-                            auto lo_next = node.lo_next, lo_prev = node.lo_prev;
-                            plink_set_prev(lo_next, lo_prev);
-                            plink_set_next(lo_prev, lo_next);
-                        }
+                        if (nlo >= 0) plink_unlink(lo_plink(node_id));
                     }
 
                     hide_node_cover_down(node_id);
@@ -288,7 +1325,7 @@ void ZddWithLinks::batch_cover(
                 }
             } else {  // var が cover_columnsではなかった場合
 
-                for (size_t i = 0; i < dp_mgr_->num_elems(var); i++) {
+                for (node_t i = 0; i < dp_mgr_->num_elems(var); i++) {
                     num_updates++;
 
                     const auto node_id = dp_mgr_->at(var, i);
@@ -296,8 +1333,7 @@ void ZddWithLinks::batch_cover(
 
                     assert(node.count_upper > 0);
 
-                    const auto upper_count =
-                        dp_mgr_->get_count_and_clear(node_id);
+                    const auto upper_count = dp_mgr_->queued_count(node_id);
                     node.count_upper -= upper_count;
                     var_head.count -= upper_count * node.count_hi;
 
@@ -335,11 +1371,13 @@ void ZddWithLinks::batch_cover(
             }
             // clear dp counter
             dp_mgr_->clear_var_counter(var);
+            sync_active_count(var);
         }
     }
 
     hidden_node_stack_->push_checkpoint();
     // processing upper nodes
+    dp_mgr_->begin_pass();
     for (auto it = col_begin; it != col_end; ++it) {
         const auto col = *it;
         dp_mgr_->add_upper_var(col);
@@ -355,15 +1393,15 @@ void ZddWithLinks::batch_cover(
                  node_id = table_[node_id].down) {
                 num_updates++;
                 Node &node = table_[node_id];
+                Links &links = links_[node_id];
 
                 assert(node.count_hi > 0);
                 assert(dp_mgr_->high_count_at(node_id) == 0);
-                const auto count_diff =
-                    dp_mgr_->get_low_count_and_clear(node_id);
+                const auto count_diff = dp_mgr_->low_count_at(node_id);
 
                 if (node.count_upper > 0) {
-                    if (!plink_is_term(node.parents_head)) {
-                        for (auto plink = node.parents_head;;
+                    if (!plink_is_term(links.parents_head())) {
+                        for (auto plink = links.parents_head();;
                              plink = plink_get_next(plink)) {
                             const auto parent_id = plink_node_id(plink);
                             const Node &parent = table_[parent_id];
@@ -377,7 +1415,7 @@ void ZddWithLinks::batch_cover(
                                     parent.var, parent_id,
                                     count_diff + node.count_hi);
                             }
-                            if (plink == node.parents_tail) break;
+                            if (plink == links.parents_tail()) break;
                         }
                     }
                 }
@@ -387,14 +1425,13 @@ void ZddWithLinks::batch_cover(
         } else {  // var is not cover column
             Header &var_head = header_[var];
 
-            for (size_t i = 0; i < dp_mgr_->num_elems(var); i++) {
+            for (node_t i = 0; i < dp_mgr_->num_elems(var); i++) {
                 num_updates++;
                 const auto node_id = dp_mgr_->at(var, i);
-                const auto low_count =
-                    dp_mgr_->get_low_count_and_clear(node_id);
-                const auto high_count =
-                    dp_mgr_->get_high_count_and_clear(node_id);
+                const auto low_count = dp_mgr_->queued_count(node_id);
+                const auto high_count = dp_mgr_->queued_high_count(node_id);
                 Node &node = table_[node_id];
+                Links &links = links_[node_id];
 
                 auto c_hi = node.count_hi, c_lo = node.count_lo;
                 if (node.count_hi == 0) {
@@ -409,12 +1446,12 @@ void ZddWithLinks::batch_cover(
                 var_head.count -= node.count_upper * high_count;
 
                 // 上流に伝播する．
-                if (!plink_is_term(node.parents_head)) {
-                    for (plink_t plink = node.parents_head;
+                if (!plink_is_term(links.parents_head())) {
+                    for (plink_t plink = links.parents_head();
                          ;  //! plink_is_term(plink);
                          plink = plink_get_next(plink)) {
                         auto parent_id = plink_node_id(plink);
-                        assert(parent_id != node_id);
+                        assert(static_cast<node_t>(parent_id) != node_id);
 
                         Node &parent = table_[parent_id];
                         // activeでない1枝経由の伝播はスキップ
@@ -435,7 +1472,7 @@ void ZddWithLinks::batch_cover(
                                     high_count + low_count);
                             }
                         }
-                        if (plink == node.parents_tail) {
+                        if (plink == links.parents_tail()) {
                             break;
                         }
                     }
@@ -449,6 +1486,7 @@ void ZddWithLinks::batch_cover(
             }
         }
         dp_mgr_->clear_var_counter(var);
+        sync_active_count(var);
     }
     hidden_node_stack_->reverse_current_stack();
     for (auto it = hidden_node_stack_->stack_cbegin();
@@ -459,10 +1497,10 @@ void ZddWithLinks::batch_cover(
         auto nup = node.up, ndown = node.down;
 
         switch (hide_type) {
-            case HiddenNodeStack::HideType::CoverUp:
+            case HiddenNodeStack<node_t>::HideType::CoverUp:
                 hide_node_cover_up(node_id);
                 break;
-            case HiddenNodeStack::HideType::LowerZero:
+            case HiddenNodeStack<node_t>::HideType::LowerZero:
 
                 if (nup >= 0) {
                     table_[nup].down = ndown;
@@ -486,9 +1524,9 @@ void ZddWithLinks::batch_cover(
     }
 }
 
-void ZddWithLinks::batch_uncover(
-    const std::vector<uint16_t>::const_iterator col_begin,
-    const std::vector<uint16_t>::const_iterator col_end) {
+template <typename L>
+void ZddWithLinks<L>::batch_uncover(const column_iterator col_begin,
+                                    const column_iterator col_end) {
     assert(is_sorted(col_begin, col_end));
     if (col_begin == col_end) {
         return;
@@ -507,6 +1545,7 @@ void ZddWithLinks::batch_uncover(
         assert(header_[left].right == right && header_[right].left == left);
         header_[left].right = col;
         header_[right].left = col;
+        reactivate_column(col);
     }
 
     // batch_coverの上方向dpでhideしたノードをすべてunhideする．
@@ -515,11 +1554,11 @@ void ZddWithLinks::batch_uncover(
         hidden_node_stack_->pop();
 
         switch (hide_type) {
-            case HiddenNodeStack::HideType::CoverUp:
+            case HiddenNodeStack<node_t>::HideType::CoverUp:
                 unhide_node_cover_up(node_id);
                 break;
 
-            case HiddenNodeStack::HideType::LowerZero:
+            case HiddenNodeStack<node_t>::HideType::LowerZero:
                 unhide_node_lowerzero(node_id);
 
                 {
@@ -554,6 +1593,7 @@ void ZddWithLinks::batch_uncover(
     {
         auto next_cover_column = col_rbegin;
 
+        dp_mgr_->begin_pass();
         for (auto it = col_begin; it != col_end; ++it) {
             dp_mgr_->add_upper_var(*it);
         }
@@ -565,19 +1605,19 @@ void ZddWithLinks::batch_uncover(
                 for (auto node_id = header_[var].down; node_id >= 0;
                      node_id = table_[node_id].down) {
                     Node &node = table_[node_id];
+                    Links &links = links_[node_id];
                     assert(node.count_hi > 0);
                     assert(dp_mgr_->high_count_at(node_id) == 0);
 
-                    const auto count_diff =
-                        dp_mgr_->get_low_count_and_clear(node_id);
+                    const auto count_diff = dp_mgr_->low_count_at(node_id);
 
-                    if (!plink_is_term(node.parents_head)) {
-                        for (plink_t plink = node.parents_head;
+                    if (!plink_is_term(links.parents_head())) {
+                        for (plink_t plink = links.parents_head();
                              ;  // !plink_is_term(plink);
                              plink = plink_get_next(plink)) {
                             const auto parent_id = plink_node_id(plink);
                             count_t pcount_upper;
-                            uint16_t pvar;
+                            column_t pvar;
                             pcount_upper = table_[parent_id].count_upper,
                             pvar = table_[parent_id].var;
 
@@ -592,7 +1632,7 @@ void ZddWithLinks::batch_uncover(
                                         count_diff + node.count_hi);
                                 }
                             }
-                            if (plink == node.parents_tail) {
+                            if (plink == links.parents_tail()) {
                                 break;
                             }
                         }
@@ -601,26 +1641,26 @@ void ZddWithLinks::batch_uncover(
             } else {  // var is not a covered column
                 Header &var_head = header_[var];
 
-                for (size_t i = 0; i < dp_mgr_->num_elems(var); i++) {
+                for (node_t i = 0; i < dp_mgr_->num_elems(var); i++) {
                     const auto node_id = dp_mgr_->at(var, i);
-                    const auto low_count =
-                        dp_mgr_->get_low_count_and_clear(node_id);
+                    const auto low_count = dp_mgr_->queued_count(node_id);
                     const auto high_count =
-                        dp_mgr_->get_high_count_and_clear(node_id);
+                        dp_mgr_->queued_high_count(node_id);
 
                     Node &node = table_[node_id];
+                    Links &links = links_[node_id];
                     assert(node.count_upper > 0);
                     node.count_lo += low_count, node.count_hi += high_count;
 
                     var_head.count += node.count_upper * high_count;
-                    if (!plink_is_term(node.parents_head)) {
-                        for (plink_t plink = node.parents_head;
+                    if (!plink_is_term(links.parents_head())) {
+                        for (plink_t plink = links.parents_head();
                              ;  //! plink_is_term(plink);
                              plink = plink_get_next(plink)) {
                             auto parent_id = plink_node_id(plink);
-                            assert(parent_id != node_id);
+                            assert(static_cast<node_t>(parent_id) != node_id);
                             count_t pcount_upper;
-                            uint16_t pvar;
+                            column_t pvar;
                             pcount_upper = table_[parent_id].count_upper,
                             pvar = table_[parent_id].var;
                             if (pcount_upper > 0) {
@@ -634,12 +1674,13 @@ void ZddWithLinks::batch_uncover(
                                         high_count + low_count);
                                 }
                             }
-                            if (plink == node.parents_tail) break;
+                            if (plink == links.parents_tail()) break;
                         }
                     }
                 }
             }
             dp_mgr_->clear_var_counter(var);
+            sync_active_count(var);
         }
     }
 
@@ -650,12 +1691,12 @@ void ZddWithLinks::batch_uncover(
         hidden_node_stack_->pop();
 
         switch (hide_type) {
-            case HiddenNodeStack::HideType::CoverDown:
+            case HiddenNodeStack<node_t>::HideType::CoverDown:
                 unhide_node_cover_down(node_id);
                 {
-                    int32_t nup, ndown;
+                    node_t nup, ndown;
                     count_t cupper;
-                    uint16_t nvar;
+                    column_t nvar;
                     nup = table_[node_id].up, ndown = table_[node_id].down;
                     cupper = table_[node_id].count_upper,
                     nvar = table_[node_id].var;
@@ -672,16 +1713,13 @@ void ZddWithLinks::batch_uncover(
                         }
 
                         if (table_[node_id].lo >= 0) {
-                            auto lo_next = table_[node_id].lo_next,
-                                 lo_prev = table_[node_id].lo_prev;
-                            plink_set_prev(lo_next, node_id << 2UL);
-                            plink_set_next(lo_prev, node_id << 2UL);
+                            plink_relink(lo_plink(node_id));
                         }
                     }
                 }
                 break;
 
-            case HiddenNodeStack::HideType::UpperZero:
+            case HiddenNodeStack<node_t>::HideType::UpperZero:
                 unhide_node_upperzero(node_id);
 
                 {
@@ -713,6 +1751,7 @@ void ZddWithLinks::batch_uncover(
     hidden_node_stack_->pop_checkpoint();
 
     {
+        dp_mgr_->begin_pass();
         for (auto it = col_begin; it != col_end; ++it) {
             dp_mgr_->add_lower_var(*it);
         }
@@ -728,8 +1767,7 @@ void ZddWithLinks::batch_uncover(
 
                     assert(node.count_hi > 0);
 
-                    const auto count_diff_upper =
-                        dp_mgr_->get_count_and_clear(node_id);
+                    const auto count_diff_upper = dp_mgr_->count_at(node_id);
                     node.count_upper += count_diff_upper;
                     header_[var].count += count_diff_upper * node.count_hi;
                     auto nhi = node.hi, nlo = node.lo;
@@ -746,12 +1784,11 @@ void ZddWithLinks::batch_uncover(
                 }
             } else {  // var が cover_columnsではなかった場合
                 auto &var_head = header_[var];
-                for (size_t i = 0; i < dp_mgr_->num_elems(var); i++) {
+                for (node_t i = 0; i < dp_mgr_->num_elems(var); i++) {
                     const auto node_id = dp_mgr_->at(var, i);
                     Node &node = table_[node_id];
 
-                    const auto upper_count =
-                        dp_mgr_->get_count_and_clear(node_id);
+                    const auto upper_count = dp_mgr_->queued_count(node_id);
                     node.count_upper += upper_count;
                     assert(node.count_upper > 0);
 
@@ -773,11 +1810,13 @@ void ZddWithLinks::batch_uncover(
             }
 
             dp_mgr_->clear_var_counter(var);
+            sync_active_count(var);
         }
     }
 }
 
-void ZddWithLinks::setup_dancing_links() {
+template <typename L>
+void ZddWithLinks<L>::setup_dancing_links() {
     // initialize counts
     // 初始化Node计数
     for (Node &node : table_) {
@@ -789,26 +1828,33 @@ void ZddWithLinks::setup_dancing_links() {
     // 计算下层计数
     for (size_t i = 0; i < table_.size(); i++) {
         Node &node = table_[i];
+        bool fits = true;
         if (node.lo == DD_ZERO_TERM) {
             node.count_lo = 0;
         } else if (node.lo == DD_ONE_TERM) {
             node.count_lo = 1;
         } else if (node.lo >= 0) {
-            node.count_lo = table_[node.lo].count_lo + table_[node.lo].count_hi;
+            fits = add_paths(table_[node.lo].count_lo, table_[node.lo].count_hi,
+                             node.count_lo);
         }
         if (node.hi == DD_ZERO_TERM) {
             node.count_hi = 0;
         } else if (node.hi == DD_ONE_TERM) {
             node.count_hi = 1;
         } else if (node.hi >= 0) {
-            node.count_hi = table_[node.hi].count_lo + table_[node.hi].count_hi;
+            fits &= add_paths(table_[node.hi].count_lo,
+                              table_[node.hi].count_hi, node.count_hi);
+        }
+        if (!fits) {
+            throw std::overflow_error("paths of node " + to_string(i) +
+                                      " overflow the count type");
         }
     }
 
     // compute upper counts
     // 计算上层节点计数
     table_[table_.size() - 1].count_upper = 1;
-    for (int i = table_.size() - 1; i >= 0; i--) {
+    for (node_t i = table_.size() - 1; i >= 0; i--) {
         Node &node = table_[i];
         if (node.hi >= 0) {
             table_[node.hi].count_upper += node.count_upper;
@@ -843,55 +1889,257 @@ void ZddWithLinks::setup_dancing_links() {
         header.count += counts;
     }
     // set parent node cells.
+    links_.assign(table_.size(), Links());
     for (size_t i = 0; i < table_.size(); i++) {
         Node &node = table_[i];
+        Links &links = links_[i];
 
-        node.parents_head = i << 2UL | 2UL;
-        node.parents_tail = i << 2UL | 2UL;
+        links.parents_head() = i << 2UL | 2UL;
+        links.parents_tail() = i << 2UL | 2UL;
 
         if (node.hi >= 0) {
-            Node &child = table_[node.hi];
-            node.hi_prev = child.parents_tail;
-            node.hi_next = node.hi << 2UL | 2UL;
-            plink_set_next(child.parents_tail, i << 2UL | 1UL);
-            child.parents_tail = i << 2UL | 1UL;
+            Links &child_links = links_[node.hi];
+            links.hi_prev() = child_links.parents_tail();
+            links.hi_next() = node.hi << 2UL | 2UL;
+            plink_set_next(child_links.parents_tail(), i << 2UL | 1UL);
+            child_links.parents_tail() = i << 2UL | 1UL;
 
         } else {
             // these links will not be used;
-            node.hi_prev = UINT32_MAX;
-            node.hi_next = UINT32_MAX;
+            links.hi_prev() = numeric_limits<plink_t>::max();
+            links.hi_next() = numeric_limits<plink_t>::max();
         }
         if (node.lo >= 0) {
-            Node &child = table_[node.lo];
-            node.lo_prev = child.parents_tail;
-            node.lo_next = node.lo << 2UL | 2UL;
-            plink_set_next(child.parents_tail, i << 2UL);
+            Links &child_links = links_[node.lo];
+            links.lo_prev() = child_links.parents_tail();
+            links.lo_next() = node.lo << 2UL | 2UL;
+            plink_set_next(child_links.parents_tail(), i << 2UL);
 
-            child.parents_tail = i << 2UL;
+            child_links.parents_tail() = i << 2UL;
         } else {
             // these links will not be used;
-            node.lo_prev = UINT32_MAX;
-            node.lo_next = UINT32_MAX;
+            links.lo_prev() = numeric_limits<plink_t>::max();
+            links.lo_next() = numeric_limits<plink_t>::max();
         }
     }
-    dp_mgr_ = make_unique<DpManager>(table_, num_var_);
+    dp_mgr_ = make_unique<DpManager<L>>(table_, num_var_, resource_);
+    hidden_node_stack_->reserve(table_.size(), num_var_);
+    setup_active_columns();
 }
 
-void ZddWithLinks::compute_upper_choice(int32_t node_id, count_t up_id,
-                                        vector<uint16_t> &choice) noexcept {
+template <typename L>
+void ZddWithLinks<L>::setup_dancing_links(int num_threads) {
+    const size_t n = table_.size();
+    if (num_threads <= 1 || n == 0 || sizeof(count_t) > sizeof(uint64_t)) {
+        setup_dancing_links();
+        return;
+    }
+
+    // levels: ranges of nodes having the same var, in table order.
+    vector<pair<size_t, size_t>> levels;
+    vector<char> seen(num_var_ + 1, 0);
+    for (size_t i = 0; i < n; i++) {
+        if (i > 0 && table_[i].var == table_[i - 1].var) continue;
+        if (seen[table_[i].var]) {
+            setup_dancing_links();  // a level is split
+            return;
+        }
+        seen[table_[i].var] = 1;
+        if (!levels.empty()) levels.back().second = i;
+        levels.emplace_back(i, n);
+    }
+    // a child must be on a deeper level stored before its parents.
+    atomic<bool> ordered(true);
+    parallel_for(0, n, num_threads, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++) {
+            const Node &node = table_[i];
+            for (node_t child : {node.hi, node.lo}) {
+                if (child >= 0 && ((size_t)child >= i ||
+                                   table_[child].var <= node.var)) {
+                    ordered = false;
+                    return;
+                }
+            }
+        }
+    });
+    if (!ordered) {
+        setup_dancing_links();
+        return;
+    }
+
+    // compute lower counts, deepest level first.
+    atomic<bool> fits(true);
+    for (const auto &level : levels) {
+        parallel_for(level.first, level.second, num_threads,
+                     [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i < hi; i++) {
+                Node &node = table_[i];
+                node.count_upper = 0;
+                node.count_lo = 0;
+                node.count_hi = 0;
+                if (node.lo == DD_ONE_TERM) {
+                    node.count_lo = 1;
+                } else if (node.lo >= 0 &&
+                           !add_paths(table_[node.lo].count_lo,
+                                      table_[node.lo].count_hi,
+                                      node.count_lo)) {
+                    fits = false;
+                }
+                if (node.hi == DD_ONE_TERM) {
+                    node.count_hi = 1;
+                } else if (node.hi >= 0 &&
+                           !add_paths(table_[node.hi].count_lo,
+                                      table_[node.hi].count_hi,
+                                      node.count_hi)) {
+                    fits = false;
+                }
+            }
+        });
+        if (!fits) {
+            throw std::overflow_error(
+                "paths of a node overflow the count type");
+        }
+    }
+
+    // compute upper counts, root level first. parents of one level push to
+    // shared children, the sums do not depend on the order.
+    table_[n - 1].count_upper = 1;
+    for (auto it = levels.crbegin(); it != levels.crend(); ++it) {
+        parallel_for(it->first, it->second, num_threads,
+                     [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i < hi; i++) {
+                const Node &node = table_[i];
+                if (node.hi >= 0) {
+                    __atomic_fetch_add(&table_[node.hi].count_upper,
+                                       node.count_upper, __ATOMIC_RELAXED);
+                }
+                if (node.lo >= 0) {
+                    __atomic_fetch_add(&table_[node.lo].count_upper,
+                                       node.count_upper, __ATOMIC_RELAXED);
+                }
+            }
+        });
+    }
+
+    // set up up/down links; a level is a contiguous range of the table.
+    for (const auto &level : levels) {
+        Header &header = header_[table_[level.first].var];
+        header.down = level.first;
+        header.up = level.second - 1;
+        parallel_for(level.first, level.second, num_threads,
+                     [&](size_t lo, size_t hi) {
+            count_t counts = 0;
+            for (size_t i = lo; i < hi; i++) {
+                Node &node = table_[i];
+                node.up = i > level.first ? i - 1 : -1;
+                node.down = i + 1 < level.second ? i + 1 : -1;
+                if (node.hi == DD_ONE_TERM) {
+                    counts += node.count_upper;
+                } else if (node.hi >= 0) {
+                    counts += node.count_upper * node.count_hi;
+                }
+            }
+            __atomic_fetch_add(&header.count, counts, __ATOMIC_RELAXED);
+        });
+    }
+
+    // set parent node cells. the parents of a child are listed in table
+    // order, the hi link before the lo link of the same parent.
+    vector<plink_t> num_parents(n + 1, 0);
+    parallel_for(0, n, num_threads, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++) {
+            for (node_t child : {table_[i].hi, table_[i].lo}) {
+                if (child >= 0) {
+                    __atomic_fetch_add(&num_parents[child], (plink_t)1,
+                                       __ATOMIC_RELAXED);
+                }
+            }
+        }
+    });
+    vector<size_t> parents_begin(n + 1, 0);
+    for (size_t c = 0; c < n; c++) {
+        parents_begin[c + 1] = parents_begin[c] + num_parents[c];
+        num_parents[c] = 0;
+    }
+    // entries are (parent << 1 | is_lo), sorted per child below.
+    vector<uint64_t> parents(parents_begin[n]);
+    links_.assign(n, Links());
+    parallel_for(0, n, num_threads, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++) {
+            const Node &node = table_[i];
+            if (node.hi >= 0) {
+                const plink_t k = __atomic_fetch_add(
+                    &num_parents[node.hi], (plink_t)1, __ATOMIC_RELAXED);
+                parents[parents_begin[node.hi] + k] = i << 1;
+            }
+            if (node.lo >= 0) {
+                const plink_t k = __atomic_fetch_add(
+                    &num_parents[node.lo], (plink_t)1, __ATOMIC_RELAXED);
+                parents[parents_begin[node.lo] + k] = i << 1 | 1;
+            }
+        }
+    });
+    parallel_for(0, n, num_threads, [&](size_t lo, size_t hi) {
+        for (size_t c = lo; c < hi; c++) {
+            Node &child = table_[c];
+            Links &child_links = links_[c];
+            const auto first = parents.begin() + parents_begin[c];
+            const auto last = parents.begin() + parents_begin[c + 1];
+            sort(first, last);
+
+            const plink_t sentinel = c << 2UL | 2UL;
+            auto to_plink = [](uint64_t e) -> plink_t {
+                return (e >> 1) << 2UL | ((e & 1) ? 0UL : 1UL);
+            };
+            child_links.parents_head() =
+                first == last ? sentinel : to_plink(*first);
+            child_links.parents_tail() =
+                first == last ? sentinel : to_plink(*(last - 1));
+            for (auto it = first; it != last; ++it) {
+                Links &parent_links = links_[*it >> 1];
+                const plink_t prev = it == first ? sentinel : to_plink(*(it - 1));
+                const plink_t next =
+                    it + 1 == last ? sentinel : to_plink(*(it + 1));
+                if (*it & 1) {
+                    parent_links.lo_prev() = prev;
+                    parent_links.lo_next() = next;
+                } else {
+                    parent_links.hi_prev() = prev;
+                    parent_links.hi_next() = next;
+                }
+            }
+            // these links will not be used;
+            if (child.hi < 0) {
+                child_links.hi_prev() = numeric_limits<plink_t>::max();
+                child_links.hi_next() = numeric_limits<plink_t>::max();
+            }
+            if (child.lo < 0) {
+                child_links.lo_prev() = numeric_limits<plink_t>::max();
+                child_links.lo_next() = numeric_limits<plink_t>::max();
+            }
+        }
+    });
+    dp_mgr_ = make_unique<DpManager<L>>(table_, num_var_, resource_);
+    hidden_node_stack_->reserve(table_.size(), num_var_);
+    setup_active_columns();
+}
+
+template <typename L>
+void ZddWithLinks<L>::compute_upper_choice(node_t node_id, count_t up_id,
+                                           vector<column_t> &choice) noexcept {
     choice.clear();
-    //    const int32_t root_id = table_.size() - 1;
+    //    const node_t root_id = table_.size() - 1;
 
     for (;;) {
-        const Node &node = table_[node_id];
-        assert(node.count_upper > 0);
-        if (plink_is_term(node.parents_head)) {  // root node
-            assert(node.count_upper > 0);
+        const Links &links = links_[node_id];
+        assert(table_[node_id].count_upper > 0);
+        if (plink_is_term(links.parents_head())) {  // root node
+            assert(table_[node_id].count_upper > 0);
             break;
         }
         count_t offset = 0UL;
 
-        plink_t plink = node.parents_head;
+        plink_t plink = links.parents_head();
         for (;;) {
             const auto parent_id = plink_node_id(plink);
             const Node &parent = table_[parent_id];
@@ -911,24 +2159,25 @@ void ZddWithLinks::compute_upper_choice(int32_t node_id, count_t up_id,
     }
 }
 
-void ZddWithLinks::compute_upper_initial_choice(
-    const int32_t start_id, vector<uint32_t> &visited,
-    vector<size_t> &diff_choices, vector<int32_t> &diff_choice_ids,
-    vector<uint16_t> &choices_buf) noexcept {
+template <typename L>
+void ZddWithLinks<L>::compute_upper_initial_choice(
+       const node_t start_id, vector<plink_t> &visited,
+       vector<size_t> &diff_choices, vector<node_t> &diff_choice_ids,
+       vector<column_t> &choices_buf) noexcept {
     visited.clear();
     diff_choices.clear();
     diff_choice_ids.clear();
-    int32_t node_id = start_id;
+    node_t node_id = start_id;
     for (;;) {
-        const Node &node = table_[node_id];
-        assert(node.count_upper > 0);
+        const Links &links = links_[node_id];
+        assert(table_[node_id].count_upper > 0);
 
-        if (plink_is_term(node.parents_head)) {
-            assert(node.parents_head == node.parents_tail);
+        if (plink_is_term(links.parents_head())) {
+            assert(links.parents_head() == links.parents_tail());
             break;
         }
 
-        plink_t link = node.parents_head;
+        plink_t link = links.parents_head();
         auto previous_id = node_id;
         node_id = plink_node_id(link);
         assert(visited.empty() ||
@@ -938,7 +2187,7 @@ void ZddWithLinks::compute_upper_initial_choice(
         } else {
             visited.push_back(node_id << 1U);
         }
-        if (link != node.parents_tail) {
+        if (link != links.parents_tail()) {
             diff_choices.push_back(visited.size() - 1);
             diff_choice_ids.push_back(previous_id);
         }
@@ -967,22 +2216,22 @@ void ZddWithLinks::compute_upper_initial_choice(
     }
 }
 
-bool ZddWithLinks::compute_upper_next_choice(vector<uint32_t> &visited,
-                                             vector<size_t> &diff_choices,
-                                             vector<int32_t> &diff_choice_ids,
-                                             vector<uint16_t> &choice_buf) {
+template <typename L>
+bool ZddWithLinks<L>::compute_upper_next_choice(
+    vector<plink_t> &visited, vector<size_t> &diff_choices,
+    vector<node_t> &diff_choice_ids, vector<column_t> &choice_buf) {
     // uncover
     //    cerr << "update " << num_updates << endl;
-    int var_prev = 100;
+    [[maybe_unused]] int var_prev = 100;
     for (const auto v : visited) {
-        assert(table_[v >> 1].var < var_prev);
+        assert(static_cast<int>(table_[v >> 1].var) < var_prev);
         var_prev = table_[v >> 1].var;
     }
     assert(diff_choices.size() == diff_choice_ids.size());
     while (!diff_choices.empty()) {
         size_t change_idx = *(diff_choices.rbegin());
         diff_choices.pop_back();
-        uint32_t child_id = *(diff_choice_ids.rbegin());
+        plink_t child_id = *(diff_choice_ids.rbegin());
         diff_choice_ids.pop_back();
 
         trace2choice(visited.rbegin(),
@@ -998,7 +2247,7 @@ bool ZddWithLinks::compute_upper_next_choice(vector<uint32_t> &visited,
         visited.erase(visited.begin() + change_idx, visited.end());
 
         plink_t plink;
-        plink_t ptail = table_[child_id].parents_tail;
+        plink_t ptail = links_[child_id].parents_tail();
         if (((val >> 1U) == plink_node_id(ptail)) &&
             ((plink_is_hi(ptail) && (val & 1U)) ||
              (!plink_is_hi(ptail) && !(val & 1U)))) {
@@ -1006,9 +2255,9 @@ bool ZddWithLinks::compute_upper_next_choice(vector<uint32_t> &visited,
         }
 
         if (val & 1U) {
-            plink = table_[val >> 1U].hi_next;
+            plink = links_[val >> 1U].hi_next();
         } else {
-            plink = table_[val >> 1U].lo_next;
+            plink = links_[val >> 1U].lo_next();
         }
         if (plink_is_term(plink)) {
             print_parent_links(val >> 1U);
@@ -1045,15 +2294,15 @@ bool ZddWithLinks::compute_upper_next_choice(vector<uint32_t> &visited,
     size_t prev_last_idx = *(diff_choices.rbegin());
     assert(prev_last_idx == visited.size() - 1);
 
-    int32_t node_id = visited[prev_last_idx] >> 1U;
+    node_t node_id = visited[prev_last_idx] >> 1U;
     for (;;) {
-        const Node &node = table_[node_id];
-        assert(node.count_upper > 0);
+        const Links &links = links_[node_id];
+        assert(table_[node_id].count_upper > 0);
 
-        if (plink_is_term(node.parents_head)) break;
+        if (plink_is_term(links.parents_head())) break;
 
-        plink_t link = node.parents_head;
-        int32_t previous_id = node_id;
+        plink_t link = links.parents_head();
+        node_t previous_id = node_id;
         node_id = plink_node_id(link);
         assert(visited.empty() ||
                table_[*(visited.rbegin()) >> 1].var > table_[node_id].var);
@@ -1062,7 +2311,7 @@ bool ZddWithLinks::compute_upper_next_choice(vector<uint32_t> &visited,
         } else {
             visited.push_back(node_id << 1U);
         }
-        if (link != table_[previous_id].parents_tail) {
+        if (link != links_[previous_id].parents_tail()) {
             diff_choices.push_back(visited.size() - 1);
             diff_choice_ids.push_back(previous_id);
 
@@ -1090,8 +2339,9 @@ bool ZddWithLinks::compute_upper_next_choice(vector<uint32_t> &visited,
     return false;
 }
 
-void ZddWithLinks::compute_lower_choice(int32_t node_id, count_t down_id,
-                                        vector<uint16_t> &choice) noexcept {
+template <typename L>
+void ZddWithLinks<L>::compute_lower_choice(node_t node_id, count_t down_id,
+                                           vector<column_t> &choice) noexcept {
     choice.clear();
 
     while (node_id >= 0) {
@@ -1109,13 +2359,13 @@ void ZddWithLinks::compute_lower_choice(int32_t node_id, count_t down_id,
     }
 }
 
-void ZddWithLinks::compute_lower_initial_choice(const int32_t start_id,
-                                                vector<uint32_t> &visited,
-                                                vector<size_t> &diff_choices,
-                                                vector<uint16_t> &choices_buf) {
+template <typename L>
+void ZddWithLinks<L>::compute_lower_initial_choice(
+    const node_t start_id, vector<plink_t> &visited,
+    vector<size_t> &diff_choices, vector<column_t> &choices_buf) {
     visited.clear();
     diff_choices.clear();
-    int32_t node_id = start_id;
+    node_t node_id = start_id;
     while (node_id >= 0) {
         const Node &node = table_[node_id];
         if (node.count_hi > 0) {
@@ -1152,9 +2402,10 @@ void ZddWithLinks::compute_lower_initial_choice(const int32_t start_id,
     }
 }
 
-bool ZddWithLinks::compute_lower_next_choice(vector<uint32_t> &visited,
-                                             vector<size_t> &diff_choices,
-                                             vector<uint16_t> &choice_buf) {
+template <typename L>
+bool ZddWithLinks<L>::compute_lower_next_choice(vector<plink_t> &visited,
+                                                vector<size_t> &diff_choices,
+                                                vector<column_t> &choice_buf) {
     // uncover
     while (!diff_choices.empty()) {
         size_t change_idx = *(diff_choices.rbegin());
@@ -1188,7 +2439,7 @@ bool ZddWithLinks::compute_lower_next_choice(vector<uint32_t> &visited,
     }
 
     int prev_last_idx = *(diff_choices.rbegin());
-    int32_t node_id = visited[prev_last_idx] >> 1U;
+    node_t node_id = visited[prev_last_idx] >> 1U;
 
     node_id = table_[node_id].lo;
     while (node_id >= 0) {
@@ -1225,293 +2476,151 @@ bool ZddWithLinks::compute_lower_next_choice(vector<uint32_t> &visited,
     return false;
 }
 
-void ZddWithLinks::hide_node(const int32_t node_id) {
-    Node &node = table_[node_id];
-    //    cerr << "hide " << node_id << endl;
-
-    if (!plink_is_term(node.parents_head)) {
-        for (plink_t plink = node.parents_head;;  // !plink_is_term(plink);
-             plink = plink_get_next(plink)) {
-            int32_t parent_id = plink_node_id(plink);
-            Node &parent = table_[parent_id];
-            if (plink_is_hi(plink)) {
-                parent.hi = node.lo;
-            } else {
-                parent.lo = node.lo;
-            }
-            if (plink == node.parents_tail) {
-                break;
-            }
+template <typename L>
+void ZddWithLinks<L>::redirect_parents(const node_t node_id,
+                                       const node_t target) {
+    const Links &links = links_[node_id];
+    if (plink_is_term(links.parents_head())) return;
+    for (plink_t plink = links.parents_head();;  // !plink_is_term(plink);
+         plink = plink_get_next(plink)) {
+        Node &parent = table_[plink_node_id(plink)];
+        if (plink_is_hi(plink)) {
+            parent.hi = target;
+        } else {
+            parent.lo = target;
         }
-    }
-
-    auto nhi = node.hi, nlo = node.lo;
-
-    if (nhi >= 0) {
-        auto hi_next = node.hi_next, hi_prev = node.hi_prev;
-        plink_set_prev(hi_next, hi_prev);
-        plink_set_next(hi_prev, hi_next);
-    }
-    if (nlo >= 0) {
-        auto lo_next = node.lo_next, lo_prev = node.lo_prev;
-        plink_set_prev(lo_next, lo_prev);
-        plink_set_next(lo_prev, lo_next);
-    }
-
-    if (nlo >= 0 && !plink_is_term(node.parents_head)) {
-        Node &lo_child = table_[nlo];
-        auto np_head = node.parents_head, np_tail = node.parents_tail;
-        plink_set_prev(np_head, lo_child.parents_tail);
-        plink_set_next(np_tail, (nlo << 2UL) | 2UL);
-        plink_set_next(lo_child.parents_tail, np_head);
-        lo_child.parents_tail = np_tail;
+        if (plink == links.parents_tail()) break;
     }
 }
 
-void ZddWithLinks::unhide_node(const int32_t node_id) {
-    Node &node = table_[node_id];
-
-    auto nhi = node.hi, nlo = node.lo;
-    if (nlo >= 0 && !plink_is_term(node.parents_head)) {
-        Node &lo_child = table_[nlo];
-
-        auto np_head = node.parents_head, np_tail = node.parents_tail;
-        plink_t orig_lo_parent_head = plink_get_prev(np_head);
-        plink_t orig_lo_parent_tail = plink_get_next(np_tail);
-        plink_set_next(orig_lo_parent_head, orig_lo_parent_tail);
-        plink_set_prev(orig_lo_parent_tail, orig_lo_parent_head);
-
-        plink_set_prev(np_head, node_id << 2UL | 2UL);
-        plink_set_next(np_tail, node_id << 2UL | 2UL);
-    }
-
-    if (nlo >= 0) {
-        auto lo_next = node.lo_next, lo_prev = node.lo_prev;
-        plink_set_prev(lo_next, node_id << 2UL);
-        plink_set_next(lo_prev, node_id << 2UL);
-    }
-
-    if (nhi >= 0) {
-        auto hi_next = node.hi_next, hi_prev = node.hi_prev;
-        plink_set_prev(hi_next, node_id << 2UL | 1UL);
-        plink_set_next(hi_prev, node_id << 2UL | 1UL);
-    }
-
-
-    if (!plink_is_term(node.parents_tail)) {
-        for (plink_t plink = node.parents_tail;;  // !plink_is_term(plink);
-             plink = plink_get_prev(plink)) {
-            int32_t parent_id = plink_node_id(plink);
-            Node &parent = table_[parent_id];
-            if (plink_is_hi(plink)) {
-                parent.hi = node_id;
-            } else {
-                parent.lo = node_id;
-            }
-            if (plink == node.parents_head) {
-                break;
-            }
+template <typename L>
+void ZddWithLinks<L>::restore_parents(const node_t node_id) {
+    const Links &links = links_[node_id];
+    if (plink_is_term(links.parents_head())) return;
+    for (plink_t plink = links.parents_tail();;  // !plink_is_term(plink);
+         plink = plink_get_prev(plink)) {
+        Node &parent = table_[plink_node_id(plink)];
+        if (plink_is_hi(plink)) {
+            parent.hi = node_id;
+        } else {
+            parent.lo = node_id;
         }
+        if (plink == links.parents_head()) break;
     }
 }
 
-void ZddWithLinks::hide_node_cover_down(const int32_t node_id) {
-    Node &node = table_[node_id];
-
-    if (node.hi >= 0) {
-        auto hi_next = node.hi_next, hi_prev = node.hi_prev;
-        plink_set_prev(hi_next, hi_prev);
-        plink_set_next(hi_prev, hi_next);
-    }
-}
-void ZddWithLinks::unhide_node_cover_down(const int32_t node_id) {
-    Node &node = table_[node_id];
-    if (node.hi >= 0) {
-        auto hi_next = node.hi_next, hi_prev = node.hi_prev;
-        plink_set_prev(hi_next, node_id << 2UL | 1UL);
-        plink_set_next(hi_prev, node_id << 2UL | 1UL);
-    }
+template <typename L>
+void ZddWithLinks<L>::splice_parents(const node_t node_id, const node_t child) {
+    const Links &links = links_[node_id];
+    if (plink_is_term(links.parents_head())) return;
+    plink_t &child_tail = links_[child].parents_tail();
+    const auto np_head = links.parents_head(), np_tail = links.parents_tail();
+    plink_set_prev(np_head, child_tail);
+    plink_set_next(np_tail, term_plink(child));
+    plink_set_next(child_tail, np_head);
+    child_tail = np_tail;
 }
 
-void ZddWithLinks::hide_node_cover_up(const int32_t node_id) {
+template <typename L>
+void ZddWithLinks<L>::unsplice_parents(const node_t node_id) {
+    const Links &links = links_[node_id];
+    if (plink_is_term(links.parents_head())) return;
+    const auto np_head = links.parents_head(), np_tail = links.parents_tail();
+    const plink_t orig_lo_parent_head = plink_get_prev(np_head);
+    const plink_t orig_lo_parent_tail = plink_get_next(np_tail);
+    plink_set_next(orig_lo_parent_head, orig_lo_parent_tail);
+    plink_set_prev(orig_lo_parent_tail, orig_lo_parent_head);
+
+    plink_set_prev(np_head, term_plink(node_id));
+    plink_set_next(np_tail, term_plink(node_id));
+}
 
-    Node &node = table_[node_id];
+template <typename L>
+void ZddWithLinks<L>::hide_node(const node_t node_id) {
+    const Node &node = table_[node_id];
+    //    cerr << "hide " << node_id << endl;
+    redirect_parents(node_id, node.lo);
 
-    if (!plink_is_term(node.parents_head)) {
-        for (plink_t plink = node.parents_head;;  //! plink_is_term(plink);
-             plink = plink_get_next(plink)) {
-            int32_t parent_id = plink_node_id(plink);
-            Node &parent = table_[parent_id];
-            if (plink_is_hi(plink)) {
-                parent.hi = node.lo;
-            } else {
-                parent.lo = node.lo;
-            }
-            if (plink == node.parents_tail) break;
-        }
+    const auto nhi = node.hi, nlo = node.lo;
+    if (nhi >= 0) plink_unlink(hi_plink(node_id));
+    if (nlo >= 0) {
+        plink_unlink(lo_plink(node_id));
+        splice_parents(node_id, nlo);
     }
+}
 
-    if (node.lo >= 0) {
-        auto lo_next = node.lo_next, lo_prev = node.lo_prev;
-        plink_set_prev(lo_next, lo_prev);
-        plink_set_next(lo_prev, lo_next);
-    }
+template <typename L>
+void ZddWithLinks<L>::unhide_node(const node_t node_id) {
+    const Node &node = table_[node_id];
 
-    if (node.lo >= 0 && !plink_is_term(node.parents_head)) {
-        Node &lo_child = table_[node.lo];
-        auto np_head = node.parents_head, np_tail = node.parents_tail;
-        plink_set_prev(np_head, lo_child.parents_tail);
-        plink_set_next(np_tail, (node.lo << 2UL) | 2UL);
-        plink_set_next(lo_child.parents_tail, np_head);
-        lo_child.parents_tail = np_tail;
+    const auto nhi = node.hi, nlo = node.lo;
+    if (nlo >= 0) {
+        unsplice_parents(node_id);
+        plink_relink(lo_plink(node_id));
     }
+    if (nhi >= 0) plink_relink(hi_plink(node_id));
+    restore_parents(node_id);
 }
 
-void ZddWithLinks::unhide_node_cover_up(const int32_t node_id) {
-    Node &node = table_[node_id];
-
-    if (node.lo >= 0 && !plink_is_term(node.parents_head)) {
-        Node &lo_child = table_[node.lo];
-
-        auto np_head = node.parents_head, np_tail = node.parents_tail;
-        plink_t orig_lo_parent_head = plink_get_prev(np_head);
-        plink_t orig_lo_parent_tail = plink_get_next(np_tail);
-        plink_set_next(orig_lo_parent_head, orig_lo_parent_tail);
-        plink_set_prev(orig_lo_parent_tail, orig_lo_parent_head);
+template <typename L>
+void ZddWithLinks<L>::hide_node_cover_down(const node_t node_id) {
+    if (table_[node_id].hi >= 0) plink_unlink(hi_plink(node_id));
+}
 
-        plink_set_prev(np_head, node_id << 2UL | 2UL);
-        plink_set_next(np_tail, node_id << 2UL | 2UL);
-    }
+template <typename L>
+void ZddWithLinks<L>::unhide_node_cover_down(const node_t node_id) {
+    if (table_[node_id].hi >= 0) plink_relink(hi_plink(node_id));
+}
 
+template <typename L>
+void ZddWithLinks<L>::hide_node_cover_up(const node_t node_id) {
+    const Node &node = table_[node_id];
+    redirect_parents(node_id, node.lo);
     if (node.lo >= 0) {
-        auto lo_next = node.lo_next, lo_prev = node.lo_prev;
-        plink_set_prev(lo_next, node_id << 2UL);
-        plink_set_next(lo_prev, node_id << 2UL);
+        plink_unlink(lo_plink(node_id));
+        splice_parents(node_id, node.lo);
     }
+}
 
-
-    if (!plink_is_term(node.parents_head)) {
-        for (plink_t plink = node.parents_tail;;  //! plink_is_term(plink);
-             plink = plink_get_prev(plink)) {
-            int32_t parent_id = plink_node_id(plink);
-            Node &parent = table_[parent_id];
-            if (plink_is_hi(plink)) {
-                parent.hi = node_id;
-            } else {
-                parent.lo = node_id;
-            }
-            if (plink == node.parents_head) break;
-        }
+template <typename L>
+void ZddWithLinks<L>::unhide_node_cover_up(const node_t node_id) {
+    if (table_[node_id].lo >= 0) {
+        unsplice_parents(node_id);
+        plink_relink(lo_plink(node_id));
     }
+    restore_parents(node_id);
 }
 
-void ZddWithLinks::hide_node_upperzero(const int32_t node_id) {
-    Node &node = table_[node_id];
+template <typename L>
+void ZddWithLinks<L>::hide_node_upperzero(const node_t node_id) {
+    const Node &node = table_[node_id];
     assert(node.count_hi > 0);
-    auto nhi = node.hi, nlo = node.lo;
-    if (nhi >= 0) {
-        auto hi_next = node.hi_next, hi_prev = node.hi_prev;
-        plink_set_prev(hi_next, hi_prev);
-        plink_set_next(hi_prev, hi_next);
-    }
-
-    if (nlo >= 0) {
-        auto lo_next = node.lo_next, lo_prev = node.lo_prev;
-        plink_set_prev(lo_next, lo_prev);
-        plink_set_next(lo_prev, lo_next);
-    }
+    if (node.hi >= 0) plink_unlink(hi_plink(node_id));
+    if (node.lo >= 0) plink_unlink(lo_plink(node_id));
 }
 
-void ZddWithLinks::unhide_node_upperzero(const int32_t node_id) {
-    Node &node = table_[node_id];
-    if (node.lo >= 0) {
-        auto lo_next = node.lo_next, lo_prev = node.lo_prev;
-        plink_set_prev(lo_next, node_id << 2UL);
-        plink_set_next(lo_prev, node_id << 2UL);
-    }
-
+template <typename L>
+void ZddWithLinks<L>::unhide_node_upperzero(const node_t node_id) {
+    const Node &node = table_[node_id];
     assert(node.count_hi > 0);
-
-    if (node.hi >= 0) {
-        auto hi_next = node.hi_next, hi_prev = node.hi_prev;
-        plink_set_prev(hi_next, node_id << 2UL | 1UL);
-        plink_set_next(hi_prev, node_id << 2UL | 1UL);
-    }
+    if (node.lo >= 0) plink_relink(lo_plink(node_id));
+    if (node.hi >= 0) plink_relink(hi_plink(node_id));
 }
 
-void ZddWithLinks::hide_node_lowerzero(const int32_t node_id) {
-    Node &node = table_[node_id];
-    if (!plink_is_term(node.parents_head)) {
-        for (plink_t plink = node.parents_head;;  // !plink_is_term(plink);
-             plink = plink_get_next(plink)) {
-            int32_t parent_id = plink_node_id(plink);
-            Node &parent = table_[parent_id];
-            if (plink_is_hi(plink)) {
-                parent.hi = node.lo;
-            } else {
-                parent.lo = node.lo;
-            }
-            if (plink == node.parents_tail) {
-                break;
-            }
-        }
-    }
-
-    if (node.lo >= 0) {
-        auto lo_next = node.lo_next, lo_prev = node.lo_prev;
-        plink_set_prev(lo_next, lo_prev);
-        plink_set_next(lo_prev, lo_next);
-    }
-
-    if (node.lo >= 0 && !plink_is_term(node.parents_head)) {
-        Node &lo_child = table_[node.lo];
-        auto np_head = node.parents_head, np_tail = node.parents_tail;
-        plink_set_prev(np_head, lo_child.parents_tail);
-        plink_set_next(np_tail,
-                       (node.lo << PLINK_ADDR_OFFSET) | PLINK_IS_TERMINAL);
-        plink_set_next(lo_child.parents_tail, np_head);
-        lo_child.parents_tail = np_tail;
-    }
+// a node whose lower count dropped to zero leaves its parents as a node
+// covered from below does.
+template <typename L>
+void ZddWithLinks<L>::hide_node_lowerzero(const node_t node_id) {
+    hide_node_cover_up(node_id);
 }
 
-void ZddWithLinks::unhide_node_lowerzero(const int32_t node_id) {
-    Node &node = table_[node_id];
-
-    if (node.lo >= 0 && !plink_is_term(node.parents_head)) {
-        Node &lo_child = table_[node.lo];
-
-        auto np_head = node.parents_head, np_tail = node.parents_tail;
-        plink_t orig_lo_parent_head = plink_get_prev(np_head);
-        plink_t orig_lo_parent_tail = plink_get_next(np_tail);
-        plink_set_next(orig_lo_parent_head, orig_lo_parent_tail);
-        plink_set_prev(orig_lo_parent_tail, orig_lo_parent_head);
-
-        auto plink_id = node_id << PLINK_ADDR_OFFSET | PLINK_IS_TERMINAL;
-        plink_set_prev(np_head, plink_id);
-        plink_set_next(np_tail, plink_id);
-    }
-    if (node.lo >= 0) {
-        plink_set_prev(node.lo_next, node_id << PLINK_ADDR_OFFSET);
-        plink_set_next(node.lo_prev, node_id << PLINK_ADDR_OFFSET);
-    }
-
-    if (plink_is_term(node.parents_head)) return;
-    for (plink_t plink = node.parents_tail;;  // !plink_is_term(plink);
-         plink = plink_get_prev(plink)) {
-        int32_t parent_id = plink_node_id(plink);
-        Node &parent = table_[parent_id];
-        if (plink_is_hi(plink)) {
-            parent.hi = node_id;
-        } else {
-            parent.lo = node_id;
-        }
-        if (plink == node.parents_head) {
-            break;
-        }
-    }
+template <typename L>
+void ZddWithLinks<L>::unhide_node_lowerzero(const node_t node_id) {
+    unhide_node_cover_up(node_id);
 }
 
-bool ZddWithLinks::sanity() const {
+template <typename L>
+bool ZddWithLinks<L>::sanity() const {
     int pos, prev;  // pos指向当前链头，prev记录上一个节点
 
     // 返回值
@@ -1525,10 +2634,10 @@ bool ZddWithLinks::sanity() const {
         }
         if (pos == 0) break;
 
-        uint64_t counter = 0ULL;
+        count_t counter = 0;
 
-        int npos = header_[pos].down;
-        int nprev = -1;
+        node_t npos = header_[pos].down;
+        node_t nprev = -1;
 
         for (;; nprev = npos, npos = table_[npos].down) {
             if (npos >= 0 && table_[npos].up != nprev) {
@@ -1541,6 +2650,7 @@ bool ZddWithLinks::sanity() const {
             if (npos < 0) break;
 
             const Node &node = table_[npos];
+            const Links &links = links_[npos];
             if (node.count_upper == 0 || node.count_hi == 0) {
                 cerr << "Bad count at node " << npos << endl;
                 has_error = true;
@@ -1549,16 +2659,17 @@ bool ZddWithLinks::sanity() const {
 
             // check parent links
             plink_t prev_link = npos << 2 | 2LU;
-            for (plink_t plink = node.parents_head;;
+            for (plink_t plink = links.parents_head();;
                  prev_link = plink, plink = plink_get_next(plink)) {
                 const auto &parent = table_[plink_node_id(plink)];
+                const Links &parent_links = links_[plink_node_id(plink)];
                 plink_t back_link;
                 if (plink_is_term(plink)) {
-                    back_link = parent.parents_tail;
+                    back_link = parent_links.parents_tail();
                 } else if (plink_is_hi(plink)) {
-                    back_link = parent.hi_prev;
+                    back_link = parent_links.hi_prev();
                 } else {
-                    back_link = parent.lo_prev;
+                    back_link = parent_links.lo_prev();
                 }
 
                 if (back_link != prev_link) {
@@ -1583,21 +2694,22 @@ bool ZddWithLinks::sanity() const {
             // check child links
             if (node.lo >= 0) {
                 const auto &child = table_[node.lo];
+                const Links &child_links = links_[node.lo];
                 if (node.var >= child.var) {
                     has_error = true;
                     cerr << "Child node " << node.lo << " has larger var than "
                          << npos << endl;
                 }
                 bool has_parent_link = false;
-                if (!plink_is_term(child.parents_head)) {
-                    for (plink_t plink = child.parents_head;
+                if (!plink_is_term(child_links.parents_head())) {
+                    for (plink_t plink = child_links.parents_head();
                          ;  // !plink_is_term(plink);
                          plink = plink_get_next(plink)) {
                         if (!plink_is_hi(plink) &&
-                            plink_node_id(plink) == npos) {
+                            static_cast<node_t>(plink_node_id(plink)) == npos) {
                             has_parent_link = true;
                         }
-                        if (plink == child.parents_tail) break;
+                        if (plink == child_links.parents_tail()) break;
                     }
                 }
                 if (!has_parent_link) {
@@ -1609,21 +2721,22 @@ bool ZddWithLinks::sanity() const {
 
             if (node.hi >= 0) {
                 const auto &child = table_[node.hi];
+                const Links &child_links = links_[node.hi];
                 bool has_parent_link = false;
                 if (node.var >= child.var) {
                     has_error = true;
                     cerr << "Child node " << node.hi << " has larger var than "
                          << npos << endl;
                 }
-                if (!plink_is_term(child.parents_head)) {
-                    for (plink_t plink = child.parents_head;
+                if (!plink_is_term(child_links.parents_head())) {
+                    for (plink_t plink = child_links.parents_head();
                          ;  //! plink_is_term(plink);
                          plink = plink_get_next(plink)) {
                         if (plink_is_hi(plink) &&
-                            plink_node_id(plink) == npos) {
+                            static_cast<node_t>(plink_node_id(plink)) == npos) {
                             has_parent_link = true;
                         }
-                        if (plink == child.parents_tail) break;
+                        if (plink == child_links.parents_tail()) break;
                     }
                 }
                 if (!has_parent_link) {
@@ -1638,6 +2751,13 @@ bool ZddWithLinks::sanity() const {
             cerr << "Count incosistent at header " << pos << endl;
             has_error = true;
         }
+        if (active_pos_[pos] >= num_active_ ||
+            active_columns_[active_pos_[pos]] != (uint32_t)pos ||
+            active_counts_[active_pos_[pos]] != header_[pos].count) {
+            cerr << "Active column set inconsistent at header " << pos
+                 << endl;
+            has_error = true;
+        }
     }
 
     // check model count
@@ -1649,8 +2769,8 @@ bool ZddWithLinks::sanity() const {
     if (root_nid == -1) return has_error;
 
     {
-        unordered_set<int32_t> reachable;
-        stack<int32_t> stk;
+        unordered_set<node_t> reachable;
+        stack<node_t> stk;
         reachable.insert(root_nid);
         stk.push(root_nid);
 
@@ -1669,10 +2789,10 @@ bool ZddWithLinks::sanity() const {
             }
         }
 
-        vector<int32_t> sorted_nodes(reachable.begin(), reachable.end());
+        vector<node_t> sorted_nodes(reachable.begin(), reachable.end());
 
         std::sort(sorted_nodes.begin(), sorted_nodes.end(),
-                  std::greater<int32_t>());
+                  std::greater<node_t>());
 
         vector<count_t> dp_upper(table_.size(), 0UL);
         vector<count_t> dp_hi(table_.size(), 0ULL);
@@ -1680,7 +2800,7 @@ bool ZddWithLinks::sanity() const {
 
         dp_upper[sorted_nodes[0]] = 1;
 
-        for (int i = 0; i < sorted_nodes.size(); i++) {
+        for (size_t i = 0; i < sorted_nodes.size(); i++) {
             const auto nid = sorted_nodes[i];
             const Node &n = table_[nid];
             if (n.count_upper != dp_upper[nid]) {
@@ -1696,7 +2816,7 @@ bool ZddWithLinks::sanity() const {
             }
         }
 
-        for (int i = sorted_nodes.size() - 1; i >= 0; i--) {
+        for (node_t i = sorted_nodes.size() - 1; i >= 0; i--) {
             const auto nid = sorted_nodes[i];
             const Node &n = table_[nid];
             if (n.hi == DD_ONE_TERM) {
@@ -1725,3 +2845,6 @@ bool ZddWithLinks::sanity() const {
 
     return has_error;
 }
+
+#define INSTANTIATE(L) template class ZddWithLinks<L>;
+FOR_EACH_LAYOUT(INSTANTIATE)
@@ -6,23 +6,48 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <iterator>
+#include <limits>
 #include <memory>
+#include <memory_resource>
 #include <queue>
+#include <random>
 #include <sstream>
 #include <stack>
 #include <string>
 #include <tuple>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
+#include "count_types.h"
 #include "hidden_node_stack.h"
+#include "output_zdd.h"
+#include "solution_writer.h"
+#include "subproblem_cache.h"
 #include "timer.h"
 using namespace std;
+template <typename L>
 class DpManager;
+template <typename NodeId>
 class HiddenNodeStack;
+template <typename L>
+class WorkStealingSearch;
+template <typename L>
+class CubeAndConquer;
+template <typename L>
+class Portfolio;
+template <typename L>
+class SearchEstimator;
+template <typename L>
+class SolutionSampler;
+template <typename L>
+class LinkBench;
+class ZddLoader;
 
 /**
  * constants
@@ -31,19 +56,72 @@ constexpr int DD_ONE_TERM =
     -1;  // represents the $\top$-terminal node of DanceDD.
 constexpr int DD_ZERO_TERM =
     -2;  // represents the $\bot$-terminal node of DanceDD
-constexpr int MAX_DEPTH = 1000;  // maximum depth of the search tree.
-using nstack_t = std::stack<int32_t>;
-using count_t = uint32_t;
 
 /**
  * type of parent links
  * lower 2 bits are used for flags, remaining bits are used for showing parent
- * nodes.
+ * nodes. The width of a link is that of the layout (Layout::plink_t).
  */
-using plink_t = uint32_t;  
 constexpr uint32_t PLINK_IS_TERMINAL = 2LU;  // 二进制 `10` (第2位)
 constexpr uint32_t PLINK_IS_HI = 1LU;  // 二进制 `01` (第1位)
 constexpr uint32_t PLINK_ADDR_OFFSET = 2LU;  // 地址偏移量（右移2位）
+constexpr uint32_t PLINK_TAG_MASK = 3LU;  // the flags, the tag of a link
+
+/**
+ * Integer types of the structure.
+ * @attr count_t: counts of paths of the nodes and of options of the columns.
+ * Each of them is at most the number of options, the 1-paths of the root,
+ * so the loader picks the narrowest layout whose count_t holds that number.
+ * @attr wide_count_t: sums and products of two counts.
+ * @attr column_t: columns (variables) in the nodes, the choice buffers and
+ * the solutions. The header links them as signed numbers, so a layout holds
+ * up to MAX_COLUMNS columns.
+ * @attr node_t: node ids, negative for the terminals.
+ * @attr plink_t: parent links, a node id and two flags, and the entries of
+ * the choice traces, a node id and the branch taken. A layout holds up to
+ * MAX_NODES nodes.
+ */
+template <typename Count, typename WideCount, typename Column = uint16_t,
+          typename NodeId = int32_t>
+struct Layout {
+    using count_t = Count;
+    using wide_count_t = WideCount;
+    using column_t = Column;
+    using header_link_t = std::make_signed_t<Column>;
+    using node_t = NodeId;
+    using plink_t = std::make_unsigned_t<NodeId>;
+
+    static constexpr int MAX_COLUMNS =
+        std::numeric_limits<header_link_t>::max();
+    static constexpr uint64_t MAX_NODES =
+        (uint64_t)(std::numeric_limits<plink_t>::max() >> PLINK_ADDR_OFFSET) +
+        1;
+};
+
+using Layout32 = Layout<uint32_t, uint64_t>;  // the compact default
+// with wider counts 16-bit columns would not make the nodes smaller, so
+// these layouts always have 32-bit columns.
+using Layout64 = Layout<uint64_t, count128_t, uint32_t>;
+using Layout128 = Layout<count128_t, count128_t, uint32_t>;
+
+// layout L with 32-bit columns, for instances beyond L::MAX_COLUMNS.
+template <typename L>
+using WideColumns = Layout<typename L::count_t, typename L::wide_count_t,
+                           uint32_t, typename L::node_t>;
+
+// layout L with 64-bit node ids and links, for diagrams beyond L::MAX_NODES.
+template <typename L>
+using LargeDiagram = Layout<typename L::count_t, typename L::wide_count_t,
+                            typename L::column_t, int64_t>;
+
+#define FOR_EACH_NODE_LAYOUT(X, L) X(L) X(LargeDiagram<L>)
+
+// calls X(layout) for every layout main can select, e.g. to instantiate the
+// templates: WideColumns only changes Layout32.
+#define FOR_EACH_LAYOUT(X)                            \
+    FOR_EACH_NODE_LAYOUT(X, Layout32)                 \
+    FOR_EACH_NODE_LAYOUT(X, WideColumns<Layout32>)    \
+    FOR_EACH_NODE_LAYOUT(X, Layout64) FOR_EACH_NODE_LAYOUT(X, Layout128)
 
 /**
  * Node cell
@@ -54,30 +132,24 @@ constexpr uint32_t PLINK_ADDR_OFFSET = 2LU;  // 地址偏移量（右移2位）
  exist, the value is -1.
  * @attr down: id of the next node cell having the same var. If no such cell
  exist, the value is -1.
- * @attr parents_head: head of the parent node list.
- * @attr parents_tail: tail of the parent node list.
- * @attr hi_next: the next edge of hi-edge pointing to the same child node.
- * @attr hi_prev: the previous edge of hi-edge pointing to the same child node.
- * @attr lo_next: the next edge of lo-edge pointing to the same child node.
- * @attr lo_prev: the previous edge of lo-edge pointing to the same child node.
  * @attr count_upper: number of routes from the root danceDD node.
  * @attr count_hi: the number of routes from the hi-child to TOP-terminal.
  * @attr count_lo: the number of routes from the lo-child to TOP-terminal.
-
+ * The parent links of the cell are kept apart in NodeLinks, so the fields
+ * read by every update of batch_cover fill 32 bytes in the compact layout.
  */
+template <typename L>
 struct Node {
    public:
-    Node(uint16_t var, int32_t hi, int32_t lo)
+    using Count = typename L::count_t;
+    using Column = typename L::column_t;
+    using node_t = typename L::node_t;
+
+    Node(Column var, node_t hi, node_t lo)
         : hi(hi),
           lo(lo),
           up(-1),
           down(-1),
-          parents_head(0),
-          parents_tail(0),
-          hi_next(0),
-          hi_prev(0),
-          lo_next(0),
-          lo_prev(0),
           count_hi(0),
           count_lo(0),
           count_upper(0),
@@ -89,12 +161,6 @@ struct Node {
           lo(obj.lo),
           up(obj.up),
           down(obj.down),
-          parents_head(obj.parents_head),
-          parents_tail(obj.parents_tail),
-          hi_next(obj.hi_next),
-          hi_prev(obj.hi_prev),
-          lo_next(obj.lo_next),
-          lo_prev(obj.lo_prev),
           count_hi(obj.count_hi),
           count_lo(obj.count_lo),
           count_upper(obj.count_upper),
@@ -103,29 +169,64 @@ struct Node {
 
     bool operator==(const Node &obj) const {
         return var == obj.var && hi == obj.hi && lo == obj.lo && up == obj.up &&
-               down == obj.down && parents_head == obj.parents_head &&
-               parents_tail == obj.parents_tail && hi_next == obj.hi_next &&
-               hi_prev == obj.hi_prev && lo_next == obj.lo_next &&
-               lo_prev == obj.lo_prev && count_upper == obj.count_upper &&
+               down == obj.down && count_upper == obj.count_upper &&
                count_hi == obj.count_hi && count_lo == obj.count_lo;
     }
 
     bool operator!=(const Node &obj) const { return !(*this == obj); }
-    int32_t hi;
-    int32_t lo;
-    int32_t up;
-    int32_t down;
-    plink_t parents_head;
-    plink_t parents_tail;
-    plink_t hi_next;
-    plink_t hi_prev;
-    plink_t lo_next;
-    plink_t lo_prev;
-    count_t count_hi; // hi-child 到终端（T-terminal）的路径数
-    count_t count_lo; // lo-child 到终端（T-terminal）的路径数
-    count_t count_upper; // 从根节点到当前节点的路径数
-    uint16_t var; // 当前节点对应的变量编号
-    uint16_t padding; // 内存对齐填充位
+    node_t hi;
+    node_t lo;
+    node_t up;
+    node_t down;
+    Count count_hi; // hi-child 到终端（T-terminal）的路径数
+    Count count_lo; // lo-child 到终端（T-terminal）的路径数
+    Count count_upper; // 从根节点到当前节点的路径数
+    Column var; // 当前节点对应的变量编号
+    Column padding; // 内存对齐填充位
+};
+
+/**
+ * Parent links of a node cell, stored at the same id as the cell.
+ * @attr slot: slot[tag][PREV / NEXT] are the neighbours of the link tagged
+ * tag (its flags) pointing at this cell: the hi edge for PLINK_IS_HI, the lo
+ * edge for 0, and the ends of the cell's own parent list for
+ * PLINK_IS_TERMINAL, the tail as PREV and the head as NEXT. A parent list
+ * is circular through the terminal link of the child, so a tagged link
+ * indexes the slot it is stored in without branching on its flags.
+ * @attr parents_head: head of the parent node list.
+ * @attr parents_tail: tail of the parent node list.
+ * @attr hi_next: the next edge of hi-edge pointing to the same child node.
+ * @attr hi_prev: the previous edge of hi-edge pointing to the same child node.
+ * @attr lo_next: the next edge of lo-edge pointing to the same child node.
+ * @attr lo_prev: the previous edge of lo-edge pointing to the same child node.
+ */
+template <typename L>
+struct NodeLinks {
+   public:
+    using plink_t = typename L::plink_t;
+    static constexpr int PREV = 0;
+    static constexpr int NEXT = 1;
+
+    bool operator==(const NodeLinks &obj) const {
+        return std::equal(&slot[0][0], &slot[0][0] + 6, &obj.slot[0][0]);
+    }
+
+    bool operator!=(const NodeLinks &obj) const { return !(*this == obj); }
+
+    plink_t &parents_head() { return slot[PLINK_IS_TERMINAL][NEXT]; }
+    plink_t &parents_tail() { return slot[PLINK_IS_TERMINAL][PREV]; }
+    plink_t &hi_next() { return slot[PLINK_IS_HI][NEXT]; }
+    plink_t &hi_prev() { return slot[PLINK_IS_HI][PREV]; }
+    plink_t &lo_next() { return slot[0][NEXT]; }
+    plink_t &lo_prev() { return slot[0][PREV]; }
+    plink_t parents_head() const { return slot[PLINK_IS_TERMINAL][NEXT]; }
+    plink_t parents_tail() const { return slot[PLINK_IS_TERMINAL][PREV]; }
+    plink_t hi_next() const { return slot[PLINK_IS_HI][NEXT]; }
+    plink_t hi_prev() const { return slot[PLINK_IS_HI][PREV]; }
+    plink_t lo_next() const { return slot[0][NEXT]; }
+    plink_t lo_prev() const { return slot[0][PREV]; }
+
+    plink_t slot[3][2] = {};
 };
 
 /**
@@ -137,10 +238,16 @@ struct Node {
  * @attr var: corresponding variable
  * @attr count: number of options having the variable
  */
+template <typename L>
 struct Header {
    public:
-    Header(int16_t left, int16_t right, int32_t down, int32_t up, uint16_t var,
-           count_t count)
+    using Count = typename L::count_t;
+    using Column = typename L::column_t;
+    using node_t = typename L::node_t;
+    using link_t = typename L::header_link_t;
+
+    Header(link_t left, link_t right, node_t down, node_t up, Column var,
+           Count count)
         : left(left),
           right(right),
           var(var),
@@ -157,43 +264,171 @@ struct Header {
 
     bool operator!=(const Header &o) const { return !((*this) == o); }
 
-    int16_t left;
-    int16_t right;
-    uint16_t var;
-    uint16_t padding1;  // dummy value
-    int32_t down;
-    int32_t up;
-    count_t count;
+    link_t left;
+    link_t right;
+    Column var;
+    Column padding1;  // dummy value
+    node_t down;
+    node_t up;
+    Count count;
     int32_t padding2;
 };
 
 /**
- * DanceDD structure
+ * Branching order of the search.
+ * @attr tie_break: column chosen among the columns with the minimum count.
+ * @attr node_order: Down walks the nodes of the chosen column along the down
+ * links, Up walks them backwards along the up links.
+ * @attr upper_order: order of the upper choices (up_id) of a node.
+ * @attr seed: seed of TieBreak::Random.
+ * @attr column_rule: rule choosing the column to branch on; tie_break picks
+ * among the columns it ranks equal.
+ * A configuration is named "<tie>-<nodes>-<upper>[-<rule>]", e.g.
+ * "first-down-asc" (the default), "random7-up-desc" or
+ * "first-down-asc-cost".
+ */
+struct SearchConfig {
+    enum class TieBreak { First, Last, Random };
+    // Mrv: the fewest options. Nodes: the fewest options, then the fewest
+    // nodes. Cost: the fewest options times nodes, a static stand-in for
+    // the updates made by the covers of its options; it does not follow a
+    // cover into the nodes above and below the column, where the updates
+    // are made, so it can rank columns far from their real cost. Lookahead:
+    // among the columns with the fewest options, the one whose options
+    // leave the fewest options in total to the next branching.
+    enum class ColumnRule { Mrv, Nodes, Cost, Lookahead };
+    // Count: the nodes with most options (count_upper * count_hi) first.
+    enum class NodeOrder { Down, Up, Count };
+    // Lookahead: the upper choices covering the columns with fewest options
+    // first, i.e. the choices that remove fewest other options.
+    enum class UpperOrder { Ascending, Descending, Lookahead };
+
+    TieBreak tie_break = TieBreak::First;
+    NodeOrder node_order = NodeOrder::Down;
+    UpperOrder upper_order = UpperOrder::Ascending;
+    ColumnRule column_rule = ColumnRule::Mrv;
+    uint64_t seed = 0;
+
+    string name() const;
+    // throws std::invalid_argument for an unknown name.
+    static SearchConfig parse(const string &name);
+};
+
+/**
+ * DanceDD structure, with the integer types of layout L.
  */
+template <typename L>
 class ZddWithLinks {
    public:
+    using count_t = typename L::count_t;
+    using wide_count_t = typename L::wide_count_t;
+    using column_t = typename L::column_t;
+    using node_t = typename L::node_t;
+    using plink_t = typename L::plink_t;
+    using Node = ::Node<L>;
+    using Links = ::NodeLinks<L>;
+    using Header = ::Header<L>;
+    // a solution: its options, each the sorted list of its columns.
+    using Solution = vector<vector<column_t>>;
+
+    /**
+     * A search frame as another replica needs it to take it over: the
+     * column chosen at a depth and the option covered for it, the
+     * up_pos-th upper choice of node_id with the lower choice of a trace.
+     */
+    struct FrameState {
+        column_t column = 0;
+        node_t node_id = -1;
+        count_t up_pos = 0;  // position of up_id in the enumeration order
+        count_t up_id = 0;    // the upper choice at up_pos
+        size_t node_pos = 0;  // position of node_id in NodeOrder::Count
+        vector<column_t> upper_choice;
+        vector<plink_t> lower_trace;
+        vector<size_t> lower_change_pts;
+    };
+
+    /**
+     * The options left to a frame of a paused search, split off by
+     * split_search. frames[i] is the frame at depth + i; the frames above
+     * the last one give their covered option, the last one the options
+     * after its covered option.
+     */
+    struct SearchSplit {
+        int depth = 0;
+        vector<FrameState> frames;
+    };
+
     // counters
     uint64_t num_search_tree_nodes;
-    uint64_t num_solutions;
+    count128_t num_solutions;
     uint64_t num_updates;
     uint64_t num_head_updates;
     uint64_t num_inactive_updates;
     uint64_t num_hides;
     uint64_t num_failure_backtracks;
 
-    ZddWithLinks(int num_var, bool sanity_check = false);
-    ZddWithLinks(const ZddWithLinks &obj);
+    /**
+     * @param resource: memory of the node table, the header and the dp
+     * tables; it must outlive the structure.
+     * Throws std::overflow_error if num_var exceeds L::MAX_COLUMNS.
+     */
+    ZddWithLinks(int num_var, bool sanity_check = false,
+                 std::pmr::memory_resource *resource =
+                     std::pmr::get_default_resource());
+    /**
+     * Creates an independent replica of a loaded structure at rest (no
+     * columns covered) in resource. Counters of the replica start from zero.
+     */
+    ZddWithLinks(const ZddWithLinks &obj,
+                 std::pmr::memory_resource *resource =
+                     std::pmr::get_default_resource());
+
+    std::pmr::memory_resource *resource() const { return resource_; }
 
     CStopWatch stopwatch;
 
     bool operator==(const ZddWithLinks &obj) const;
 
     /**
-     * The main recursive procedure.
-     * @param solution: partioal solution found so far
+     * The main procedure: start_search(depth), then resume_search until
+     * the subtree is searched.
+     * @param solution: partioal solution found so far, filled with the
+     * options of depths 0..depth-1 when solutions are enumerated
      * @param depth: depth of the search tree, initially depht= 0
      */
-    void search(vector<vector<uint16_t>> &solution, const int depth);
+    void search(Solution &solution, const int depth);
+
+    /**
+     * Sets up the search of the subtree of the current state at depth. The
+     * search keeps its frames on an explicit stack, so it has no depth
+     * limit and can be paused between two search tree nodes.
+     */
+    void start_search(const int depth);
+
+    /**
+     * Runs the search until it is finished (true) or until max_nodes more
+     * search tree nodes have been entered (false). A paused search keeps
+     * the options of its open frames covered; it is resumed by calling
+     * resume_search again, and no other search may run in between.
+     */
+    bool resume_search(Solution &solution, uint64_t max_nodes = UINT64_MAX);
+
+    /**
+     * Splits the remaining options of the shallowest frame of a paused
+     * search that has options after its covered one off into split. The
+     * paused search leaves that frame after its covered option.
+     * @return false if no frame has options left.
+     */
+    bool split_search(SearchSplit &split);
+
+    /**
+     * Sets up the search of a split of another replica with the same
+     * configuration: covers the options of its frames, and resume_search
+     * then searches the options after the covered one of its last frame
+     * and uncovers everything. A split of a search started at depth 0
+     * needs a structure at rest.
+     */
+    void start_split(const SearchSplit &split);
 
     /**
      * load zdd file.
@@ -202,10 +437,290 @@ class ZddWithLinks {
      */
     void load_zdd_from_file(const string &file_name);
 
+    /**
+     * load the nodes parsed by loader and set up the links with num_threads
+     * threads. The result is identical to load_zdd_from_file.
+     */
+    void load_zdd(const ZddLoader &loader, int num_threads);
+
+    /**
+     * Renumbers the nodes of a loaded structure at rest for locality and sets
+     * up the links again with num_threads threads. The levels are stored
+     * from the deepest up as before, and the nodes of a level in the order a
+     * breadth-first walk from the root meets them, hi child first, so the
+     * children of neighbours in a down list are neighbours in theirs.
+     * Counts, solutions and option numbers do not depend on node ids and
+     * are unchanged. The options of a column are searched in the new down
+     * list order.
+     * Throws std::runtime_error if a child is not on a deeper level.
+     */
+    void renumber_nodes(int num_threads = 1);
+
     // check validity of the dancedd structure
     bool sanity() const;
 
+    /**
+     * Makes search() throw once the flag becomes true. Used to stop the
+     * replicas of a parallel search.
+     */
+    void set_cancel_flag(const std::atomic<bool> *flag) {
+        cancel_flag_ = flag;
+    }
+
+    void set_search_config(const SearchConfig &config) {
+        config_ = config;
+        rng_.seed(config.seed);
+    }
+
+    const SearchConfig &search_config() const { return config_; }
+
+    /**
+     * search() stops after finding limit solutions, uncovering everything it
+     * has covered. The solutions found are kept in found_solutions().
+     */
+    void set_solution_limit(uint64_t limit) { solution_limit_ = limit; }
+
+    // solutions of a limited search, each a list of options (sorted columns).
+    const vector<Solution> &found_solutions() const {
+        return found_solutions_;
+    }
+
+    // starts the clock of first_solution_time().
+    void mark_search_start();
+
+    // seconds from mark_search_start() to the first solution, -1 if none.
+    double first_solution_time() const { return first_solution_time_; }
+
+    /**
+     * count-only memoization: search() looks up the set of uncovered columns
+     * in cache and adds the stored count instead of searching the subtree
+     * again. Ignored in parallel, cube splitting and limited searches, where
+     * a subtree is not counted as a whole. nullptr disables it.
+     */
+    void set_subproblem_cache(SubproblemCache *cache) { memo_ = cache; }
+
+    /**
+     * Makes search() build the family of solutions in output, with the
+     * options numbered by an OptionIndex of this structure (taken now, so
+     * the structure must be at rest). Like memoization, this needs a serial
+     * search without limit. After search(solution, 0), output_root() is the
+     * root of the family. nullptr disables it.
+     */
+    void set_output_zdd(OutputZdd *output);
+
+    OutputZdd::node_t output_root() const { return output_result_; }
+
+    /**
+     * Makes search() enumerate the solutions and push each one to writer.
+     * Memoization is skipped. Only a serial search can write. nullptr
+     * disables it.
+     */
+    void set_solution_writer(SolutionWriter *writer) {
+        writer_ = writer;
+        writer_shared_ = 0;
+    }
+
+    int num_var() const { return num_var_; }
+
    private:
+    friend class WorkStealingSearch<L>;
+    friend class CubeAndConquer<L>;
+    friend class Portfolio<L>;
+    friend class SearchEstimator<L>;
+    friend class SolutionSampler<L>;
+    friend class LinkBench<L>;
+
+    /**
+     * A frame of the search stack: the column chosen at a depth, the
+     * option covered for it and where its enumeration stands. The options
+     * are enumerated from the up_pos-th upper choice of node_id in the
+     * order of the search configuration. If resumed is true, the option in
+     * the frame has already been searched by another replica; it is
+     * covered again and the enumeration continues with the next lower
+     * choice.
+     */
+    struct Frame {
+        vector<column_t> column;  // the chosen column
+        vector<column_t> upper_choice;
+        vector<column_t> lower_choice;
+        vector<plink_t> lower_trace;
+        vector<size_t> lower_change_pts;
+        vector<node_t> node_order;  // NodeOrder::Count
+        size_t node_pos = 0;  // of node_id in node_order
+        // UpperOrder::Lookahead: the ranked upper choices of node_id from
+        // position up_order_start, (score, up_id) in order.
+        vector<pair<wide_count_t, count_t>> up_order;
+        count_t up_order_start = 0;
+        node_t node_id = -1;
+        node_t next_node_id = -1;
+        count_t up_pos = 0;
+        count_t up_id = 0;  // the upper choice at up_pos
+        count_t up_end = 0;
+        bool in_node = false;    // next_node_id and up_end are of node_id
+        bool in_option = false;  // an option of the frame is covered
+        bool resumed = false;
+        bool split_off = false;  // the options after the covered one are gone
+        // memoization of the subtree, see enter_frame.
+        bool memoize = false;
+        count128_t num_solutions_before = 0;
+        uint64_t num_nodes_before = 0;
+        // the options tried with the families below them (output_).
+        vector<pair<uint64_t, OutputZdd::node_t>> output_options;
+    };
+
+    // what resume_search does next at search_depth_.
+    enum class SearchStep {
+        Enter,   // enter the search tree node
+        Next,    // cover the next option of the frame
+        Return,  // come back from the option of the frame
+    };
+
+    // the frame at depth; the stack grows to it.
+    Frame &frame_at(const int depth) {
+        if ((size_t)depth >= frames_.size()) {
+            frames_.resize(depth + 1);
+        }
+        return frames_[depth];
+    }
+
+    /**
+     * Enters the search tree node at depth: counts it and, unless it is
+     * finished without branching (a solution, a dead end, a leaf counted in
+     * closed form, a cache hit or a cube), covers the chosen column and
+     * opens its frame. Returns whether the frame was opened.
+     */
+    bool enter_frame(Solution &solution, const int depth);
+
+    /**
+     * Covers the next option of the frame at depth. Returns false, with
+     * the options uncovered, if the frame has none left.
+     */
+    bool next_option(Solution &solution, const int depth);
+
+    /**
+     * Back from the subtree of the option of the frame at depth. Returns
+     * false, with the option uncovered, if the solution limit is reached.
+     */
+    bool return_to_frame(const int depth);
+
+    // uncovers the column of the frame at depth and closes it.
+    void leave_frame(const int depth);
+
+    // the frame at depth may have options after its covered one.
+    bool frame_has_more(const Frame &frame) const {
+        return !frame.lower_change_pts.empty() ||
+               frame.up_pos + 1 < frame.up_end || frame.next_node_id >= 0;
+    }
+
+    // the frame at depth, for another replica.
+    void save_frame(const int depth, FrameState &state) const;
+
+    // the columns of the option covered at depth, in ascending order.
+    void depth_option(const int depth, vector<column_t> &option) const;
+
+    // cover / uncover the option stored in the frame at depth, except for
+    // the column chosen at that depth.
+    void cover_depth_option(const int depth);
+    void uncover_depth_option(const int depth);
+
+    // cover / uncover the lower choice given by a trace and its change points
+    // in the same batches as compute_lower_initial_choice does.
+    void cover_lower_segments(const vector<plink_t> &visited,
+                              const vector<size_t> &diff_choices,
+                              vector<column_t> &choice_buf);
+    void uncover_lower_segments(const vector<plink_t> &visited,
+                                const vector<size_t> &diff_choices,
+                                vector<column_t> &choice_buf);
+
+    /**
+     * The uncovered column chosen by the configured column rule and tie
+     * break, or -1 if some column has no option left. remain_cols is set to the
+     * number of uncovered columns (when the result is not -1).
+     */
+    int choose_column(int &remain_cols);
+
+    // choose_column for ColumnRule::Nodes and ColumnRule::Cost.
+    int choose_scored_column(int &remain_cols);
+    // choose_column for ColumnRule::Lookahead.
+    int choose_lookahead_column(int &remain_cols);
+
+    // the number of nodes of a column, or limit if it has more.
+    uint64_t column_nodes(int col, uint64_t limit) const;
+
+    /**
+     * The sum over the options of a column of the fewest options of a
+     * column left after covering it, 1 if no column is left. The sum stops
+     * once it reaches limit.
+     */
+    wide_count_t lookahead_branching(int col, wide_count_t limit);
+
+    // fills the active column set from the header list.
+    void setup_active_columns();
+
+    // removes a column being covered from the active column set.
+    void deactivate_column(int col) {
+        const uint32_t pos = active_pos_[col];
+        const uint32_t last = --num_active_;
+        const uint32_t last_col = active_columns_[last];
+        std::swap(active_counts_[pos], active_counts_[last]);
+        active_columns_[pos] = last_col;
+        active_columns_[last] = col;
+        active_pos_[last_col] = pos;
+        active_pos_[col] = last;
+    }
+
+    // puts back the last column removed, in the reverse order of removal.
+    void reactivate_column(int col) {
+        assert(active_columns_[num_active_] == (uint32_t)col);
+        (void)col;
+        num_active_++;
+    }
+
+    // copies the count of a column from its header cell to the active set.
+    void sync_active_count(int col) {
+        active_counts_[active_pos_[col]] = header_[col].count;
+    }
+
+    // adds count solutions found at depth: notes the time of the first one
+    // and, in a limited search, keeps the options of the solution.
+    void add_solutions(const int depth, const count128_t count);
+
+    // value ordering, see SearchConfig. the nodes of the column covered at
+    // depth in the node_order of its frame, from its node_pos, and the
+    // upper choices of its node_id in batches: rank_upper_choices starts
+    // at up_pos, ranked_upper_choice gives the up_pos-th one.
+    void rank_column_nodes(const int depth, const int column);
+    node_t next_ranked_node(const int depth);
+    void rank_upper_choices(const int depth);
+    count_t ranked_upper_choice(const int depth);
+    wide_count_t upper_choice_score(const vector<column_t> &upper_choice) const;
+
+    /**
+     * Counts the solutions of a node with one or two uncovered columns from
+     * the column counts, without covering options. column is the chosen
+     * column. With one column nothing is covered; with two, column is
+     * covered and uncovered once to count the options of the other column
+     * without it, and only those updates go to num_updates, which is
+     * therefore lower than the option-by-option search would count. The
+     * other counters are updated as the full search would. With a solution
+     * writer, the solutions are pushed.
+     */
+    void count_leaf_solutions(Solution &solution, const int depth,
+                              const int column, const int remain_cols);
+
+    // pushes the options of depths 0..size-1 of solution to writer_.
+    void push_solution(const Solution &solution, const size_t size);
+
+    // records the option covered at depth with the solutions below it
+    // (output_result_).
+    void add_output_option(const int depth);
+
+    // the union of the options recorded at depth, each with its solutions.
+    OutputZdd::node_t unite_output_options(const int depth);
+
+    // bitset of the uncovered columns, built in memo_key_.
+    const SubproblemCache::Key &uncovered_columns_key();
+
     /***
      * parent link operation methods.
      *
@@ -224,124 +739,156 @@ class ZddWithLinks {
 
     /**
      * parent linkの操作．将 addr 指向的相应分支的 prev 的值设置为 val。
+     * The flags of addr index the slot directly (see NodeLinks).
      */
     inline void plink_set_prev(plink_t addr, plink_t val) {
         assert((addr & 3LU) != 3LU);
         assert((val & 3LU) != 3LU);
-        Node &node = table_[plink_node_id(addr)];
-        if (plink_is_hi(addr)) {
-            node.hi_prev = val;
-        } else if (plink_is_term(addr)) {
-            node.parents_tail = val;
-        } else {
-            node.lo_prev = val;
-        }
+        plink_slot(addr)[Links::PREV] = val;
     }
 
     inline void plink_set_next(plink_t addr, plink_t val) {
         assert((addr & 3LU) != 3LU);
         assert((val & 3LU) != 3LU);
-        Node &node = table_[plink_node_id(addr)];
-        if (plink_is_hi(addr)) {
-            node.hi_next = val;
-        } else if (plink_is_term(addr)) {
-            node.parents_head = val;
-        } else {
-            node.lo_next = val;
-        }
+        plink_slot(addr)[Links::NEXT] = val;
     }
 
     inline plink_t plink_get_prev(plink_t addr) const {
         assert((addr & 3LU) != 3LU);
-
-        const Node &node = table_[plink_node_id(addr)];
-
-        if (plink_is_hi(addr)) {
-            return node.hi_prev;
-        } else if (plink_is_term(addr)) {
-            return node.parents_tail;
-        } else {
-            return node.lo_prev;
-        }
+        return plink_slot(addr)[Links::PREV];
     }
 
     inline plink_t plink_get_next(plink_t addr) const {
         assert((addr & 3LU) != 3LU);
-        const Node &node = table_[plink_node_id(addr)];
-
-        if (plink_is_hi(addr)) {
-            return node.hi_next;
-        } else if (plink_is_term(addr)) {
-            return node.parents_head;
-        } else {
-            return node.lo_next;
-        }
+        return plink_slot(addr)[Links::NEXT];
     }
 
+    // the prev / next pair stored for link addr.
+    inline plink_t *plink_slot(plink_t addr) {
+        return links_[plink_node_id(addr)].slot[addr & PLINK_TAG_MASK];
+    }
+    inline const plink_t *plink_slot(plink_t addr) const {
+        return links_[plink_node_id(addr)].slot[addr & PLINK_TAG_MASK];
+    }
+
+    // removes link from the list it is in; its own slot is kept.
+    inline void plink_unlink(plink_t link) {
+        const plink_t *slot = plink_slot(link);
+        const plink_t prev = slot[Links::PREV], next = slot[Links::NEXT];
+        plink_set_prev(next, prev);
+        plink_set_next(prev, next);
+    }
+
+    // puts link back between the neighbours kept in its slot.
+    inline void plink_relink(plink_t link) {
+        const plink_t *slot = plink_slot(link);
+        plink_set_prev(slot[Links::NEXT], link);
+        plink_set_next(slot[Links::PREV], link);
+    }
+
+    // the hi / lo edge of node_id as a link.
+    static plink_t hi_plink(node_t node_id) {
+        return (plink_t)node_id << PLINK_ADDR_OFFSET | PLINK_IS_HI;
+    }
+    static plink_t lo_plink(node_t node_id) {
+        return (plink_t)node_id << PLINK_ADDR_OFFSET;
+    }
+    // the terminal link of node_id: the ends of its parent list.
+    static plink_t term_plink(node_t node_id) {
+        return (plink_t)node_id << PLINK_ADDR_OFFSET | PLINK_IS_TERMINAL;
+    }
+
+    /**
+     * Counts the paths and links the nodes. Throws std::overflow_error if
+     * the number of paths of a node does not fit in count_t.
+     */
     void setup_dancing_links();
+    /**
+     * Level-parallel version of setup_dancing_links(). Nodes of one variable
+     * are independent, so each pass runs level by level with the nodes of a
+     * level split among num_threads threads. Falls back to the serial version
+     * if the levels are not contiguous or a child is not on a deeper level,
+     * and for counts wider than 64 bits, which have no lock-free atomic add.
+     */
+    void setup_dancing_links(int num_threads);
 
-    void batch_cover(const std::vector<uint16_t>::const_iterator col_begin,
-                     const std::vector<uint16_t>::const_iterator col_end);
+    // a + b, false if the sum does not fit in count_t.
+    static bool add_paths(count_t a, count_t b, count_t &sum) {
+        return !__builtin_add_overflow(a, b, &sum);
+    }
+
+    using column_iterator = typename vector<column_t>::const_iterator;
+
+    void batch_cover(const column_iterator col_begin,
+                     const column_iterator col_end);
 
-    void batch_uncover(const std::vector<uint16_t>::const_iterator col_begin,
-                       const std::vector<uint16_t>::const_iterator col_end);
+    void batch_uncover(const column_iterator col_begin,
+                       const column_iterator col_end);
 
-    void compute_upper_choice(int32_t node_id, count_t up_id,
-                              vector<uint16_t> &choice) noexcept;
+    void compute_upper_choice(node_t node_id, count_t up_id,
+                              vector<column_t> &choice) noexcept;
 
-    void compute_upper_initial_choice(int32_t node_id,
-                                      vector<uint32_t> &visited,
+    void compute_upper_initial_choice(node_t node_id,
+                                      vector<plink_t> &visited,
                                       vector<size_t> &diff_choices,
-                                      vector<int32_t> &diff_choice_ids,
-                                      vector<uint16_t> &choices_buf) noexcept;
+                                      vector<node_t> &diff_choice_ids,
+                                      vector<column_t> &choices_buf) noexcept;
 
-    bool compute_upper_next_choice(vector<uint32_t> &visited,
+    bool compute_upper_next_choice(vector<plink_t> &visited,
                                    vector<size_t> &diff_choices,
-                                   vector<int32_t> &diff_choice_ids,
-                                   vector<uint16_t> &choice_buf);
+                                   vector<node_t> &diff_choice_ids,
+                                   vector<column_t> &choice_buf);
 
-    void compute_lower_choice(int32_t node_id, count_t down_id,
-                              vector<uint16_t> &choice) noexcept;
+    void compute_lower_choice(node_t node_id, count_t down_id,
+                              vector<column_t> &choice) noexcept;
 
-    void compute_lower_initial_choice(const int32_t start_id,
-                                      vector<uint32_t> &visited,
+    void compute_lower_initial_choice(const node_t start_id,
+                                      vector<plink_t> &visited,
                                       vector<size_t> &diff_choices,
-                                      vector<uint16_t> &choices_buf);
+                                      vector<column_t> &choices_buf);
 
-    bool compute_lower_next_choice(vector<uint32_t> &visited,
+    bool compute_lower_next_choice(vector<plink_t> &visited,
                                    vector<size_t> &diff_choices,
-                                   vector<uint16_t> &choice_buf);
+                                   vector<column_t> &choice_buf);
 
     template <typename ForwardIterator>
     void trace2choice(ForwardIterator begin, ForwardIterator end,
-                      vector<uint16_t> &choice) const {
+                      vector<column_t> &choice) const {
         choice.clear();
         for (auto it = begin; it != end; ++it) {
-            uint32_t val = *it;
+            plink_t val = *it;
             if (val & 1U) {
                 choice.push_back(table_[val >> 1U].var);
             }
         }
     }
 
-    void hide_node(const int32_t node_id);
+    // points the parents of node_id at target; restore_parents undoes it.
+    void redirect_parents(const node_t node_id, const node_t target);
+    void restore_parents(const node_t node_id);
+    // moves the parents of node_id to the end of the parent list of child;
+    // unsplice_parents undoes it.
+    void splice_parents(const node_t node_id, const node_t child);
+    void unsplice_parents(const node_t node_id);
 
-    void hide_node_cover_down(const int32_t node_id);
-    void hide_node_cover_up(const int32_t node_id);
-    void hide_node_upperzero(const int32_t node_id);
-    void hide_node_lowerzero(const int32_t node_id);
+    void hide_node(const node_t node_id);
 
-    void unhide_node(const int32_t node_id);
+    void hide_node_cover_down(const node_t node_id);
+    void hide_node_cover_up(const node_t node_id);
+    void hide_node_upperzero(const node_t node_id);
+    void hide_node_lowerzero(const node_t node_id);
+
+    void unhide_node(const node_t node_id);
     
-    void unhide_node_cover_down(const int32_t node_id);
-    void unhide_node_cover_up(const int32_t node_id);
-    void unhide_node_upperzero(const int32_t node_id);
-    void unhide_node_lowerzero(const int32_t node_id);
+    void unhide_node_cover_down(const node_t node_id);
+    void unhide_node_cover_up(const node_t node_id);
+    void unhide_node_upperzero(const node_t node_id);
+    void unhide_node_lowerzero(const node_t node_id);
 
-    void print_parent_links(const int32_t node_id) const {
-        const Node &node = table_[node_id];
+    void print_parent_links(const node_t node_id) const {
+        const Links &links = links_[node_id];
         std::cerr << node_id << ", ";
-        for (plink_t plink = node.parents_head;;
+        for (plink_t plink = links.parents_head();;
              plink = plink_get_next(plink)) {
             auto pid = plink_node_id(plink);
             auto is_hi = plink_is_hi(plink);
@@ -356,7 +903,7 @@ class ZddWithLinks {
             } else {
                 std::cerr << "LO), ";
             }
-            if (plink == node.parents_tail) {
+            if (plink == links.parents_tail()) {
                 break;
             }
         }
@@ -365,23 +912,88 @@ class ZddWithLinks {
 
     const int num_var_;
 
+    // parallel search: frames shallower than steal_depth_ are published to
+    // work_stealing_ so that idle workers can take their remaining options.
+    WorkStealingSearch<L> *work_stealing_;
+    int worker_id_;
+    int steal_depth_;
+    const std::atomic<bool> *cancel_flag_;
+
+    // cube-and-conquer: search() hands the frames reaching cube_depth_ to
+    // cube_splitter_ instead of searching them.
+    CubeAndConquer<L> *cube_splitter_;
+    int cube_depth_;
+
+    SearchConfig config_;
+    std::mt19937_64 rng_;
+    uint64_t solution_limit_;
+    vector<Solution> found_solutions_;
+    std::chrono::steady_clock::time_point search_start_;
+    double first_solution_time_;
+
+    SubproblemCache *memo_;
+    SubproblemCache::Key memo_key_;  // uncovered columns of the current node
+
+    // solution family output: a search tree node leaves the family of the
+    // solutions below it in output_result_; the output_options of its
+    // frame collect the options tried with the families below them.
+    OutputZdd *output_;
+    // with output_, the smallest uncovered column is branched on unless it
+    // has this many times the options of the chosen column. Total
+    // --output-zdd time on the 49 benchmark instances: 2 took 14 s, 3 took
+    // 12 s and 4 took 16 s.
+    static constexpr unsigned OUTPUT_BRANCH_FACTOR = 3;
+    unique_ptr<OptionIndex> option_index_;
+    OutputZdd::node_t output_result_;
+    vector<column_t> output_option_buf_;
+
+    SolutionWriter *writer_;
+    size_t writer_shared_;  // options of solution unchanged since the last push
+
+    std::pmr::memory_resource *resource_;
     // storing the node cells
-    vector<Node> table_; 
+    std::pmr::vector<Node> table_; 
+    // storing the parent links of the node cells, by node id
+    std::pmr::vector<Links> links_;
     // storing the header cells
-    vector<Header> header_;
-
-    unique_ptr<DpManager> dp_mgr_;
-    unique_ptr<HiddenNodeStack> hidden_node_stack_;
+    std::pmr::vector<Header> header_;
+    // the uncovered columns as a sparse set, scanned by choose_column:
+    // active_columns_[0..num_active_) with their counts, a copy of those of
+    // the header cells, and the position of every column in them. Covered
+    // columns stay past num_active_, in the order they were covered.
+    std::pmr::vector<count_t> active_counts_;
+    std::pmr::vector<uint32_t> active_columns_;
+    std::pmr::vector<uint32_t> active_pos_;
+    size_t num_active_;
+
+    // columns with the fewest options compared by choose_lookahead_column.
+    static constexpr size_t LOOKAHEAD_COLUMNS = 8;
+    // buffers of choose_lookahead_column.
+    vector<column_t> lookahead_candidates_;
+    vector<column_t> lookahead_column_buf_;
+    vector<column_t> lookahead_upper_buf_;
+    vector<column_t> lookahead_lower_buf_;
+    vector<column_t> lookahead_option_buf_;
+
+    unique_ptr<DpManager<L>> dp_mgr_;
+    unique_ptr<HiddenNodeStack<node_t>> hidden_node_stack_;
     const bool sanity_check_;
 
-    // buffers used in the search.
-    vector<vector<uint16_t>> depth_choice_buf_;
-    vector<vector<uint16_t>> depth_upper_choice_buf_;
-    vector<vector<uint16_t>> depth_lower_choice_buf_;
-    vector<vector<uint32_t>> depth_lower_trace_buf_;
-    vector<vector<size_t>> depth_lower_change_pts_buf_;
-    vector<vector<uint32_t>> depth_upper_trace_buf_;
-    vector<vector<size_t>> depth_upper_change_pts_buf_;
-    vector<vector<int32_t>> depth_upper_change_node_ids_buf_;
+    // the search stack, by depth. it grows with the deepest search and is
+    // kept, with the capacity of its buffers, for the next one.
+    vector<Frame> frames_;
+    // the frames [base_depth_, search_depth_) are open; those from
+    // replay_depth_ were covered by start_split.
+    int replay_depth_;
+    int base_depth_;
+    int search_depth_;
+    SearchStep search_step_;
+
+    // upper choices are ranked in batches growing from UP_RANK_BATCH to
+    // UP_RANK_BATCH_MAX, which bounds the memory of a frame of a node with
+    // many of them; each batch rescans the choices.
+    static constexpr size_t UP_RANK_BATCH = 256;
+    static constexpr size_t UP_RANK_BATCH_MAX = 1 << 16;
+    vector<column_t> up_rank_choice_buf_;
 };
 #endif  // DANCING_ON_ZDD_H_
\ No newline at end of file
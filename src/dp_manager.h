@@ -2,148 +2,167 @@
 #define DP_MANAGER_H_
 
 #include <memory>
-#include <queue>
+#include <memory_resource>
 #include <vector>
 
 #include "dancing_on_zdd.h"
+#include "level_scheduler.h"
+
+// the alignment of the dp slot of a node. A slot of up to 16 bytes is
+// padded to a power of two, so it never straddles two cache lines; larger
+// slots keep the alignment of their counts, as padding 20 bytes to 32 would
+// cost more memory traffic than the rare straddle.
+template <typename Count>
+constexpr size_t dp_slot_align() {
+    const size_t bytes = 2 * sizeof(Count) + sizeof(uint32_t);
+    if (bytes > 16) return alignof(Count);
+    size_t align = alignof(Count);
+    while (align < bytes) align *= 2;
+    return align;
+}
 
 /**
  * A class having dp tables for cover / uncover operaitons.
  *  When performing cover/uncover operations, the order must be reversed. 
  *  the class stores the order of processed node cell ids.
+ *  The variables holding counts are visited in ascending order by the lower
+ *  pass of a cover and in descending order by the upper pass, through a
+ *  LevelScheduler each.
+ *  The counts are stamped with the epoch of the pass that wrote them, so
+ *  begin_pass drops all of them at once instead of clearing each node as it
+ *  is read, and a node is queued when its stamp is not the current epoch.
  */
-
-struct Node;
+template <typename L>
 class DpManager {
    public:
-    DpManager(const std::vector<Node> &nodes, const int num_var);
+    using count_t = typename L::count_t;
+    using column_t = typename L::column_t;
+    using node_t = typename L::node_t;
+    using Node = typename ZddWithLinks<L>::Node;
+
+    DpManager(const std::pmr::vector<Node> &nodes, const int num_var,
+              std::pmr::memory_resource *resource =
+                  std::pmr::get_default_resource());
     DpManager(const DpManager &obj) = delete;
 
-    void add_node_diff_count(uint16_t var, int32_t node_id, count_t count) {
-        diff_counter_[node_id] += count;
-        if (diff_counter_[node_id] > count) {
-            return;
+    /**
+     * The dp state of a node: its diff counts, which count only in the pass
+     * they were written in (epoch). Reading the counts of a node touches one
+     * cache line.
+     */
+    struct alignas(dp_slot_align<count_t>()) Slot {
+        count_t count;  // the diff count, of the lo paths in the upper pass
+        count_t count_hi;
+        uint32_t epoch;
+    };
+
+    // starts a lower or upper pass: the counts of earlier passes read as 0.
+    void begin_pass() {
+        if (++epoch_ == 0) {
+            for (Slot &slot : slots_) slot.epoch = 0;
+            epoch_ = 1;
         }
+    }
 
-        auto var_num_elems = num_elems_[var];
-        num_elems_[var]++;
-        table_elems_[var_heads_[var] + var_num_elems] = node_id;
-        if (!var_num_elems) {
-            lower_varorder_pq_.push(var);
+    void add_node_diff_count(column_t var, node_t node_id, count_t count) {
+        Slot &slot = slots_[node_id];
+        if (slot.epoch == epoch_) {
+            slot.count += count;
+            return;
+        }
+        // the lower pass reads count only.
+        slot.epoch = epoch_;
+        slot.count = count;
+        if (push_elem(var, node_id) == 0) {
+            lower_vars_.add(var);
         }
     }
 
-    void add_node_diff_count_high(uint16_t var, int32_t node_id,
+    void add_node_diff_count_high(column_t var, node_t node_id,
                                   count_t count) {
-        if (diff_counter_[node_id] > 0 || diff_counter_hi_[node_id] > 0) {
-            diff_counter_hi_[node_id] += count;
+        Slot &slot = slots_[node_id];
+        if (slot.epoch == epoch_) {
+            slot.count_hi += count;
             return;
         }
-
-        diff_counter_hi_[node_id] += count;
-        table_elems_[var_heads_[var] + num_elems_[var]] = node_id;
-        num_elems_[var]++;
-        if (num_elems_[var] == 1) {
-            upper_varorder_pq_.push(var);
+        slot.epoch = epoch_;
+        slot.count = 0;
+        slot.count_hi = count;
+        if (push_elem(var, node_id) == 0) {
+            upper_vars_.add(var);
         }
     }
 
-    void add_node_diff_count_low(uint16_t var, int32_t node_id, count_t count) {
-        if (diff_counter_[node_id] > 0 || diff_counter_hi_[node_id] > 0) {
-            diff_counter_[node_id] += count;
+    void add_node_diff_count_low(column_t var, node_t node_id, count_t count) {
+        Slot &slot = slots_[node_id];
+        if (slot.epoch == epoch_) {
+            slot.count += count;
             return;
         }
-
-        diff_counter_[node_id] += count;
-        table_elems_[var_heads_[var] + num_elems_[var]] = node_id;
-        num_elems_[var]++;
-        if (num_elems_[var] == 1) {
-            upper_varorder_pq_.push(var);
+        slot.epoch = epoch_;
+        slot.count = count;
+        slot.count_hi = 0;
+        if (push_elem(var, node_id) == 0) {
+            upper_vars_.add(var);
         }
     }
 
-    inline int32_t at(uint16_t var, int32_t i) const noexcept {
+    inline node_t at(column_t var, node_t i) const noexcept {
         return table_elems_[var_heads_[var] + i];
     }
 
-    int32_t num_elems(uint16_t var) const { return num_elems_[var]; }
-
-    count_t count_at(int32_t node_id) const { return diff_counter_[node_id]; }
+    node_t num_elems(column_t var) const { return num_elems_[var]; }
 
-    count_t low_count_at(int32_t node_id) const {
-        return diff_counter_[node_id];
+    count_t count_at(node_t node_id) const {
+        const Slot &slot = slots_[node_id];
+        return slot.epoch == epoch_ ? slot.count : 0;
     }
 
-    count_t high_count_at(int32_t node_id) const {
-        return diff_counter_hi_[node_id];
-    }
+    count_t low_count_at(node_t node_id) const { return count_at(node_id); }
 
-    count_t get_count_and_clear(const int32_t node_id) {
-        auto c = diff_counter_[node_id];
-        diff_counter_[node_id] = 0;
-        return c;
+    count_t high_count_at(node_t node_id) const {
+        const Slot &slot = slots_[node_id];
+        return slot.epoch == epoch_ ? slot.count_hi : 0;
     }
 
-    count_t get_low_count_and_clear(const int32_t node_id) {
-        auto c = diff_counter_[node_id];
-        diff_counter_[node_id] = 0;
-        return c;
+    // the counts of a node queued in this pass, one of at(var, i): no need
+    // to check its epoch.
+    count_t queued_count(node_t node_id) const {
+        return slots_[node_id].count;
     }
 
-    count_t get_high_count_and_clear(const int32_t node_id) {
-        auto c = diff_counter_hi_[node_id];
-        diff_counter_hi_[node_id] = 0;
-        return c;
+    count_t queued_high_count(node_t node_id) const {
+        return slots_[node_id].count_hi;
     }
 
-    void clear_var_counter(uint16_t var) { num_elems_[var] = 0; }
+    void clear_var_counter(column_t var) { num_elems_[var] = 0; }
 
-    void clear_var_elems(uint16_t var) {
-        for (size_t i = 0; i < num_elems_[var]; i++) {
-            auto node_id = at(var, i);
-            diff_counter_[node_id] = 0UL;
-            diff_counter_hi_[node_id] = 0UL;
-        }
-        num_elems_[var] = 0;
-    }
-
-    uint16_t upper_nonzero_var() {
-        if (upper_varorder_pq_.empty()) return 0;
+    // the largest variable added by the upper pass, 0 if none is left.
+    column_t upper_nonzero_var() { return upper_vars_.pop_max(); }
 
-        uint16_t next = upper_varorder_pq_.top();
-        upper_varorder_pq_.pop();
-        return next;
-    }
+    // the smallest variable added by the lower pass, 0 if none is left.
+    column_t lower_nonzero_var() { return lower_vars_.pop_min(); }
 
+    void add_upper_var(column_t var) { upper_vars_.add(var); }
 
-    uint16_t lower_nonzero_var() {
-        if (lower_varorder_pq_.empty()) return 0;
+    void add_lower_var(column_t var) { lower_vars_.add(var); }
 
-        uint16_t next = lower_varorder_pq_.top();
-        lower_varorder_pq_.pop();
-        return next;
-
-        return 0;
+   private:
+    // queues node_id on var; returns the number of nodes queued before.
+    node_t push_elem(column_t var, node_t node_id) {
+        const node_t k = num_elems_[var]++;
+        table_elems_[var_heads_[var] + k] = node_id;
+        return k;
     }
 
-    void add_upper_var(uint16_t var) { upper_varorder_pq_.push(var); }
-
-    void add_lower_var(uint16_t var) { lower_varorder_pq_.push(var); }
-
-
-   private:
-    std::vector<int32_t> table_elems_;
-    std::vector<int32_t> var_heads_;
-    std::vector<int32_t> num_elems_;
-    std::vector<count_t> diff_counter_;
-    std::vector<count_t> diff_counter_hi_;
-
-    uint32_t entries_counter_;
-    const uint16_t num_var_;
-    int var_cache_;
-    std::priority_queue<uint16_t, std::vector<uint16_t>, std::greater<uint16_t>>
-        lower_varorder_pq_;
-    std::priority_queue<uint16_t> upper_varorder_pq_;
+    std::pmr::vector<Slot> slots_;
+    // the nodes queued on each variable, from var_heads_[var] on.
+    std::pmr::vector<node_t> table_elems_;
+    std::pmr::vector<node_t> var_heads_;
+    std::pmr::vector<node_t> num_elems_;
+    uint32_t epoch_;
+    LevelScheduler lower_vars_;
+    LevelScheduler upper_vars_;
 };
 
 #endif  // DP_MANAGER_H_
\ No newline at end of file
@@ -1,4 +1,20 @@
 #include "hidden_node_stack.h"
 
-HiddenNodeStack::HiddenNodeStack(): 
-node_stack_(), stack_start_positions_() {}
\ No newline at end of file
+template <typename NodeId>
+HiddenNodeStack<NodeId>::HiddenNodeStack(std::pmr::memory_resource *resource)
+    : node_stack_(resource),
+      stack_start_positions_(std::pmr::vector<NodeId>(resource)) {}
+
+template <typename NodeId>
+void HiddenNodeStack<NodeId>::reserve(size_t num_nodes, int num_var) {
+    assert(stack_start_positions_.empty());
+    node_stack_.reserve(num_nodes);
+    // two checkpoints per level of the search: cover and upper/lower zero.
+    std::pmr::vector<NodeId> positions(node_stack_.get_allocator());
+    positions.reserve(2 * static_cast<size_t>(num_var) + 2);
+    stack_start_positions_ =
+        std::stack<NodeId, std::pmr::vector<NodeId>>(std::move(positions));
+}
+
+template class HiddenNodeStack<int32_t>;
+template class HiddenNodeStack<int64_t>;
@@ -4,43 +4,55 @@
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <memory_resource>
 #include <stack>
 #include <vector>
 /**
  * A stack storing the node cells to hide.
  * this class helps to restore hidden nodes in an appropriate order.
+ * NodeId is the node id type of the layout; it also holds the positions of
+ * the checkpoints.
  */
-
+template <typename NodeId>
 class HiddenNodeStack {
    public:
     enum class HideType { UpperZero, LowerZero, CoverUp, CoverDown };
    
-    using stack_value_t = std::pair<int32_t, HideType>;
+    using stack_value_t = std::pair<NodeId, HideType>;
+
 
+    explicit HiddenNodeStack(std::pmr::memory_resource *resource =
+                                 std::pmr::get_default_resource());
 
-    HiddenNodeStack();
+    /**
+     * Reserves room for hiding every node once and for the checkpoints of a
+     * search of depth num_var, so that the stack does not grow during the
+     * search.
+     */
+    void reserve(size_t num_nodes, int num_var);
 
     stack_value_t top() const { return *node_stack_.crbegin(); }
 
     void pop() { node_stack_.pop_back(); }
-    void push_cover_down(const int32_t val) {
+    void push_cover_down(const NodeId val) {
         node_stack_.emplace_back(val, HideType::CoverDown);
     }
 
-    void push_cover_up(const int32_t val) {
+    void push_cover_up(const NodeId val) {
         node_stack_.emplace_back(val, HideType::CoverUp);
     }
 
-    void push_upperzero(const int32_t val) {
+    void push_upperzero(const NodeId val) {
         node_stack_.emplace_back(val, HideType::UpperZero);
     }
 
-    void push_lowerzero(const int32_t val) {
+    void push_lowerzero(const NodeId val) {
         node_stack_.emplace_back(val, HideType::LowerZero);
     }
 
     bool is_empty() const {
-        return node_stack_.size() == stack_start_positions_.top();
+        return node_stack_.size() ==
+               static_cast<size_t>(stack_start_positions_.top());
     }
     void push_checkpoint() { stack_start_positions_.push(node_stack_.size()); }
 
@@ -49,11 +61,11 @@ class HiddenNodeStack {
                      node_stack_.end());
     }
 
-    std::vector<stack_value_t>::const_iterator stack_cbegin() const {
+    typename std::pmr::vector<stack_value_t>::const_iterator stack_cbegin() const {
         return node_stack_.cbegin() + stack_start_positions_.top();
     }
 
-    std::vector<stack_value_t>::const_iterator stack_cend() const {
+    typename std::pmr::vector<stack_value_t>::const_iterator stack_cend() const {
         return node_stack_.cend();
     }
 
@@ -63,8 +75,8 @@ class HiddenNodeStack {
     }
 
    private:
-    std::vector<stack_value_t> node_stack_;
-    std::stack<int32_t, std::vector<int32_t>> stack_start_positions_;
+    std::pmr::vector<stack_value_t> node_stack_;
+    std::stack<NodeId, std::pmr::vector<NodeId>> stack_start_positions_;
 };
 
 #endif  // HIDDEN_NODE_STACK_H_
\ No newline at end of file
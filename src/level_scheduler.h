@@ -0,0 +1,112 @@
+#ifndef LEVEL_SCHEDULER_H_
+#define LEVEL_SCHEDULER_H_
+
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+/**
+ * The set of variables (levels) waiting to be visited by a cover or uncover
+ * pass, as a bitmap with one bit per variable.
+ *  A summary word has a bit per word of the bitmap that is not zero, so the
+ *  next variable is found with one find-first-set or find-last-set in a
+ *  summary word and one in a bitmap word. The summary words are scanned
+ *  linearly; there is one per 4096 variables.
+ *  The smallest and the largest variable are kept apart, so pop_min and
+ *  pop_max return them with one load, and the search for the next one is
+ *  off the path of the caller that visits the popped variable.
+ *  Adding a variable that is already in the set does nothing, so every
+ *  variable is visited once however many times it was added.
+ *  Variable 0 is never added (it is the head of the header cells); pop_min
+ *  and pop_max return 0 if the set is empty.
+ */
+class LevelScheduler {
+   public:
+    explicit LevelScheduler(size_t num_var,
+                            std::pmr::memory_resource *resource =
+                                std::pmr::get_default_resource())
+        : min_(0),
+          max_(0),
+          words_(num_var / WORD_BITS + 1, 0, resource),
+          summary_(words_.size() / WORD_BITS + 1, 0, resource) {}
+
+    void add(size_t var) {
+        const size_t w = var / WORD_BITS;
+        words_[w] |= 1ULL << (var % WORD_BITS);
+        summary_[w / WORD_BITS] |= 1ULL << (w % WORD_BITS);
+        if (min_ == 0 || var < min_) min_ = var;
+        if (var > max_) max_ = var;
+    }
+
+    // removes and returns the smallest variable of the set.
+    size_t pop_min() {
+        const size_t var = min_;
+        if (var == 0) return 0;
+        remove(var);
+        min_ = next_above(var);
+        if (min_ == 0) max_ = 0;
+        return var;
+    }
+
+    // removes and returns the largest variable of the set.
+    size_t pop_max() {
+        const size_t var = max_;
+        if (var == 0) return 0;
+        remove(var);
+        max_ = next_below(var);
+        if (max_ == 0) min_ = 0;
+        return var;
+    }
+
+   private:
+    static constexpr size_t WORD_BITS = 64;
+
+    void remove(size_t var) {
+        const size_t w = var / WORD_BITS;
+        words_[w] &= ~(1ULL << (var % WORD_BITS));
+        if (words_[w] == 0) {
+            summary_[w / WORD_BITS] &= ~(1ULL << (w % WORD_BITS));
+        }
+    }
+
+    // the smallest variable of the set above var, 0 if none.
+    size_t next_above(size_t var) const {
+        size_t w = var / WORD_BITS;
+        const uint64_t rest = words_[w] & (~1ULL << (var % WORD_BITS));
+        if (rest != 0) return w * WORD_BITS + __builtin_ctzll(rest);
+        w++;
+        for (size_t s = w / WORD_BITS; s < summary_.size(); s++) {
+            uint64_t bits = summary_[s];
+            if (s == w / WORD_BITS) bits &= ~0ULL << (w % WORD_BITS);
+            if (bits == 0) continue;
+            w = s * WORD_BITS + __builtin_ctzll(bits);
+            return w * WORD_BITS + __builtin_ctzll(words_[w]);
+        }
+        return 0;
+    }
+
+    // the largest variable of the set below var, 0 if none.
+    size_t next_below(size_t var) const {
+        size_t w = var / WORD_BITS;
+        const uint64_t rest =
+            words_[w] & ((1ULL << (var % WORD_BITS)) - 1);
+        if (rest != 0) {
+            return w * WORD_BITS + (WORD_BITS - 1 - __builtin_clzll(rest));
+        }
+        for (size_t s = w / WORD_BITS + 1; s-- > 0;) {
+            uint64_t bits = summary_[s];
+            if (s == w / WORD_BITS) bits &= (1ULL << (w % WORD_BITS)) - 1;
+            if (bits == 0) continue;
+            w = s * WORD_BITS + (WORD_BITS - 1 - __builtin_clzll(bits));
+            return w * WORD_BITS + (WORD_BITS - 1 - __builtin_clzll(words_[w]));
+        }
+        return 0;
+    }
+
+    size_t min_;  // the smallest variable of the set, 0 if it is empty
+    size_t max_;  // the largest variable of the set, 0 if it is empty
+    std::pmr::vector<uint64_t> words_;
+    std::pmr::vector<uint64_t> summary_;
+};
+
+#endif  // LEVEL_SCHEDULER_H_
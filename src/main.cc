@@ -1,13 +1,24 @@
+#include <getopt.h>
 #include <math.h>
 #include <unistd.h>
 
 #include <chrono>
+#include <type_traits>
 #include <unordered_set>
 #include <filesystem>
 #include <fstream>
 
+#include "arena.h"
+#include "batch_runner.h"
+#include "cube_and_conquer.h"
 #include "dancing_on_zdd.h"
 #include "dp_manager.h"
+#include "portfolio.h"
+#include "search_estimator.h"
+#include "solution_sampler.h"
+#include "solution_writer.h"
+#include "work_stealing_search.h"
+#include "zdd_loader.h"
 
 using namespace std;
 namespace fs = std::filesystem;
@@ -21,40 +32,582 @@ namespace fs = std::filesystem;
 // extern uint64_t num_solutions;
 // extern uint64_t ZddWithLinks::num_updates;
 // extern uint64_t num_inactive_updates;
-int get_num_vars_from_zdd_file(const string& file_name) {
-    ifstream ifs(file_name);
-    if (!ifs) {
-        cerr << "can't open " << file_name << endl;
-        exit(1);
+
+/**
+ * a zdd file before the structure is built: the number of variables, of
+ * options and of nodes, which picks the layout. The file is parsed by
+ * ZddLoader, which counts them in its pass and is kept for the load.
+ */
+struct ZddFile {
+    string name;
+    int num_vars = 0;
+    count128_t num_options = 0;  // 1-paths of the root, saturated
+    uint64_t num_nodes = 0;
+    unique_ptr<ZddLoader> loader;
+};
+
+ZddFile read_zdd_file(const string& file_name, int num_threads = 1) {
+    ZddFile file;
+    file.name = file_name;
+    file.loader = make_unique<ZddLoader>(file_name, max(num_threads, 1));
+    file.num_vars = file.loader->num_vars();
+    file.num_options = file.loader->num_options();
+    file.num_nodes = file.loader->nodes().size();
+    return file;
+}
+
+// call f(L()), or with LargeDiagram<L> if file has more nodes than L holds.
+template <typename L, typename F>
+auto with_nodes(const ZddFile& file, F&& f) {
+    if (file.num_nodes <= L::MAX_NODES) {
+        return f(L());
+    }
+    return f(LargeDiagram<L>());
+}
+
+// with_nodes<L>, or with WideColumns<L> if file has more columns than L holds.
+template <typename L, typename F>
+auto with_columns(const ZddFile& file, F&& f) {
+    if (file.num_vars <= L::MAX_COLUMNS) {
+        return with_nodes<L>(file, f);
+    }
+    return with_nodes<WideColumns<L>>(file, f);
+}
+
+/**
+ * call f(L()) with the narrowest layout whose counts hold the number of
+ * options of file; every path count of the structure is at most that.
+ */
+template <typename F>
+auto with_layout(const ZddFile& file, F&& f) {
+    if (file.num_options <= UINT32_MAX) {
+        return with_columns<Layout32>(file, f);
+    }
+    if (file.num_options <= UINT64_MAX) {
+        return with_nodes<Layout64>(file, f);
+    }
+    if (file.num_options == COUNT128_MAX) {
+        throw std::runtime_error(file.name +
+                                 ": the options do not fit in 128 bits");
+    }
+    return with_nodes<Layout128>(file, f);
+}
+
+// print layout L to stderr unless it is the compact default.
+template <typename L>
+void print_layout() {
+    if (std::is_same_v<L, Layout32>) return;
+    fprintf(stderr,
+            "layout: %d-bit counts, %d-bit columns, %d-bit node ids\n",
+            (int)(8 * sizeof(typename L::count_t)),
+            (int)(8 * sizeof(typename L::column_t)),
+            (int)(8 * sizeof(typename L::node_t)));
+}
+
+/**
+ * how to run the search of an instance.
+ */
+struct SearchOptions {
+    int num_threads = 1;
+    SearchConfig config;             // configuration of a single search
+    vector<SearchConfig> portfolio;  // raced configurations, if not empty
+    uint64_t solution_limit = UINT64_MAX;  // stop after this many solutions
+    bool memo = false;               // memoize subproblem counts
+    SubproblemCache::Config memo_config;
+    string output_zdd_file;  // write the solutions as a zdd, if not empty
+    string solutions_file;   // enumerate the solutions to it, if not empty
+    SolutionWriter::Format solutions_format = SolutionWriter::Format::Ndjson;
+    double approx_time = 0.0;  // approximate count budget in seconds, if > 0
+    double approx_error = 0.01;
+    double approx_confidence = 0.95;
+    bool renumber = false;  // renumber the nodes for locality after load
+};
+
+/**
+ * write the family of solutions built by the search to file_name and check
+ * that it holds every solution that was counted.
+ */
+void write_output_zdd(const string& file_name, const OutputZdd& output,
+                      OutputZdd::node_t root, count128_t num_solutions) {
+    if (output.count(root) != num_solutions) {
+        throw std::runtime_error("output zdd has " +
+                                 count_to_string(output.count(root)) +
+                                 " solutions, counted " +
+                                 count_to_string(num_solutions));
+    }
+    ofstream ofs(file_name);
+    if (!ofs) {
+        throw std::runtime_error("can't open " + file_name);
+    }
+    output.write(ofs, root);
+    if (!ofs) {
+        throw std::runtime_error("can't write " + file_name);
+    }
+    fprintf(stderr, "output zdd: %zu nodes, %zu built\n", output.size(root),
+            output.size());
+}
+
+/**
+ * run the search from the root. if num_threads > 1, the search is shared by
+ * num_threads workers with work stealing and their counters are merged into
+ * zdd_with_links. with a portfolio, the configurations race and the counters
+ * of the winner are copied to zdd_with_links.
+ * @return the name of the configuration that produced the counters.
+ */
+template <typename L>
+string run_search(ZddWithLinks<L>& zdd_with_links,
+                  const SearchOptions& options) {
+    zdd_with_links.mark_search_start();
+    if (!options.portfolio.empty()) {
+        Portfolio<L> portfolio(zdd_with_links, options.portfolio,
+                               options.solution_limit);
+        portfolio.run();
+        fprintf(stderr, "portfolio: %zu configs, winner: %s\n",
+                options.portfolio.size(), portfolio.winner().name().c_str());
+        return portfolio.winner().name();
+    }
+    const int num_threads = options.num_threads;
+    zdd_with_links.set_search_config(options.config);
+    zdd_with_links.set_solution_limit(options.solution_limit);
+    if (num_threads > 1) {
+        WorkStealingSearch<L> work_stealing(zdd_with_links, num_threads);
+        work_stealing.run();
+        fprintf(stderr, "workers: %d, steals: %llu\n", num_threads,
+                (unsigned long long)work_stealing.num_steals());
+    } else if (!options.solutions_file.empty()) {
+        SolutionWriter writer(options.solutions_file, options.solutions_format,
+                              zdd_with_links.num_var());
+        zdd_with_links.set_solution_writer(&writer);
+        typename ZddWithLinks<L>::Solution solution;
+        try {
+            zdd_with_links.search(solution, 0);
+        } catch (...) {
+            zdd_with_links.set_solution_writer(nullptr);
+            throw;
+        }
+        zdd_with_links.set_solution_writer(nullptr);
+        writer.finish();
+        fprintf(stderr, "solutions written: %llu, %.1f MB, queue stalls: %llu\n",
+                (unsigned long long)writer.num_written(),
+                writer.num_bytes() / 1048576.0,
+                (unsigned long long)writer.num_stalls());
+    } else if (options.memo || !options.output_zdd_file.empty()) {
+        // the output zdd shares the families of memoized subproblems, so
+        // it always runs with a cache.
+        SubproblemCache cache(options.memo_config);
+        OutputZdd output;
+        zdd_with_links.set_subproblem_cache(&cache);
+        if (!options.output_zdd_file.empty()) {
+            zdd_with_links.set_output_zdd(&output);
+        }
+        typename ZddWithLinks<L>::Solution solution;
+        try {
+            zdd_with_links.search(solution, 0);
+        } catch (...) {
+            zdd_with_links.set_subproblem_cache(nullptr);
+            zdd_with_links.set_output_zdd(nullptr);
+            throw;
+        }
+        zdd_with_links.set_subproblem_cache(nullptr);
+        zdd_with_links.set_output_zdd(nullptr);
+        if (!options.output_zdd_file.empty()) {
+            write_output_zdd(options.output_zdd_file, output,
+                             zdd_with_links.output_root(),
+                             zdd_with_links.num_solutions);
+        }
+        const uint64_t lookups = cache.num_hits() + cache.num_misses();
+        fprintf(stderr,
+                "memo: hits: %llu, hit rate: %.2f%%, entries: %zu, "
+                "size: %.1f MB, evictions: %llu, saved nodes: %llu\n",
+                (unsigned long long)cache.num_hits(),
+                lookups ? 100.0 * cache.num_hits() / lookups : 0.0,
+                cache.size(), cache.bytes() / 1048576.0,
+                (unsigned long long)cache.num_evictions(),
+                (unsigned long long)cache.num_saved_nodes());
+    } else {
+        typename ZddWithLinks<L>::Solution solution;
+        zdd_with_links.search(solution, 0);
+    }
+    return zdd_with_links.search_config().name();
+}
+
+/**
+ * load a zdd file into arena and check the initial structure. the nodes
+ * parsed by ZddLoader are linked with num_threads threads and then
+ * released; a file without its loader is read again by the serial loader.
+ */
+template <typename L>
+unique_ptr<ZddWithLinks<L>> load_zdd(ZddFile& file, Arena& arena,
+                                     int num_threads = 1,
+                                     bool renumber = false) {
+    auto zdd_with_links =
+        make_unique<ZddWithLinks<L>>(file.num_vars, false, &arena);
+    if (file.loader) {
+        zdd_with_links->load_zdd(*file.loader, num_threads);
+        file.loader.reset();
+    } else {
+        zdd_with_links->load_zdd_from_file(file.name);
+    }
+    if (renumber) {
+        zdd_with_links->renumber_nodes(num_threads);
+    }
+
+    if (zdd_with_links->sanity()) {
+        throw std::runtime_error("initial zdd is invalid");
+    }
+    return zdd_with_links;
+}
+
+/**
+ * count the solutions of an instance approximately within the budget of
+ * options.
+ */
+template <typename L>
+SearchEstimatorBase::CountResult approximate_count(
+    ZddWithLinks<L>& zdd_with_links, const SearchOptions& options) {
+    zdd_with_links.set_search_config(options.config);
+    return SearchEstimator<L>(zdd_with_links)
+        .count(options.approx_time, options.approx_error,
+               options.approx_confidence);
+}
+
+// solve_instance of a file read in layout L.
+template <typename L>
+BatchResult solve_instance(ZddFile& file, long time_limit,
+                           const SearchOptions& options, Arena& arena) {
+    auto zdd_with_links =
+        load_zdd<L>(file, arena, options.num_threads, options.renumber);
+    zdd_with_links->stopwatch.setTimeBound(time_limit);
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+    zdd_with_links->stopwatch.markStartTime();
+    string config;
+    try {
+        config = run_search(*zdd_with_links, options);
+    } catch (const std::runtime_error& e) {
+        if (options.approx_time <= 0 ||
+            !zdd_with_links->stopwatch.timeBoundBroken()) {
+            throw;
+        }
+        // the search stopped half way; start from a fresh structure.
+        zdd_with_links.reset();
+        arena.reset();
+        ZddFile fresh_file = read_zdd_file(file.name);
+        zdd_with_links = load_zdd<L>(fresh_file, arena, 1, options.renumber);
+        const auto count = approximate_count(*zdd_with_links, options);
+        BatchResult result;
+        result.error = e.what();
+        result.approx_solutions = count.num_solutions.mean;
+        result.approx_low = count.num_solutions.low;
+        result.approx_high = count.num_solutions.high;
+        return result;
+    }
+    auto end_time = std::chrono::high_resolution_clock::now();
+
+    BatchResult result;
+    result.config = config;
+    result.num_search_tree_nodes = zdd_with_links->num_search_tree_nodes;
+    result.num_solutions = zdd_with_links->num_solutions;
+    result.num_updates = zdd_with_links->num_updates;
+    result.first_solution_time = zdd_with_links->first_solution_time();
+    result.time = std::chrono::duration_cast<std::chrono::duration<double>>(
+                      end_time - start_time)
+                      .count();
+    result.success = true;
+    return result;
+}
+
+/**
+ * solve one instance of a batch run. the instance is built in arena, which
+ * is reset first. if the search runs out of time and options.approx_time is
+ * set, the instance is loaded again and counted approximately.
+ */
+BatchResult solve_instance(const string& zdd_file_name, long time_limit,
+                           const SearchOptions& options, Arena& arena) {
+    arena.reset();
+    ZddFile file = read_zdd_file(zdd_file_name, options.num_threads);
+    return with_layout(file, [&](auto layout) {
+        using L = decltype(layout);
+        return solve_instance<L>(file, time_limit, options, arena);
+    });
+}
+
+/**
+ * print the estimates of a search with their rough ranges: the lowest and
+ * highest means of groups of the probes, not confidence intervals.
+ */
+void print_estimate(const SearchEstimatorBase::Result& result) {
+    const auto print = [](const char* name,
+                          const SearchEstimatorBase::Estimate& e) {
+        printf("%s: %.4g [%.4g, %.4g]\n", name, e.mean, e.low, e.high);
+    };
+    printf("Probes: %llu\n", (unsigned long long)result.num_probes);
+    print("Nodes", result.num_nodes);
+    print("Solutions", result.num_solutions);
+    print("Updates", result.num_updates);
+    print("Time (s)", result.seconds);
+    printf("Time per update (s): %.3g\n", result.seconds_per_update);
+}
+
+/**
+ * print a solution as "label i: {..} {..}", one option per brace, as its
+ * sorted columns.
+ */
+template <typename Column>
+void print_solution(const char* label, size_t i,
+                    const vector<vector<Column>>& solution) {
+    printf("%s %zu:", label, i);
+    for (const auto& option : solution) {
+        printf(" {");
+        for (size_t j = 0; j < option.size(); j++) {
+            printf(j ? " %u" : "%u", (unsigned)option[j]);
+        }
+        printf("}");
+    }
+    printf("\n");
+}
+
+/**
+ * draw num_samples uniform solutions and print them, or write them to
+ * options.solutions_file if set. sub-counts are cached as with --memo.
+ */
+template <typename L>
+void run_sampler(ZddWithLinks<L>& zdd_with_links, const SearchOptions& options,
+                 uint64_t num_samples, uint64_t seed) {
+    zdd_with_links.set_search_config(options.config);
+    SubproblemCache cache(options.memo_config);
+    zdd_with_links.set_subproblem_cache(&cache);
+    unique_ptr<SolutionWriter> writer;
+    if (!options.solutions_file.empty()) {
+        writer = make_unique<SolutionWriter>(options.solutions_file,
+                                             options.solutions_format,
+                                             zdd_with_links.num_var());
+    }
+    SolutionSampler<L> sampler(zdd_with_links, seed);
+    const auto start_time = std::chrono::high_resolution_clock::now();
+    const auto seconds_since = [](const auto& time) {
+        return std::chrono::duration_cast<std::chrono::duration<double>>(
+                   std::chrono::high_resolution_clock::now() - time)
+            .count();
+    };
+    try {
+        const count128_t num_solutions = sampler.num_solutions();
+        printf("Solutions: %s, Time: %.4f s\n",
+               count_to_string(num_solutions).c_str(),
+               seconds_since(start_time));
+        const auto sample_time = std::chrono::high_resolution_clock::now();
+        typename ZddWithLinks<L>::Solution solution;
+        for (uint64_t i = 0; i < num_samples && sampler.sample(solution);
+             i++) {
+            if (writer) {
+                writer->push(solution, solution.size(), 0);
+            } else {
+                print_solution("Sample", i + 1, solution);
+            }
+        }
+        if (writer) {
+            writer->finish();
+        }
+        fprintf(stderr,
+                "sampling time: %.4f s, options counted: %llu, "
+                "nodes kept: %zu\n",
+                seconds_since(sample_time),
+                (unsigned long long)sampler.num_counted_options(),
+                sampler.num_nodes());
+    } catch (...) {
+        zdd_with_links.set_subproblem_cache(nullptr);
+        throw;
+    }
+    zdd_with_links.set_subproblem_cache(nullptr);
+}
+
+/**
+ * print an approximate count with its range at the confidence, see
+ * SearchEstimatorBase::CountResult.
+ */
+void print_approximate_count(const SearchEstimatorBase::CountResult& result,
+                             double confidence) {
+    const auto& e = result.num_solutions;
+    if (result.exact) {
+        printf("Solutions: %.0f (exact), Time: %.4f s\n", e.mean,
+               result.seconds);
+        return;
+    }
+    printf("Approximate solutions: %.4g [%.4g, %.4g] at %g%%, "
+           "relative error: %.3g, Time: %.4f s\n",
+           e.mean, e.low, e.high, 100 * confidence, result.relative_error,
+           result.seconds);
+    printf("Probes: %llu, exact subtrees: up to %llu nodes\n",
+           (unsigned long long)result.num_probes,
+           (unsigned long long)result.subtree_nodes);
+}
+
+// long options without a short name
+enum LongOption {
+    OPT_CUBES = 256,
+    OPT_SPLIT_DEPTH,
+    OPT_SPLIT_CUBES,
+    OPT_SOLVE_CUBES,
+    OPT_CUBE_ID,
+    OPT_RETRY_MISSING,
+    OPT_MERGE_CUBES,
+    OPT_RESULTS,
+    OPT_JOBS,
+    OPT_ISOLATE,
+    OPT_TIME_LIMIT,
+    OPT_MEM_LIMIT,
+    OPT_LARGEST_FIRST,
+    OPT_PORTFOLIO,
+    OPT_FIRST_SOLUTION,
+    OPT_LIMIT,
+    OPT_CONFIG,
+    OPT_HUGE_PAGES,
+    OPT_NUMA_LOCAL,
+    OPT_VERIFY_LOAD,
+    OPT_MEMO,
+    OPT_MEMO_EVICT,
+    OPT_OUTPUT_ZDD,
+    OPT_SOLUTIONS,
+    OPT_SOLUTIONS_FORMAT,
+    OPT_ESTIMATE,
+    OPT_ESTIMATE_TIME,
+    OPT_ESTIMATE_TIME_FACTOR,
+    OPT_APPROX,
+    OPT_APPROX_ERROR,
+    OPT_APPROX_CONFIDENCE,
+    OPT_SAMPLE,
+    OPT_SEED,
+    OPT_RENUMBER,
+};
+
+struct CubeOptions {
+    string cube_file_name;
+    string results_file_name;
+    int split_depth = -1;
+    size_t split_cubes = 0;
+    bool solve = false;
+    int64_t cube_id = -1;
+    bool retry_missing = false;
+    bool merge = false;
+    bool renumber = false;
+};
+
+/**
+ * cube-and-conquer modes: split an instance into cubes, solve the cubes
+ * from the queue, or merge the results.
+ */
+int run_cube_mode(const string& zdd_file_name, const CubeOptions& options,
+                  Arena& arena) {
+    const string results_file_name = options.results_file_name.empty()
+                                         ? options.cube_file_name + ".results"
+                                         : options.results_file_name;
+
+    if (options.merge) {
+        auto cube_file =
+            CubeAndConquerBase::read_cubes(options.cube_file_name);
+        return CubeAndConquerBase::merge(cube_file, results_file_name) ? 0 : 2;
+    }
+
+    if (options.solve) {
+        auto cube_file =
+            CubeAndConquerBase::read_cubes(options.cube_file_name);
+        ZddFile file = read_zdd_file(
+            zdd_file_name.empty() ? cube_file.zdd_file : zdd_file_name);
+        return with_layout(file, [&](auto layout) {
+            using L = decltype(layout);
+            auto zdd_with_links = load_zdd<L>(file, arena, 1, options.renumber);
+            CubeAndConquer<L> cube_and_conquer(*zdd_with_links);
+            auto start_time = std::chrono::high_resolution_clock::now();
+            size_t num_solved = cube_and_conquer.solve_queue(
+                cube_file, options.cube_file_name, results_file_name,
+                options.cube_id, options.retry_missing);
+            auto end_time = std::chrono::high_resolution_clock::now();
+            printf("solved cubes: %zu, Solutions: %s, Time: %.4f s\n",
+                   num_solved,
+                   count_to_string(zdd_with_links->num_solutions).c_str(),
+                   std::chrono::duration_cast<std::chrono::duration<double>>(
+                       end_time - start_time)
+                       .count());
+            return 0;
+        });
     }
-    string line;
-    unordered_set<int> vars;
-    while (getline(ifs, line)) {
-        if (line[0] == '.' || line[0] == '\n' || line.size() == 0) continue;
-        istringstream iss(line);
-        int nid;
-        int var;
-        string lo_str;
-        int lo_id;
-        string hi_str;
-        int hi_id;
-        iss >> nid;
-        iss >> var;
-        vars.emplace(var);
+
+    if (zdd_file_name.empty()) {
+        cerr << "split mode needs -z zdd_file" << endl;
+        return 1;
     }
-    return vars.size();
+    ZddFile file = read_zdd_file(zdd_file_name);
+    auto cube_file = with_layout(file, [&](auto layout) {
+        using L = decltype(layout);
+        auto zdd_with_links = load_zdd<L>(file, arena, 1, options.renumber);
+        CubeAndConquer<L> cube_and_conquer(*zdd_with_links);
+        return options.split_depth >= 0
+                   ? cube_and_conquer.split(options.split_depth)
+                   : cube_and_conquer.split_to_count(options.split_cubes);
+    });
+    cube_file.zdd_file = zdd_file_name;
+    CubeAndConquerBase::write_cubes(options.cube_file_name, cube_file);
+    printf("depth: %d, cubes: %zu, solutions above depth: %s\n",
+           cube_file.depth, cube_file.cubes.size(),
+           count_to_string(cube_file.num_solutions).c_str());
+    return 0;
 }
 
 void show_help_and_exit() {
     std::cerr << "Usage:" << endl;
     std::cerr << "  Single file: ./d3x -z zdd_file" << endl;
     std::cerr << "  Batch mode:  ./d3x -d input_directory [-o output_file]" << endl;
+    std::cerr << "  Cube split:  ./d3x -z zdd_file --cubes cube_file (--split-depth D | --split-cubes N)" << endl;
+    std::cerr << "  Cube solve:  ./d3x --cubes cube_file --solve-cubes [--cube id | --retry-missing]" << endl;
+    std::cerr << "  Cube merge:  ./d3x --cubes cube_file --merge-cubes" << endl;
     std::cerr << endl;
     std::cerr << "Options:" << endl;
     std::cerr << "  -z file     Process single ZDD file" << endl;
     std::cerr << "  -d dir      Process all ZDD files in directory" << endl;
     std::cerr << "  -o file     Output results file (default: zdd_results.txt)" << endl;
+    std::cerr << "  -j num      Number of search threads (default: 1)" << endl;
+    std::cerr << "  --jobs k            Batch mode: solve k instances at once (default: 1)" << endl;
+    std::cerr << "  --isolate mode      Batch mode: fork (default) or thread" << endl;
+    std::cerr << "  --time-limit s      Batch mode: seconds per instance (default: 1200)" << endl;
+    std::cerr << "  --mem-limit mb      Batch mode: memory per instance in MB (default: none)" << endl;
+    std::cerr << "  --largest-first     Batch mode: start the instances with most nodes first" << endl;
+    std::cerr << "  --portfolio spec    Race search configurations: a number k (first k defaults)" << endl;
+    std::cerr << "                      or names like first-down-asc,last-up-desc,random7-down-asc" << endl;
+    std::cerr << "  --first-solution    Stop at the first solution (--limit 1)" << endl;
+    std::cerr << "  --limit k           Stop after k solutions and print them" << endl;
+    std::cerr << "  --config name       Search configuration, e.g. first-count-look (default:" << endl;
+    std::cerr << "                      first-down-asc); nodes: down, up, count; upper: asc, desc, look" << endl;
+    std::cerr << "                      an optional fourth part picks the column: mrv (default)," << endl;
+    std::cerr << "                      nodes, cost or lookahead, e.g. first-down-asc-cost" << endl;
+    std::cerr << "  --huge-pages        Back the node tables with 2 MB transparent huge pages" << endl;
+    std::cerr << "  --numa-local        Place each search thread's tables on its NUMA node" << endl;
+    std::cerr << "  --verify-load       Check the parallel load (-j) against the serial one" << endl;
+    std::cerr << "  --renumber          Renumber the nodes for locality after load" << endl;
+    std::cerr << "  --memo mb           Count with a cache of subproblems of up to mb MB" << endl;
+    std::cerr << "  --memo-evict mode   Cache eviction: lru (default) or depth (deepest first)" << endl;
+    std::cerr << "  --output-zdd file   Write the solutions as a zdd over option numbers" << endl;
+    std::cerr << "  --solutions file    Enumerate the solutions to file" << endl;
+    std::cerr << "  --solutions-format f  ndjson (default), binary or delta" << endl;
+    std::cerr << "  --estimate          Estimate the search size with random probes instead" << endl;
+    std::cerr << "  --estimate-time s   Seconds of probes for --estimate (default: 2)" << endl;
+    std::cerr << "  --estimate-time-factor f  Search time per update over that of the" << endl;
+    std::cerr << "                      probes (default: " << SearchEstimatorBase::SEARCH_TIME_FACTOR << ")" << endl;
+    std::cerr << "  --approx s          Count approximately for up to s seconds instead; in" << endl;
+    std::cerr << "                      batch mode, only the instances out of time" << endl;
+    std::cerr << "  --approx-error e    Stop at this relative error (default: 0.01)" << endl;
+    std::cerr << "  --approx-confidence c  Confidence of the error (default: 0.95)" << endl;
+    std::cerr << "  --sample n          Draw n uniform solutions; written to --solutions file" << endl;
+    std::cerr << "                      if given; the counts use the --memo cache (256 MB)" << endl;
+    std::cerr << "  --seed s            Random seed of --sample (default: 1)" << endl;
     std::cerr << "  -h          Show this help message" << endl;
+    std::cerr << "  --cubes file        Cube work file" << endl;
+    std::cerr << "  --split-depth d     Write the frames at depth d as cubes" << endl;
+    std::cerr << "  --split-cubes n     Split at the first depth with at least n cubes" << endl;
+    std::cerr << "  --solve-cubes       Solve unclaimed cubes of the cube file" << endl;
+    std::cerr << "  --cube id           Solve only the given cube (rerun)" << endl;
+    std::cerr << "  --retry-missing     Solve the cubes without a result" << endl;
+    std::cerr << "  --merge-cubes       Sum the cube results and report missing cubes" << endl;
+    std::cerr << "  --results file      Cube results file (default: cube_file.results)" << endl;
     exit(1);
 }
 
@@ -65,8 +618,59 @@ int main(int argc, char** argv) {
     string input_directory;
     string output_file_path = "../../output/zdd_results.csv";
     bool batch_mode = false;
-    
-    while ((opt = getopt(argc, argv, "z:d:o:h")) != -1) {
+    int num_threads = 1;
+    SearchOptions search_options;
+    CubeOptions cube_options;
+    BatchRunner::Config batch_config;
+    Arena::Options arena_options;
+    bool verify_load = false;
+    bool estimate = false;
+    double estimate_time = 2.0;
+    double estimate_time_factor = SearchEstimatorBase::SEARCH_TIME_FACTOR;
+    uint64_t num_samples = 0;
+    uint64_t seed = 1;
+
+    static const struct option long_options[] = {
+        {"cubes", required_argument, nullptr, OPT_CUBES},
+        {"split-depth", required_argument, nullptr, OPT_SPLIT_DEPTH},
+        {"split-cubes", required_argument, nullptr, OPT_SPLIT_CUBES},
+        {"solve-cubes", no_argument, nullptr, OPT_SOLVE_CUBES},
+        {"cube", required_argument, nullptr, OPT_CUBE_ID},
+        {"retry-missing", no_argument, nullptr, OPT_RETRY_MISSING},
+        {"merge-cubes", no_argument, nullptr, OPT_MERGE_CUBES},
+        {"results", required_argument, nullptr, OPT_RESULTS},
+        {"jobs", required_argument, nullptr, OPT_JOBS},
+        {"isolate", required_argument, nullptr, OPT_ISOLATE},
+        {"time-limit", required_argument, nullptr, OPT_TIME_LIMIT},
+        {"mem-limit", required_argument, nullptr, OPT_MEM_LIMIT},
+        {"largest-first", no_argument, nullptr, OPT_LARGEST_FIRST},
+        {"portfolio", required_argument, nullptr, OPT_PORTFOLIO},
+        {"first-solution", no_argument, nullptr, OPT_FIRST_SOLUTION},
+        {"limit", required_argument, nullptr, OPT_LIMIT},
+        {"config", required_argument, nullptr, OPT_CONFIG},
+        {"huge-pages", no_argument, nullptr, OPT_HUGE_PAGES},
+        {"numa-local", no_argument, nullptr, OPT_NUMA_LOCAL},
+        {"verify-load", no_argument, nullptr, OPT_VERIFY_LOAD},
+        {"memo", required_argument, nullptr, OPT_MEMO},
+        {"memo-evict", required_argument, nullptr, OPT_MEMO_EVICT},
+        {"output-zdd", required_argument, nullptr, OPT_OUTPUT_ZDD},
+        {"solutions", required_argument, nullptr, OPT_SOLUTIONS},
+        {"solutions-format", required_argument, nullptr, OPT_SOLUTIONS_FORMAT},
+        {"estimate", no_argument, nullptr, OPT_ESTIMATE},
+        {"estimate-time", required_argument, nullptr, OPT_ESTIMATE_TIME},
+        {"estimate-time-factor", required_argument, nullptr,
+         OPT_ESTIMATE_TIME_FACTOR},
+        {"approx", required_argument, nullptr, OPT_APPROX},
+        {"approx-error", required_argument, nullptr, OPT_APPROX_ERROR},
+        {"approx-confidence", required_argument, nullptr,
+         OPT_APPROX_CONFIDENCE},
+        {"sample", required_argument, nullptr, OPT_SAMPLE},
+        {"seed", required_argument, nullptr, OPT_SEED},
+        {"renumber", no_argument, nullptr, OPT_RENUMBER},
+        {nullptr, 0, nullptr, 0}};
+
+    while ((opt = getopt_long(argc, argv, "z:d:o:j:h", long_options,
+                              nullptr)) != -1) {
         switch (opt) {
             case 'z':
                 zdd_file_name = optarg;
@@ -78,6 +682,159 @@ int main(int argc, char** argv) {
             case 'o':
                 output_file_path = optarg;
                 break;
+            case 'j':
+                num_threads = atoi(optarg);
+                if (num_threads < 1) show_help_and_exit();
+                break;
+            case OPT_CUBES:
+                cube_options.cube_file_name = optarg;
+                break;
+            case OPT_SPLIT_DEPTH:
+                cube_options.split_depth = atoi(optarg);
+                break;
+            case OPT_SPLIT_CUBES:
+                cube_options.split_cubes = atoll(optarg);
+                break;
+            case OPT_SOLVE_CUBES:
+                cube_options.solve = true;
+                break;
+            case OPT_CUBE_ID:
+                cube_options.cube_id = atoll(optarg);
+                break;
+            case OPT_RETRY_MISSING:
+                cube_options.retry_missing = true;
+                break;
+            case OPT_MERGE_CUBES:
+                cube_options.merge = true;
+                break;
+            case OPT_RESULTS:
+                cube_options.results_file_name = optarg;
+                break;
+            case OPT_JOBS:
+                batch_config.num_jobs = atoi(optarg);
+                if (batch_config.num_jobs < 1) show_help_and_exit();
+                break;
+            case OPT_ISOLATE:
+                if (string(optarg) == "fork") {
+                    batch_config.isolation = BatchRunner::Isolation::Fork;
+                } else if (string(optarg) == "thread") {
+                    batch_config.isolation = BatchRunner::Isolation::Thread;
+                } else {
+                    show_help_and_exit();
+                }
+                break;
+            case OPT_TIME_LIMIT:
+                batch_config.time_limit = atol(optarg);
+                break;
+            case OPT_MEM_LIMIT:
+                batch_config.memory_limit_mb = atoll(optarg);
+                break;
+            case OPT_LARGEST_FIRST:
+                batch_config.largest_first = true;
+                break;
+            case OPT_PORTFOLIO:
+                try {
+                    search_options.portfolio = PortfolioBase::parse(optarg);
+                } catch (const std::exception& e) {
+                    cerr << e.what() << endl;
+                    exit(1);
+                }
+                break;
+            case OPT_FIRST_SOLUTION:
+                search_options.solution_limit = 1;
+                break;
+            case OPT_LIMIT:
+                search_options.solution_limit = strtoull(optarg, nullptr, 10);
+                if (search_options.solution_limit == 0) show_help_and_exit();
+                break;
+            case OPT_CONFIG:
+                try {
+                    search_options.config = SearchConfig::parse(optarg);
+                } catch (const std::exception& e) {
+                    cerr << e.what() << endl;
+                    exit(1);
+                }
+                break;
+            case OPT_HUGE_PAGES:
+                arena_options.huge_pages = true;
+                break;
+            case OPT_NUMA_LOCAL:
+                arena_options.numa_local = true;
+                break;
+            case OPT_VERIFY_LOAD:
+                verify_load = true;
+                break;
+            case OPT_RENUMBER:
+                search_options.renumber = true;
+                cube_options.renumber = true;
+                break;
+            case OPT_MEMO:
+                search_options.memo = true;
+                search_options.memo_config.max_bytes =
+                    (size_t)atoll(optarg) << 20;
+                if (search_options.memo_config.max_bytes == 0) {
+                    show_help_and_exit();
+                }
+                break;
+            case OPT_MEMO_EVICT:
+                if (string(optarg) == "lru") {
+                    search_options.memo_config.eviction =
+                        SubproblemCache::Eviction::Lru;
+                } else if (string(optarg) == "depth") {
+                    search_options.memo_config.eviction =
+                        SubproblemCache::Eviction::Depth;
+                } else {
+                    show_help_and_exit();
+                }
+                break;
+            case OPT_OUTPUT_ZDD:
+                search_options.output_zdd_file = optarg;
+                break;
+            case OPT_SOLUTIONS:
+                search_options.solutions_file = optarg;
+                break;
+            case OPT_SOLUTIONS_FORMAT:
+                try {
+                    search_options.solutions_format =
+                        SolutionWriter::parse_format(optarg);
+                } catch (const std::exception& e) {
+                    cerr << e.what() << endl;
+                    exit(1);
+                }
+                break;
+            case OPT_ESTIMATE:
+                estimate = true;
+                break;
+            case OPT_ESTIMATE_TIME:
+                estimate_time = atof(optarg);
+                if (!(estimate_time > 0)) show_help_and_exit();
+                break;
+            case OPT_ESTIMATE_TIME_FACTOR:
+                estimate_time_factor = atof(optarg);
+                if (!(estimate_time_factor > 0)) show_help_and_exit();
+                break;
+            case OPT_APPROX:
+                search_options.approx_time = atof(optarg);
+                if (!(search_options.approx_time > 0)) show_help_and_exit();
+                break;
+            case OPT_APPROX_ERROR:
+                search_options.approx_error = atof(optarg);
+                if (!(search_options.approx_error > 0)) show_help_and_exit();
+                break;
+            case OPT_APPROX_CONFIDENCE:
+                search_options.approx_confidence = atof(optarg);
+                if (!(search_options.approx_confidence > 0 &&
+                      search_options.approx_confidence < 1)) {
+                    show_help_and_exit();
+                }
+                break;
+            case OPT_SAMPLE:
+                num_samples = strtoull(optarg, nullptr, 10);
+                if (num_samples == 0) show_help_and_exit();
+                break;
+            case OPT_SEED:
+                seed = strtoull(optarg, nullptr, 10);
+                break;
             case 'h':
                 show_help_and_exit();
                 break;
@@ -86,6 +843,67 @@ int main(int argc, char** argv) {
         }
     }
 
+    search_options.num_threads = num_threads;
+    const bool limited = search_options.solution_limit != UINT64_MAX;
+    if (num_threads > 1 && (!search_options.portfolio.empty() || limited)) {
+        cerr << "--portfolio and --limit run with -j 1" << endl;
+        exit(1);
+    }
+    if (search_options.memo &&
+        (num_threads > 1 || !search_options.portfolio.empty() ||
+         limited)) {
+        cerr << "--memo counts with -j 1, without --portfolio and --limit"
+             << endl;
+        exit(1);
+    }
+    if (!search_options.output_zdd_file.empty() &&
+        (num_threads > 1 || !search_options.portfolio.empty() ||
+         limited || batch_mode)) {
+        cerr << "--output-zdd runs on a single file with -j 1, without "
+                "--portfolio and --limit"
+             << endl;
+        exit(1);
+    }
+    if (num_samples > 0 &&
+        (num_threads > 1 || !search_options.portfolio.empty() || limited ||
+         !search_options.output_zdd_file.empty() || batch_mode || estimate ||
+         search_options.approx_time > 0)) {
+        cerr << "--sample runs on a single file with -j 1, without "
+                "--portfolio, --limit, --output-zdd, --estimate and --approx"
+             << endl;
+        exit(1);
+    }
+    if (!search_options.solutions_file.empty() && num_samples == 0 &&
+        (num_threads > 1 || !search_options.portfolio.empty() ||
+         search_options.memo || !search_options.output_zdd_file.empty() ||
+         batch_mode)) {
+        cerr << "--solutions runs on a single file with -j 1, without "
+                "--portfolio, --memo and --output-zdd"
+             << endl;
+        exit(1);
+    }
+
+    if (estimate && (batch_mode || zdd_file_name.empty() ||
+                     search_options.approx_time > 0)) {
+        cerr << "--estimate runs on a single file (-z), without --approx"
+             << endl;
+        exit(1);
+    }
+
+    if (!cube_options.cube_file_name.empty()) {
+        if (!cube_options.solve && !cube_options.merge &&
+            cube_options.split_depth < 0 && cube_options.split_cubes == 0) {
+            show_help_and_exit();
+        }
+        try {
+            Arena arena(arena_options);
+            return run_cube_mode(zdd_file_name, cube_options, arena);
+        } catch (const std::exception& e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+    }
+
     if (batch_mode && !input_directory.empty()) {
         // 批量处理模式
         cout << "=== ZDD Batch Processing ===" << endl;
@@ -103,84 +921,148 @@ int main(int argc, char** argv) {
 
         // 创建输出文件
         ofstream output_file(output_file_path);
-        output_file << "Filename,Nodes,sols,Updates,Time(s),Status" << endl;
+        output_file << "Filename,Nodes,sols,Updates,Time(s),Status"
+                    << (search_options.portfolio.empty() ? "" : ",Config")
+                    << (limited ? ",FirstSolution(s)" : "")
+                    << (search_options.approx_time > 0
+                            ? ",ApproxSols,ApproxLow,ApproxHigh"
+                            : "")
+                    << endl;
 
         if (!output_file.is_open()) {
             cerr << "Error: Cannot create output file: " << output_file_path << endl;
             exit(1);
         }
 
-        for (const auto& entry : fs::directory_iterator(input_directory)) {
-            if (entry.is_regular_file()) {
-                string file_name = entry.path().stem().string();
-                output_file << file_name << ",";
-
-                try {
-
-                    int num_var = get_num_vars_from_zdd_file(entry.path().string());
-                    ZddWithLinks zdd_with_links(num_var, false);
-                    zdd_with_links.load_zdd_from_file(entry.path().string());
-        
-                    if (zdd_with_links.sanity()) {
-                        fprintf(stderr, "initial zdd is invalid\n");
-                        exit(1);
-                    }
-                    cout << "load file: " << file_name << " done" << endl;
-
-                    vector<vector<uint16_t>> solution;
-                    auto start_time = std::chrono::high_resolution_clock::now();
-                    zdd_with_links.stopwatch.markStartTime();
-                    zdd_with_links.search(solution, 0);
-                    auto end_time = std::chrono::high_resolution_clock::now();
-
-                    printf("num_nodes: %llu, sols: %llu, num_updates: %llu, time: %.4fs\n", zdd_with_links.num_search_tree_nodes,
-                            zdd_with_links.num_solutions, zdd_with_links.num_updates,
-                            std::chrono::duration_cast<std::chrono::duration<double>>(end_time - start_time).count()
-                    );
-
-                    output_file << zdd_with_links.num_search_tree_nodes << ","
-                                << zdd_with_links.num_solutions << ","
-                                << zdd_with_links.num_updates << ","
-                                << std::chrono::duration_cast<std::chrono::duration<double>>(end_time - start_time).count() << ","
-                                << "SUCCESS\n";
-                    output_file.flush();
-
-                } catch (const std::runtime_error& e) {
-                    output_file  << "-,"
-                                << "-,"
-                                << "-,"
-                                << "-,"
-                                << "FAILED\n";
-                    output_file.flush();
+        batch_config.num_search_threads =
+            search_options.portfolio.empty() ? num_threads
+                                             : search_options.portfolio.size();
+        batch_config.report_config = !search_options.portfolio.empty();
+        batch_config.report_first_solution = limited;
+        batch_config.approx_time = search_options.approx_time;
+        // a forked child gets a copy of the arena of the parent and exits
+        // after one instance, so with Isolation::Fork the chunks it maps are
+        // not reused by the next instance. Threads keep one arena each, which
+        // solve_instance() resets for every file.
+        Arena fork_arena(arena_options);
+        const bool forked =
+            batch_config.isolation == BatchRunner::Isolation::Fork;
+        BatchRunner batch_runner(
+            batch_config,
+            [&search_options, &arena_options, &fork_arena, forked](
+                const string& file_name, long time_limit) {
+                if (forked) {
+                    return solve_instance(file_name, time_limit,
+                                          search_options, fork_arena);
                 }
-                cout << file_name << " done." << endl;
-                cout << endl;
-            }
-        }
+                thread_local Arena arena(arena_options);
+                return solve_instance(file_name, time_limit, search_options,
+                                      arena);
+            });
+        batch_runner.run(input_directory, output_file);
         output_file.close();
         cout << "All Done." << endl;
     } else if (!zdd_file_name.empty()) {
         // 单文件处理模式（保持原有功能）
-        int num_var = get_num_vars_from_zdd_file(zdd_file_name);
-        ZddWithLinks zdd_with_links(num_var, false);
-        zdd_with_links.load_zdd_from_file(zdd_file_name);
-        
-        if (zdd_with_links.sanity()) {
-            fprintf(stderr, "initial zdd is invalid\n");
+        auto load_start = std::chrono::high_resolution_clock::now();
+        ZddFile file;
+        try {
+            file = read_zdd_file(zdd_file_name, num_threads);
+        } catch (const std::exception& e) {
+            cerr << e.what() << endl;
             exit(1);
         }
+        const auto run_file = [&](auto layout) {
+            using L = decltype(layout);
+            Arena arena(arena_options);
+            unique_ptr<ZddWithLinks<L>> zdd_ptr;
+            try {
+                zdd_ptr = load_zdd<L>(file, arena, num_threads,
+                                      search_options.renumber);
+                fprintf(
+                    stderr, "load time: %.4f s\n",
+                    std::chrono::duration_cast<std::chrono::duration<double>>(
+                        std::chrono::high_resolution_clock::now() -
+                        load_start)
+                        .count());
+                print_layout<L>();
+                if (verify_load) {
+                    Arena serial_arena(arena_options);
+                    // no loader: load_zdd_from_file reads the file.
+                    ZddFile serial_file;
+                    serial_file.name = file.name;
+                    serial_file.num_vars = file.num_vars;
+                    if (!(*load_zdd<L>(serial_file, serial_arena, 1,
+                                       search_options.renumber) == *zdd_ptr)) {
+                        cerr << "parallel load differs from the serial load"
+                             << endl;
+                        exit(1);
+                    }
+                    fprintf(stderr, "load verified\n");
+                }
+            } catch (const std::exception& e) {
+                cerr << e.what() << endl;
+                exit(1);
+            }
+            ZddWithLinks<L>& zdd_with_links = *zdd_ptr;
         
-        fprintf(stderr, "load files done\n");
-        vector<vector<uint16_t>> solution;
-        auto start_time = std::chrono::high_resolution_clock::now();
-        zdd_with_links.search(solution, 0);
-        auto end_time = std::chrono::high_resolution_clock::now();
+            fprintf(stderr, "load files done\n");
+            if (estimate) {
+                zdd_with_links.set_search_config(search_options.config);
+                print_estimate(
+                    SearchEstimator<L>(zdd_with_links)
+                        .run(estimate_time, estimate_time_factor));
+                return 0;
+            }
+            if (num_samples > 0) {
+                try {
+                    run_sampler(zdd_with_links, search_options, num_samples,
+                                seed);
+                } catch (const std::exception& e) {
+                    cerr << e.what() << endl;
+                    exit(1);
+                }
+                return 0;
+            }
+            if (search_options.approx_time > 0) {
+                print_approximate_count(
+                    approximate_count(zdd_with_links, search_options),
+                    search_options.approx_confidence);
+                return 0;
+            }
+            auto start_time = std::chrono::high_resolution_clock::now();
+            string config;
+            try {
+                config = run_search(zdd_with_links, search_options);
+            } catch (const std::exception& e) {
+                cerr << e.what() << endl;
+                exit(1);
+            }
+            auto end_time = std::chrono::high_resolution_clock::now();
         
-        printf("Solutions: %llu, Time: %.4f s\n", 
-               zdd_with_links.num_solutions, 
-               std::chrono::duration_cast<std::chrono::duration<double>>(end_time - start_time).count()
-            );
-                   
+            printf("Solutions: %s, Time: %.4f s\n", 
+                   count_to_string(zdd_with_links.num_solutions).c_str(), 
+                   std::chrono::duration_cast<std::chrono::duration<double>>(end_time - start_time).count()
+                );
+            if (!search_options.portfolio.empty()) {
+                printf("Config: %s\n", config.c_str());
+            }
+            if (zdd_with_links.first_solution_time() >= 0) {
+                printf("First solution: %.4f s\n",
+                       zdd_with_links.first_solution_time());
+            }
+            const auto& solutions = zdd_with_links.found_solutions();
+            for (size_t i = 0; i < solutions.size(); i++) {
+                print_solution("Solution", i + 1, solutions[i]);
+            }
+            return 0;
+        };
+        try {
+            return with_layout(file, run_file);
+        } catch (const std::exception& e) {
+            cerr << e.what() << endl;
+            exit(1);
+        }
     } else {
         show_help_and_exit();
     }
@@ -0,0 +1,189 @@
+#include "output_zdd.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "dancing_on_zdd.h"
+
+using namespace std;
+
+template <typename L>
+OptionIndex::OptionIndex(const pmr::vector<Node<L>> &table)
+    : nodes_() {
+    nodes_.reserve(table.size());
+    // children are stored before their parents.
+    for (const auto &node : table) {
+        RankNode rank_node{node.hi, node.lo, node.var, 0};
+        if (__builtin_add_overflow(num_paths(node.lo), num_paths(node.hi),
+                                   &rank_node.num_paths)) {
+            throw std::overflow_error("too many options to number");
+        }
+        nodes_.push_back(rank_node);
+    }
+}
+
+#define INSTANTIATE(L)            \
+    template OptionIndex::OptionIndex( \
+        const pmr::vector<ZddWithLinks<L>::Node> &);
+FOR_EACH_LAYOUT(INSTANTIATE)
+#undef INSTANTIATE
+
+uint64_t OptionIndex::num_paths(int64_t node_id) const {
+    if (node_id == DD_ONE_TERM) return 1;
+    if (node_id < 0) return 0;
+    return nodes_[node_id].num_paths;
+}
+
+uint64_t OptionIndex::num_options() const {
+    return nodes_.empty() ? 0 : nodes_.back().num_paths;
+}
+
+template <typename Column>
+uint64_t OptionIndex::rank(const vector<Column> &option) const {
+    uint64_t r = 0;
+    auto col = option.cbegin();
+    int64_t node_id = nodes_.size() - 1;  // the root
+    while (node_id >= 0) {
+        const RankNode &node = nodes_[node_id];
+        if (col != option.cend() && *col == node.var) {
+            node_id = node.hi;
+            ++col;
+        } else {
+            r += num_paths(node.hi);  // the options taking the hi branch
+            node_id = node.lo;
+        }
+    }
+    assert(node_id == DD_ONE_TERM && col == option.cend());
+    return r;
+}
+
+template uint64_t OptionIndex::rank(const vector<uint16_t> &) const;
+template uint64_t OptionIndex::rank(const vector<uint32_t> &) const;
+
+OutputZdd::OutputZdd()
+    : nodes_(2, ZNode{UINT64_MAX, ZERO, ZERO}),
+      unique_(),
+      change_cache_(),
+      union_cache_(),
+      count_cache_() {}
+
+OutputZdd::node_t OutputZdd::make(uint64_t var, node_t lo, node_t hi) {
+    if (hi == ZERO) return lo;  // zero-suppression
+    assert(var < top(lo) && var < top(hi));
+    auto inserted = unique_.emplace(ZNodeKey{var, lo, hi}, nodes_.size());
+    if (inserted.second) {
+        nodes_.push_back({var, lo, hi});
+    }
+    return inserted.first->second;
+}
+
+OutputZdd::node_t OutputZdd::change(node_t f, uint64_t var) {
+    if (f == ZERO) return ZERO;
+    const uint64_t v = top(f);
+    if (var < v) return make(var, ZERO, f);
+    if (var == v) {
+        throw std::logic_error("option already in the family");
+    }
+
+    const auto key = make_pair(f, var);
+    auto it = change_cache_.find(key);
+    if (it != change_cache_.end()) return it->second;
+
+    const ZNode node = nodes_[f];
+    const node_t lo = change(node.lo, var);
+    const node_t hi = change(node.hi, var);
+    const node_t r = make(v, lo, hi);
+    if (change_cache_.size() >= MAX_CACHE_ENTRIES) change_cache_.clear();
+    change_cache_.emplace(key, r);
+    return r;
+}
+
+OutputZdd::node_t OutputZdd::unite(node_t f, node_t g) {
+    if (f == ZERO || f == g) return g;
+    if (g == ZERO) return f;
+    if (f > g) std::swap(f, g);
+
+    const auto key = make_pair(f, (uint64_t)g);
+    auto it = union_cache_.find(key);
+    if (it != union_cache_.end()) return it->second;
+
+    const uint64_t vf = top(f), vg = top(g);
+    node_t r;
+    if (vf < vg) {
+        const ZNode node = nodes_[f];
+        r = make(vf, unite(node.lo, g), node.hi);
+    } else if (vg < vf) {
+        const ZNode node = nodes_[g];
+        r = make(vg, unite(f, node.lo), node.hi);
+    } else {
+        const ZNode nf = nodes_[f], ng = nodes_[g];
+        const node_t lo = unite(nf.lo, ng.lo);
+        const node_t hi = unite(nf.hi, ng.hi);
+        r = make(vf, lo, hi);
+    }
+    if (union_cache_.size() >= MAX_CACHE_ENTRIES) union_cache_.clear();
+    union_cache_.emplace(key, r);
+    return r;
+}
+
+count128_t OutputZdd::count(node_t f) const {
+    // children have smaller ids than their parents. A saturated count is
+    // only computed again.
+    count_cache_.resize(nodes_.size(), COUNT128_MAX);
+    count_cache_[ZERO] = 0;
+    count_cache_[ONE] = 1;
+    for (node_t i = 2; i <= f; i++) {
+        if (count_cache_[i] == COUNT128_MAX) {
+            count_cache_[i] = saturating_add(count_cache_[nodes_[i].lo],
+                                             count_cache_[nodes_[i].hi]);
+        }
+    }
+    return count_cache_[f];
+}
+
+size_t OutputZdd::size(node_t f) const {
+    vector<char> reached(f + 1, 0);
+    if (f > ONE) reached[f] = 1;
+    size_t n = 0;
+    for (node_t i = f; i > ONE; i--) {
+        if (!reached[i]) continue;
+        n++;
+        reached[nodes_[i].lo] = 1;
+        reached[nodes_[i].hi] = 1;
+    }
+    return n;
+}
+
+void OutputZdd::write(ostream &os, node_t f) const {
+    if (f <= ONE) {
+        os << (f == ONE ? "T" : "B") << "\n.\n";
+        return;
+    }
+    vector<char> reached(f + 1, 0);
+    reached[f] = 1;
+    vector<uint64_t> vars;
+    for (node_t i = f; i > ONE; i--) {
+        if (!reached[i]) continue;
+        reached[nodes_[i].lo] = 1;
+        reached[nodes_[i].hi] = 1;
+        vars.push_back(nodes_[i].var);
+    }
+    // dense variables in the order of the options keep the zdd ordered.
+    sort(vars.begin(), vars.end());
+    vars.erase(unique(vars.begin(), vars.end()), vars.end());
+    for (size_t k = 0; k < vars.size(); k++) {
+        os << "# " << k + 1 << " " << vars[k] - 1 << "\n";
+    }
+    auto dense = [&vars](uint64_t var) {
+        return lower_bound(vars.cbegin(), vars.cend(), var) - vars.cbegin() + 1;
+    };
+    auto child = [](node_t c) -> string {
+        return c == ZERO ? "B" : c == ONE ? "T" : to_string(c);
+    };
+    for (node_t i = 2; i <= f; i++) {
+        if (!reached[i]) continue;
+        os << i << " " << dense(nodes_[i].var) << " " << child(nodes_[i].lo)
+           << " " << child(nodes_[i].hi) << "\n";
+    }
+    os << ".\n";
+}
@@ -0,0 +1,139 @@
+#ifndef OUTPUT_ZDD_H_
+#define OUTPUT_ZDD_H_
+
+#include <cstdint>
+#include <memory_resource>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include "count_types.h"
+
+template <typename L>
+struct Node;
+
+/**
+ * Numbers the options of an input zdd.
+ *  Option k (0-based) is the k-th 1-path of the zdd at rest, hi branches
+ *  before lo branches, which sorts the options lexicographically by their
+ *  columns. A snapshot of the nodes is taken at construction, so ranks can
+ *  be computed while the dancing links are modified by a search.
+ */
+class OptionIndex {
+   public:
+    // throws std::overflow_error if the zdd has 2^64 options or more.
+    template <typename L>
+    explicit OptionIndex(const std::pmr::vector<Node<L>> &table);
+
+    // rank of option, a sorted list of columns that is a path of the zdd.
+    template <typename Column>
+    uint64_t rank(const std::vector<Column> &option) const;
+
+    uint64_t num_options() const;
+
+   private:
+    struct RankNode {
+        int64_t hi;  // node ids of any layout
+        int64_t lo;
+        uint32_t var;
+        uint64_t num_paths;  // 1-paths below this node
+    };
+
+    uint64_t num_paths(int64_t node_id) const;
+
+    std::vector<RankNode> nodes_;
+};
+
+/**
+ * A zdd over option numbers holding a family of solutions.
+ *  Nodes are hash-consed in a unique table, so equal subfamilies share one
+ *  node and the size follows the shared structure, not the number of
+ *  solutions. Variable v stands for option v - 1 of an OptionIndex; smaller
+ *  variables are closer to the root, as in the files read by
+ *  ZddWithLinks::load_zdd_from_file.
+ */
+class OutputZdd {
+   public:
+    using node_t = int64_t;
+    static constexpr node_t ZERO = 0;  // the empty family
+    static constexpr node_t ONE = 1;   // the family {{}}
+
+    OutputZdd();
+    OutputZdd(const OutputZdd &obj) = delete;
+
+    // the family {s + {var} | s in f}, for a var in no set of f.
+    node_t change(node_t f, uint64_t var);
+
+    // the union of f and g.
+    node_t unite(node_t f, node_t g);
+
+    // number of sets in f; COUNT128_MAX if more.
+    count128_t count(node_t f) const;
+
+    // nodes in the unique table, terminals excluded.
+    size_t size() const { return nodes_.size() - 2; }
+
+    // nodes reachable from f, terminals excluded.
+    size_t size(node_t f) const;
+
+    /**
+     * writes f in the Graphillion text format: one "id var lo hi" line per
+     * node, children first, then ".". The variables of the nodes are
+     * renumbered to 1..n in their order, so the file loads like any input
+     * zdd; it starts with one "# var option" comment line per variable
+     * mapping it back to its option.
+     */
+    void write(std::ostream &os, node_t f) const;
+
+   private:
+    struct ZNode {
+        uint64_t var;
+        node_t lo;
+        node_t hi;
+    };
+
+    struct PairHash {
+        size_t operator()(const std::pair<node_t, uint64_t> &p) const noexcept {
+            return std::hash<uint64_t>()(p.first * 0x9e3779b97f4a7c15ULL ^
+                                         p.second);
+        }
+    };
+
+    struct ZNodeKey {
+        uint64_t var;
+        node_t lo;
+        node_t hi;
+        bool operator==(const ZNodeKey &o) const {
+            return var == o.var && lo == o.lo && hi == o.hi;
+        }
+    };
+
+    struct ZNodeHash {
+        size_t operator()(const ZNodeKey &k) const noexcept {
+            uint64_t h = k.var * 0x9e3779b97f4a7c15ULL;
+            h ^= k.lo + 0xbf58476d1ce4e5b9ULL + (h << 6) + (h >> 2);
+            h ^= k.hi + 0x94d049bb133111ebULL + (h << 6) + (h >> 2);
+            return h;
+        }
+    };
+
+    // the reduced node (var, lo, hi) from the unique table.
+    node_t make(uint64_t var, node_t lo, node_t hi);
+
+    uint64_t top(node_t f) const {
+        return f <= ONE ? UINT64_MAX : nodes_[f].var;
+    }
+
+    // operation caches are dropped when they grow beyond this.
+    static constexpr size_t MAX_CACHE_ENTRIES = 1UL << 22;
+
+    std::vector<ZNode> nodes_;
+    std::unordered_map<ZNodeKey, node_t, ZNodeHash> unique_;
+    std::unordered_map<std::pair<node_t, uint64_t>, node_t, PairHash>
+        change_cache_;
+    std::unordered_map<std::pair<node_t, uint64_t>, node_t, PairHash>
+        union_cache_;
+    mutable std::vector<count128_t> count_cache_;
+};
+
+#endif  // OUTPUT_ZDD_H_
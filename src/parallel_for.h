@@ -0,0 +1,39 @@
+#ifndef PARALLEL_FOR_H_
+#define PARALLEL_FOR_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// ranges shorter than this are not worth a thread.
+constexpr size_t PARALLEL_FOR_GRAIN = 4096;
+
+/**
+ * Calls f(lo, hi) on consecutive subranges of [begin, end), one per thread.
+ *  Runs f(begin, end) in the calling thread if num_threads <= 1 or the range
+ *  is short. f must not throw.
+ */
+template <class F>
+void parallel_for(size_t begin, size_t end, int num_threads, F &&f) {
+    const size_t n = end > begin ? end - begin : 0;
+    const size_t max_threads = std::max<size_t>(n / PARALLEL_FOR_GRAIN, 1);
+    const size_t num_parts =
+        std::min<size_t>(std::max(num_threads, 1), max_threads);
+    if (num_parts <= 1) {
+        if (n > 0) f(begin, end);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < num_parts; t++) {
+        threads.emplace_back(f, begin + n * t / num_parts,
+                             begin + n * (t + 1) / num_parts);
+    }
+    f(begin, begin + n / num_parts);
+    for (auto &th : threads) {
+        th.join();
+    }
+}
+
+#endif  // PARALLEL_FOR_H_
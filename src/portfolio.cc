@@ -0,0 +1,124 @@
+#include "portfolio.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+#include "dp_manager.h"
+
+using namespace std;
+
+// configurations picked by a numeric portfolio spec, in this order.
+static const char *const DEFAULT_CONFIGS[] = {
+    "first-down-asc",  "last-down-asc",    "first-up-asc",
+    "first-down-desc", "random1-down-asc", "random2-up-desc",
+    "last-up-desc",    "random3-down-desc", "first-count-look",
+    "first-count-asc",
+};
+
+template <typename L>
+Portfolio<L>::Portfolio(ZddWithLinks<L> &master,
+                        const vector<SearchConfig> &configs,
+                        uint64_t solution_limit)
+    : master_(master),
+      configs_(configs),
+      solution_limit_(solution_limit),
+      arenas_(configs.size()),
+      replicas_(configs.size()),
+      cancelled_(false),
+      winner_(-1),
+      errors_(configs.size()) {
+    if (configs_.empty()) {
+        throw std::invalid_argument("empty portfolio");
+    }
+}
+
+template <typename L>
+void Portfolio<L>::run() {
+    cancelled_ = false;
+    winner_ = -1;
+
+    vector<thread> threads;
+    for (size_t i = 0; i < configs_.size(); i++) {
+        threads.emplace_back(&Portfolio::run_config, this, (int)i);
+    }
+    for (auto &th : threads) {
+        th.join();
+    }
+
+    if (winner_ < 0) {
+        throw std::runtime_error(errors_[0]);
+    }
+    const ZddWithLinks<L> &zdd = *replicas_[winner_];
+    master_.num_search_tree_nodes += zdd.num_search_tree_nodes;
+    master_.num_solutions += zdd.num_solutions;
+    master_.num_updates += zdd.num_updates;
+    master_.num_head_updates += zdd.num_head_updates;
+    master_.num_inactive_updates += zdd.num_inactive_updates;
+    master_.num_hides += zdd.num_hides;
+    master_.num_failure_backtracks += zdd.num_failure_backtracks;
+    master_.first_solution_time_ = zdd.first_solution_time_;
+    master_.found_solutions_ = zdd.found_solutions_;
+}
+
+template <typename L>
+void Portfolio<L>::run_config(int index) {
+    try {
+        pmr::memory_resource *resource = pmr::get_default_resource();
+        if (auto arena = dynamic_cast<const Arena *>(master_.resource())) {
+            arenas_[index] = make_unique<Arena>(arena->options());
+            resource = arenas_[index].get();
+        }
+        replicas_[index] = make_unique<ZddWithLinks<L>>(master_, resource);
+        ZddWithLinks<L> &zdd = *replicas_[index];
+        zdd.set_search_config(configs_[index]);
+        zdd.set_cancel_flag(&cancelled_);
+        zdd.stopwatch.setTimeBound(master_.stopwatch.getTimeBound());
+        if (master_.stopwatch.isRunning()) {
+            zdd.stopwatch.markStartTime();
+        }
+        zdd.set_solution_limit(solution_limit_);
+
+        typename ZddWithLinks<L>::Solution solution;
+        zdd.search(solution, 0);
+    } catch (const std::exception &e) {
+        // a cancelled loser or a failed configuration; each thread only
+        // writes its own slot.
+        errors_[index] = e.what();
+        return;
+    }
+    int none = -1;
+    if (winner_.compare_exchange_strong(none, index)) {
+        cancelled_ = true;
+    }
+}
+
+vector<SearchConfig> PortfolioBase::parse(const string &spec) {
+    vector<SearchConfig> configs;
+    if (!spec.empty() && all_of(spec.begin(), spec.end(), ::isdigit)) {
+        const size_t num_defaults =
+            sizeof(DEFAULT_CONFIGS) / sizeof(DEFAULT_CONFIGS[0]);
+        const size_t k = stoul(spec);
+        if (k < 1 || k > num_defaults) {
+            throw std::invalid_argument("portfolio size must be 1.." +
+                                        to_string(num_defaults));
+        }
+        for (size_t i = 0; i < k; i++) {
+            configs.push_back(SearchConfig::parse(DEFAULT_CONFIGS[i]));
+        }
+        return configs;
+    }
+
+    istringstream iss(spec);
+    string name;
+    while (getline(iss, name, ',')) {
+        configs.push_back(SearchConfig::parse(name));
+    }
+    if (configs.empty()) {
+        throw std::invalid_argument("empty portfolio");
+    }
+    return configs;
+}
+
+#define INSTANTIATE(L) template class Portfolio<L>;
+FOR_EACH_LAYOUT(INSTANTIATE)
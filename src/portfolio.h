@@ -0,0 +1,63 @@
+#ifndef PORTFOLIO_H_
+#define PORTFOLIO_H_
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "arena.h"
+#include "dancing_on_zdd.h"
+
+/**
+ * Portfolio specs, common to the layouts.
+ */
+class PortfolioBase {
+   public:
+    /**
+     * Parses a portfolio spec: either a number k, selecting the first k
+     * default configurations, or a comma separated list of configuration
+     * names. Throws std::invalid_argument for a malformed spec.
+     */
+    static vector<SearchConfig> parse(const string &spec);
+};
+
+/**
+ * Races several search configurations on one instance.
+ *  Every configuration runs on its own replica of the master in its own
+ *  thread. The first replica to finish its search (or, with a solution
+ *  limit, to find that many solutions or prove there are fewer) wins: it
+ *  cancels the others and its counters and solutions are copied to the
+ *  master. Replicas are built in
+ *  their own threads, in arenas of their own if the master uses an Arena.
+ */
+template <typename L>
+class Portfolio : public PortfolioBase {
+   public:
+    Portfolio(ZddWithLinks<L> &master, const vector<SearchConfig> &configs,
+              uint64_t solution_limit = UINT64_MAX);
+    Portfolio(const Portfolio &obj) = delete;
+
+    /**
+     * Runs the race. Throws std::runtime_error if no configuration finished,
+     * e.g. when all of them exceeded the time limit.
+     */
+    void run();
+
+    // configuration of the winner, valid after run().
+    const SearchConfig &winner() const { return configs_[winner_]; }
+
+   private:
+    void run_config(int index);
+
+    ZddWithLinks<L> &master_;
+    const vector<SearchConfig> configs_;
+    const uint64_t solution_limit_;
+    vector<unique_ptr<Arena>> arenas_;
+    vector<unique_ptr<ZddWithLinks<L>>> replicas_;
+    std::atomic<bool> cancelled_;
+    std::atomic<int> winner_;
+    vector<string> errors_;
+};
+
+#endif  // PORTFOLIO_H_
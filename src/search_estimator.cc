@@ -0,0 +1,564 @@
+#include "search_estimator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+
+template <typename L>
+SearchEstimator<L>::SearchEstimator(ZddWithLinks<L> &zdd, uint64_t seed)
+    : zdd_(zdd),
+      rng_(seed),
+      levels_(),
+      upper_buf_(),
+      lower_buf_(),
+      solution_(),
+      root_exact_(false),
+      learning_(false),
+      score_sum_(),
+      score_n_(),
+      branches_(),
+      saved_solutions_(0),
+      saved_counters_() {}
+
+template <typename L>
+SearchEstimatorBase::Result SearchEstimator<L>::run(double time_budget,
+                                                    double time_factor,
+                                                    uint64_t max_probes) {
+    save_counters();
+    const uint64_t updates_before = zdd_.num_updates;
+
+    GroupedMoments nodes, updates, solutions;
+    const auto start = chrono::steady_clock::now();
+    double elapsed = 0.0;
+    while (nodes.n < max_probes &&
+           (nodes.n < MIN_PROBES || elapsed < time_budget)) {
+        const Sample sample = probe();
+        nodes.add(sample.num_nodes);
+        updates.add(sample.num_updates);
+        solutions.add(sample.num_solutions);
+        elapsed = chrono::duration<double>(chrono::steady_clock::now() - start)
+                      .count();
+    }
+    const uint64_t probe_updates = zdd_.num_updates - updates_before;
+    restore_counters();
+
+    Result result;
+    result.num_probes = nodes.n;
+    result.num_nodes = group_range(nodes);
+    result.num_updates = group_range(updates);
+    result.num_solutions = group_range(solutions);
+    result.seconds_per_update =
+        probe_updates > 0 ? time_factor * elapsed / probe_updates : 0.0;
+    result.seconds.mean =
+        result.num_updates.mean * result.seconds_per_update;
+    result.seconds.low = result.num_updates.low * result.seconds_per_update;
+    result.seconds.high = result.num_updates.high * result.seconds_per_update;
+    return result;
+}
+
+template <typename L>
+SearchEstimatorBase::Sample SearchEstimator<L>::probe() {
+    Sample sample{0.0, 0.0, 0.0};
+    double weight = 1.0;
+    int num_levels = 0;
+
+    for (int depth = 0;; depth++) {
+        sample.num_nodes += weight;
+        if (zdd_.header_[0].right == 0) {  // all columns are covered
+            sample.num_solutions += weight;
+            break;
+        }
+        int remain_cols;
+        const int column = zdd_.choose_column(remain_cols);
+        if (column < 0) break;  // failure backtrack
+
+        if (remain_cols <= 2) {
+            // closed form of the search, measured on cleared counters.
+            const uint64_t nodes = zdd_.num_search_tree_nodes;
+            const count128_t sols = zdd_.num_solutions;
+            const uint64_t updates = zdd_.num_updates;
+            zdd_.count_leaf_solutions(solution_, depth, column, remain_cols);
+            sample.num_nodes += weight * (zdd_.num_search_tree_nodes - nodes);
+            sample.num_solutions += weight * (zdd_.num_solutions - sols);
+            sample.num_updates += weight * (zdd_.num_updates - updates);
+            break;
+        }
+
+        Level &level = level_at(depth);
+        level.weight = weight;
+        uint64_t updates = zdd_.num_updates;
+        level.column.assign(1, (column_t)column);
+        zdd_.batch_cover(level.column.cbegin(), level.column.cend());
+        level.column_updates = zdd_.num_updates - updates;
+
+        level.num_options = draw_option(column, level);
+        updates = zdd_.num_updates;
+        zdd_.batch_cover(level.upper.cbegin(), level.upper.cend());
+        level.option_updates =
+            (double)(zdd_.num_updates - updates) / level.upper_share;
+        for (size_t i = 0; i < level.segments.size(); i++) {
+            updates = zdd_.num_updates;
+            zdd_.batch_cover(level.segments[i].cbegin(),
+                             level.segments[i].cend());
+            level.option_updates += (double)(zdd_.num_updates - updates) /
+                                    level.segment_shares[i];
+        }
+
+        weight *= level.num_options;
+        num_levels++;
+    }
+
+    for (int depth = num_levels - 1; depth >= 0; depth--) {
+        Level &level = levels_[depth];
+        uint64_t updates;
+        for (size_t i = level.segments.size(); i-- > 0;) {
+            updates = zdd_.num_updates;
+            zdd_.batch_uncover(level.segments[i].cbegin(),
+                               level.segments[i].cend());
+            level.option_updates += (double)(zdd_.num_updates - updates) /
+                                    level.segment_shares[i];
+        }
+        updates = zdd_.num_updates;
+        zdd_.batch_uncover(level.upper.cbegin(), level.upper.cend());
+        level.option_updates +=
+            (double)(zdd_.num_updates - updates) / level.upper_share;
+        updates = zdd_.num_updates;
+        zdd_.batch_uncover(level.column.cbegin(), level.column.cend());
+        level.column_updates += zdd_.num_updates - updates;
+
+        // the shares of a uniformly drawn option, times the number of
+        // options, estimate the updates of all of them.
+        sample.num_updates +=
+            level.weight * (level.column_updates +
+                            level.num_options * level.option_updates);
+    }
+    return sample;
+}
+
+template <typename L>
+typename SearchEstimator<L>::count_t SearchEstimator<L>::draw_option(
+    int column, Level &level) {
+    const auto &table = zdd_.table_;
+    count_t num_options = 0;
+    for (node_t node_id = zdd_.header_[column].down; node_id >= 0;
+         node_id = table[node_id].down) {
+        num_options += table[node_id].count_upper * table[node_id].count_hi;
+    }
+
+    // the node, then the upper choice, then a lower path.
+    count_t r = random_below(num_options);
+    node_t node_id = zdd_.header_[column].down;
+    for (;;) {
+        const count_t n = table[node_id].count_upper * table[node_id].count_hi;
+        if (r < n) break;
+        r -= n;
+        node_id = table[node_id].down;
+    }
+    draw_in_node(node_id, level);
+    return num_options;
+}
+
+template <typename L>
+void SearchEstimator<L>::draw_in_node(node_t node_id, Level &level) {
+    const auto &table = zdd_.table_;
+    zdd_.compute_upper_choice(node_id,
+                              random_below(table[node_id].count_upper),
+                              upper_buf_);
+    level.upper.assign(upper_buf_.rbegin(), upper_buf_.rend());
+    level.upper_share = table[node_id].count_hi;
+
+    // a lower path by its index, as compute_lower_choice decodes it; only
+    // the hi counts are kept up to date during the search. A segment ends
+    // where the enumeration can branch and is shared by the lower paths
+    // from there.
+    level.segments.resize(1);
+    level.segments[0].clear();
+    level.segment_shares.clear();
+    size_t num_segments = 1;
+    count_t num_paths = table[node_id].count_hi;
+    count_t down_id = random_below(num_paths);
+    for (node_t id = table[node_id].hi; id >= 0;) {
+        const Node &node = table[id];
+        if (node.count_hi > 0 && node.count_hi < num_paths) {
+            level.segment_shares.push_back(num_paths);
+            if (level.segments.size() <= num_segments) {
+                level.segments.emplace_back();
+            }
+            level.segments[num_segments++].clear();
+        }
+        if (down_id < node.count_hi) {
+            level.segments[num_segments - 1].push_back(node.var);
+            num_paths = node.count_hi;
+            id = node.hi;
+        } else {
+            down_id -= node.count_hi;
+            num_paths -= node.count_hi;
+            id = node.lo;
+        }
+    }
+    level.segments.resize(num_segments);
+    level.segment_shares.push_back(1);
+}
+
+template <typename L>
+double SearchEstimator<L>::draw_scored_option(int column, Level &level) {
+    const auto &table = zdd_.table_;
+    double num_options = 0.0;
+    double ratio = 1.0;
+    level.edges.clear();
+
+    // the node, by the hi edges carrying the column.
+    branches_.clear();
+    for (node_t node_id = zdd_.header_[column].down; node_id >= 0;
+         node_id = table[node_id].down) {
+        const double n =
+            (double)(table[node_id].count_upper * table[node_id].count_hi);
+        branches_.push_back({n, 2 * (size_t)node_id + 1, 0.0});
+        num_options += n;
+    }
+    const node_t node_id = branches_[draw_branch(ratio)].edge / 2;
+    level.edges.push_back(2 * (size_t)node_id + 1);
+
+    // the upper choice, by the parents up to the root.
+    upper_buf_.clear();
+    for (node_t id = node_id;;) {
+        const auto &links = zdd_.links_[id];
+        if (zdd_.plink_is_term(links.parents_head())) break;
+        branches_.clear();
+        for (auto plink = links.parents_head();;
+             plink = zdd_.plink_get_next(plink)) {
+            const node_t parent_id = zdd_.plink_node_id(plink);
+            branches_.push_back({(double)table[parent_id].count_upper,
+                                 2 * (size_t)parent_id +
+                                     (zdd_.plink_is_hi(plink) ? 1 : 0),
+                                 0.0});
+            if (plink == links.parents_tail()) break;
+        }
+        const size_t edge = branches_[draw_branch(ratio)].edge;
+        level.edges.push_back(edge);
+        id = edge / 2;
+        if (edge & 1) upper_buf_.push_back(table[id].var);
+    }
+    level.upper.assign(upper_buf_.rbegin(), upper_buf_.rend());
+
+    // the lower path, by the hi or lo edge where both lead to paths.
+    level.segments.resize(1);
+    auto &lower = level.segments[0];
+    lower.clear();
+    count_t num_paths = table[node_id].count_hi;
+    for (node_t id = table[node_id].hi; id >= 0;) {
+        const Node &node = table[id];
+        bool hi = node.count_hi == num_paths;
+        if (node.count_hi > 0 && node.count_hi < num_paths) {
+            branches_.clear();
+            branches_.push_back(
+                {(double)node.count_hi, 2 * (size_t)id + 1, 0.0});
+            branches_.push_back(
+                {(double)(num_paths - node.count_hi), 2 * (size_t)id, 0.0});
+            hi = draw_branch(ratio) == 0;
+            level.edges.push_back(2 * (size_t)id + (hi ? 1 : 0));
+        }
+        if (hi) {
+            lower.push_back(node.var);
+            num_paths = node.count_hi;
+            id = node.hi;
+        } else {
+            num_paths -= node.count_hi;
+            id = node.lo;
+        }
+    }
+    return num_options * ratio;
+}
+
+template <typename L>
+size_t SearchEstimator<L>::draw_branch(double &ratio) {
+    // unscored edges get the mean score of the scored ones.
+    double total_paths = 0.0, known_sum = 0.0;
+    int num_known = 0;
+    for (const Branch &branch : branches_) {
+        total_paths += branch.paths;
+        const double score = edge_score(branch.edge);
+        if (branch.paths > 0 && score >= 0) {
+            known_sum += score;
+            num_known++;
+        }
+    }
+    const double default_score = num_known > 0 ? known_sum / num_known : 0.0;
+    double total_score = 0.0;
+    for (Branch &branch : branches_) {
+        const double score = edge_score(branch.edge);
+        branch.score = branch.paths * (score >= 0 ? score : default_score);
+        total_score += branch.score;
+    }
+    const double by_score = total_score > 0 ? 1 - UNIFORM_SHARE : 0.0;
+
+    double r = uniform_real_distribution<double>(0.0, 1.0)(rng_);
+    size_t drawn = 0;
+    double p = 0.0;
+    for (size_t i = 0; i < branches_.size(); i++) {
+        const Branch &branch = branches_[i];
+        if (branch.paths == 0) continue;
+        drawn = i;  // the last one if r is past the end by rounding
+        p = by_score * branch.score / (by_score > 0 ? total_score : 1.0) +
+            (1 - by_score) * branch.paths / total_paths;
+        r -= p;
+        if (r < 0) break;
+    }
+    ratio *= branches_[drawn].paths / total_paths / p;
+    return drawn;
+}
+
+template <typename L>
+typename SearchEstimator<L>::count_t SearchEstimator<L>::random_below(
+    count_t n) {
+    if constexpr (sizeof(count_t) <= sizeof(uint64_t)) {
+        return rng_() % n;
+    } else {
+        const count128_t r = (count128_t)rng_() << 64 | rng_();
+        return r % n;
+    }
+}
+
+template <typename L>
+SearchEstimatorBase::CountResult SearchEstimator<L>::count(
+    double time_budget, double relative_error, double confidence) {
+    save_counters();
+    score_sum_.assign(2 * zdd_.table_.size(), 0.0);
+    score_n_.assign(2 * zdd_.table_.size(), 0);
+    learning_ = true;
+    const auto start = chrono::steady_clock::now();
+    const auto elapsed = [&start]() {
+        return chrono::duration<double>(chrono::steady_clock::now() - start)
+            .count();
+    };
+
+    // pilots on budgets growing by 4x: the budget giving the least variance
+    // per second wins. Larger budgets cost more per probe; stop after two
+    // that do worse, or when a quarter of the time is spent. The pilots
+    // learn the scores as they go.
+    CountResult result;
+    Moments best;
+    double best_cost = 0.0;
+    int num_worse = 0;
+    for (uint64_t subtree_nodes = 64;; subtree_nodes *= 4) {
+        Moments pilot;
+        const double pilot_start = elapsed();
+        do {
+            pilot.add(count_probe(subtree_nodes));
+            if (root_exact_) {
+                learning_ = false;
+                restore_counters();
+                result.num_probes = 1;
+                result.num_solutions = {pilot.sum, pilot.sum, pilot.sum};
+                result.subtree_nodes = subtree_nodes;
+                result.exact = true;
+                result.seconds = elapsed();
+                return result;
+            }
+        } while (pilot.n < MIN_PROBES ||
+                 elapsed() - pilot_start < time_budget / 32);
+
+        // a pilot without solutions has no variance, but tells nothing.
+        const double cost =
+            pilot.sum > 0
+                ? pilot.variance() * (elapsed() - pilot_start) / pilot.n
+                : INFINITY;
+        if (best.n == 0 || cost < best_cost) {
+            best = pilot;
+            best_cost = cost;
+            result.subtree_nodes = subtree_nodes;
+            num_worse = 0;
+        } else if (++num_worse == 2) {
+            break;
+        }
+        if (elapsed() >= time_budget / 4) break;
+    }
+
+    // with the scores frozen, the probes are independent and identically
+    // distributed; the pilots drew from other distributions and are left
+    // out. The range is checked on whole rounds of the groups.
+    learning_ = false;
+    GroupedMoments samples(count_groups(confidence));
+    const size_t num_groups = samples.groups.size();
+    Estimate e;
+    for (;;) {
+        if (samples.n > 0 && samples.n % num_groups == 0) {
+            e = group_range(samples);
+            const bool converged =
+                samples.n >= MIN_COUNT_PROBES && e.mean > 0 &&
+                (e.high - e.low) / 2 <= relative_error * e.mean &&
+                samples.max_value <= relative_error * samples.sum();
+            if (converged || elapsed() >= time_budget) break;
+        }
+        samples.add(count_probe(result.subtree_nodes));
+    }
+    restore_counters();
+
+    // no solution in any probe says little about how many there are.
+    if (e.mean == 0) e.high = INFINITY;
+    result.num_probes = samples.n;
+    result.num_solutions = e;
+    result.relative_error =
+        e.mean > 0 ? (e.high - e.low) / 2 / e.mean : INFINITY;
+    result.seconds = elapsed();
+    return result;
+}
+
+template <typename L>
+double SearchEstimator<L>::count_probe(uint64_t subtree_nodes) {
+    double weight = 1.0;
+    double count = 0.0;
+    int num_levels = 0;
+    root_exact_ = false;
+
+    for (int depth = 0;; depth++) {
+        uint64_t budget = subtree_nodes;
+        double subtree_count = 0.0;
+        if (count_exact(depth, budget, subtree_count)) {
+            count = weight * subtree_count;
+            root_exact_ = depth == 0;
+            break;
+        }
+
+        // too large to count: more than two columns are uncovered.
+        int remain_cols;
+        const int column = zdd_.choose_column(remain_cols);
+        Level &level = level_at(depth);
+        level.column.assign(1, (column_t)column);
+        zdd_.batch_cover(level.column.cbegin(), level.column.cend());
+        weight *= draw_scored_option(column, level);
+        level.option_weight = weight;
+        zdd_.batch_cover(level.upper.cbegin(), level.upper.cend());
+        for (const auto &segment : level.segments) {
+            zdd_.batch_cover(segment.cbegin(), segment.cend());
+        }
+        num_levels++;
+    }
+
+    for (int depth = num_levels - 1; depth >= 0; depth--) {
+        Level &level = levels_[depth];
+        for (size_t i = level.segments.size(); i-- > 0;) {
+            zdd_.batch_uncover(level.segments[i].cbegin(),
+                               level.segments[i].cend());
+        }
+        zdd_.batch_uncover(level.upper.cbegin(), level.upper.cend());
+        zdd_.batch_uncover(level.column.cbegin(), level.column.cend());
+        if (learning_) {
+            // the count below the option, unbiased whatever the weights.
+            for (size_t edge : level.edges) {
+                score_sum_[edge] += count / level.option_weight;
+                score_n_[edge]++;
+            }
+        }
+    }
+    return count;
+}
+
+template <typename L>
+bool SearchEstimator<L>::count_exact(int depth, uint64_t &budget,
+                                     double &count) {
+    if (budget == 0) return false;
+    budget--;
+    if (zdd_.header_[0].right == 0) {  // all columns are covered
+        count += 1.0;
+        return true;
+    }
+    int remain_cols;
+    const int column = zdd_.choose_column(remain_cols);
+    if (column < 0) return true;
+    if (remain_cols <= 2) {
+        const count128_t sols = zdd_.num_solutions;
+        zdd_.count_leaf_solutions(solution_, depth, column, remain_cols);
+        count += zdd_.num_solutions - sols;
+        return true;
+    }
+
+    // the options of the column, as next_option enumerates them.
+    Level &level = level_at(depth);
+    level.column.assign(1, (column_t)column);
+    zdd_.batch_cover(level.column.cbegin(), level.column.cend());
+    bool complete = true;
+    for (node_t node_id = zdd_.header_[column].down;
+         node_id >= 0 && complete;) {
+        const Node &node = zdd_.table_[node_id];
+        const node_t next_node_id = node.down;
+        const count_t up_end = node.count_upper;
+        const count_t down_end = node.count_hi;
+        for (count_t up_id = 0; up_id < up_end && complete; up_id++) {
+            zdd_.compute_upper_choice(node_id, up_id, level.upper);
+            reverse(level.upper.begin(), level.upper.end());
+            for (count_t down_id = 0; down_id < down_end && complete;
+                 down_id++) {
+                zdd_.compute_lower_choice(node.hi, down_id, lower_buf_);
+                auto &option = level.exact_option;
+                option.assign(level.upper.cbegin(), level.upper.cend());
+                option.insert(option.end(), lower_buf_.cbegin(),
+                              lower_buf_.cend());
+                zdd_.batch_cover(option.cbegin(), option.cend());
+                complete = count_exact(depth + 1, budget, count);
+                zdd_.batch_uncover(option.cbegin(), option.cend());
+            }
+        }
+        node_id = next_node_id;
+    }
+    zdd_.batch_uncover(level.column.cbegin(), level.column.cend());
+    return complete;
+}
+
+double SearchEstimatorBase::Moments::variance() const {
+    if (n < 2) return 0.0;
+    return max(sum_sq - sum * sum / n, 0.0) / (n - 1);
+}
+
+double SearchEstimatorBase::GroupedMoments::sum() const {
+    double sum = 0.0;
+    for (const Moments &group : groups) sum += group.sum;
+    return sum;
+}
+
+SearchEstimatorBase::Estimate SearchEstimatorBase::group_range(
+    const GroupedMoments &values) {
+    Estimate e;
+    if (values.n == 0) return e;
+    e.mean = values.sum() / values.n;
+    e.low = INFINITY;
+    for (const Moments &group : values.groups) {
+        if (group.n == 0) {
+            e.high = INFINITY;
+            continue;
+        }
+        e.low = min(e.low, group.mean());
+        e.high = max(e.high, group.mean());
+    }
+    return e;
+}
+
+size_t SearchEstimatorBase::count_groups(double confidence) {
+    size_t k = 2;
+    while (ldexp(1.0, 1 - (int)k) > 1.0 - confidence) k++;
+    return k;
+}
+
+template <typename L>
+void SearchEstimator<L>::save_counters() {
+    saved_solutions_ = zdd_.num_solutions;
+    saved_counters_ = {zdd_.num_search_tree_nodes, zdd_.num_updates,
+                       zdd_.num_head_updates,      zdd_.num_inactive_updates,
+                       zdd_.num_hides,             zdd_.num_failure_backtracks};
+}
+
+template <typename L>
+void SearchEstimator<L>::restore_counters() {
+    zdd_.num_solutions = saved_solutions_;
+    zdd_.num_search_tree_nodes = saved_counters_[0];
+    zdd_.num_updates = saved_counters_[1];
+    zdd_.num_head_updates = saved_counters_[2];
+    zdd_.num_inactive_updates = saved_counters_[3];
+    zdd_.num_hides = saved_counters_[4];
+    zdd_.num_failure_backtracks = saved_counters_[5];
+}
+
+#define INSTANTIATE(L) template class SearchEstimator<L>;
+FOR_EACH_LAYOUT(INSTANTIATE)
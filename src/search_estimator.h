@@ -0,0 +1,278 @@
+#ifndef SEARCH_ESTIMATOR_H_
+#define SEARCH_ESTIMATOR_H_
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "dancing_on_zdd.h"
+
+/**
+ * Results and statistics of SearchEstimator, common to the layouts.
+ */
+class SearchEstimatorBase {
+   public:
+    // mean of the probes with a low and a high bound, see Result and
+    // CountResult.
+    struct Estimate {
+        double mean = 0.0;
+        double low = 0.0;
+        double high = 0.0;
+    };
+
+    /**
+     * The bounds of run() are a rough range, not a confidence interval: the
+     * lowest and highest means of RANGE_GROUPS groups of the probes. When
+     * the nodes, solutions or updates sit in branches that the probes
+     * rarely reach, every group can miss them, and the true value then
+     * lies above the range.
+     */
+    struct Result {
+        uint64_t num_probes = 0;
+        Estimate num_nodes;
+        Estimate num_updates;
+        Estimate num_solutions;
+        Estimate seconds;  // the updates at seconds_per_update
+        double seconds_per_update = 0.0;  // of the probes, times the factor
+    };
+
+    /**
+     * The bounds of count() are the lowest and highest means of
+     * count_groups(confidence) groups of the probes after the pilots. The
+     * range misses the number of solutions only if every group mean is on
+     * the same side of it, which happens with probability 2^(1 - groups)
+     * <= 1 - confidence when a group mean is as likely above the number as
+     * below. With a heavy tail the group means are mostly below it, so the
+     * range is only trusted after MIN_COUNT_PROBES probes and when no
+     * single probe carries more than the relative error of their sum. If
+     * every probe found no solution, high is infinite.
+     */
+    struct CountResult {
+        uint64_t num_probes = 0;  // after the pilots
+        Estimate num_solutions;
+        double relative_error = 0.0;  // half the range over the estimate
+        uint64_t subtree_nodes = 0;   // node budget of the exact subtrees
+        bool exact = false;           // the whole tree was counted
+        double seconds = 0.0;
+    };
+
+    // default time per update of the search over that of the probes: the
+    // search also walks the lower and upper choices of every option. The
+    // median over the 49 instances of the benchmark set that finish within
+    // 30 s, of the time per update of a -j 1 batch run over that of 0.5 s
+    // of probes (quartiles 1.08 and 1.42); --estimate-time-factor sets it.
+    static constexpr double SEARCH_TIME_FACTOR = 1.2;
+    // groups of the probes of run(), for the range of their means.
+    static constexpr size_t RANGE_GROUPS = 8;
+
+    static constexpr uint64_t MIN_PROBES = 16;
+    // probes of count() after the pilots before it may stop.
+    static constexpr uint64_t MIN_COUNT_PROBES = 1024;
+    // share of each branching of count() that follows the path counts
+    // alone, whatever the learned scores; it bounds the ratio of the drawn
+    // probability to the uniform one at a branching by 1 / share.
+    static constexpr double UNIFORM_SHARE = 0.5;
+
+    // groups of the probes of count(): the least k >= 2 with
+    // 2^(1 - k) <= 1 - confidence, e.g. 6 at 0.95.
+    static size_t count_groups(double confidence);
+
+   protected:
+    // sums of the probe values.
+    struct Moments {
+        uint64_t n = 0;
+        double sum = 0.0;
+        double sum_sq = 0.0;
+
+        void add(double value) {
+            n++;
+            sum += value;
+            sum_sq += value * value;
+        }
+        double variance() const;
+        double mean() const { return n > 0 ? sum / n : 0.0; }
+    };
+
+    // probe values dealt to the groups in turn.
+    struct GroupedMoments {
+        uint64_t n = 0;
+        double max_value = 0.0;
+        vector<Moments> groups;
+
+        explicit GroupedMoments(size_t num_groups = RANGE_GROUPS)
+            : groups(num_groups) {}
+        void add(double value) {
+            groups[n++ % groups.size()].add(value);
+            max_value = std::max(max_value, value);
+        }
+        double sum() const;
+    };
+
+    struct Sample {
+        double num_nodes;
+        double num_updates;
+        double num_solutions;
+    };
+
+    // the mean of the values, between the lowest and highest group mean;
+    // high is infinite while a group is empty.
+    static Estimate group_range(const GroupedMoments &values);
+};
+
+/**
+ * Estimates the size of a search with Knuth's random probes.
+ *  A probe walks from the root to a leaf of the search tree, covering the
+ *  column the search would choose and one option of it drawn uniformly at
+ *  random, through the same batch_cover / batch_uncover path as the search.
+ *  A node at the end of a path whose branching factors are b_0 .. b_{d-1}
+ *  stands for w = b_0 * .. * b_{d-1} nodes, so summing w over the nodes of a
+ *  probe gives an unbiased estimate of the number of search tree nodes; the
+ *  same holds for solutions and updates. Nodes with one or two columns left
+ *  are counted in closed form, as the search does.
+ *
+ *  count() estimates the number of solutions by partial search: a probe
+ *  counts the subtree below a node exactly if it has at most a budget of
+ *  nodes, and otherwise covers one option and goes on with the weight
+ *  multiplied by the inverse of the option's probability. Whether a subtree
+ *  is counted exactly depends only on the subtree, so the estimate stays
+ *  unbiased while most of the variance of the deep levels is removed.
+ *  The options are drawn by importance, along their paths in the
+ *  DanceDD: the node of the column, then the parents up to the root, then
+ *  the hi or lo branches down to the terminal. The pilot probes learn, for
+ *  each ZDD edge, the mean count below the options through it, and each
+ *  branching takes an edge by its paths times that score, mixed with
+ *  UNIFORM_SHARE of the paths alone so that every option keeps a chance.
+ *  The scores are frozen after the pilots, so the probes that make the
+ *  estimate are independent and identically distributed.
+ *
+ *  The structure must be at rest and is left at rest.
+ */
+template <typename L>
+class SearchEstimator : public SearchEstimatorBase {
+   public:
+    using count_t = typename L::count_t;
+    using column_t = typename L::column_t;
+    using node_t = typename L::node_t;
+    using Node = typename ZddWithLinks<L>::Node;
+
+    explicit SearchEstimator(ZddWithLinks<L> &zdd, uint64_t seed = 1);
+    SearchEstimator(const SearchEstimator &obj) = delete;
+
+    /**
+     * Runs probes for time_budget seconds, but at least MIN_PROBES and at
+     * most max_probes of them. The time is estimated at the time per update
+     * of the probes times time_factor.
+     */
+    Result run(double time_budget, double time_factor = SEARCH_TIME_FACTOR,
+               uint64_t max_probes = UINT64_MAX);
+
+    /**
+     * Estimates the number of solutions until the range of CountResult at
+     * the given confidence is within relative_error of the estimate, or for
+     * at most time_budget seconds. The node budget of the exact subtrees is
+     * chosen by pilot runs, each on a slice of the time budget, which also
+     * learn the scores of the option draws.
+     */
+    CountResult count(double time_budget, double relative_error,
+                      double confidence);
+
+   private:
+    /**
+     * An option is covered as the search covers it: its upper choice, then
+     * the segments of its lower path between the nodes where the lower
+     * enumeration branches. Each part is shared by the options enumerated
+     * while it stays covered, and its updates are split among them.
+     */
+    struct Level {
+        double weight;  // search tree nodes this node stands for
+        vector<size_t> edges;  // count(): the edges of the drawn option
+        double option_weight;  // count(): the weight below the option
+        count_t num_options;
+        vector<column_t> upper;
+        count_t upper_share;                // options sharing the upper choice
+        vector<vector<column_t>> segments;  // lower path, ascending
+        vector<count_t> segment_shares;
+        uint64_t column_updates;  // covering and uncovering the column
+        double option_updates;    // this option's share of its updates
+        vector<column_t> column;  // the covered column
+        vector<column_t> exact_option;
+    };
+
+    // the level at depth; the levels grow to it and stay where they are.
+    Level &level_at(int depth) {
+        while ((size_t)depth >= levels_.size()) {
+            levels_.emplace_back();
+        }
+        return levels_[depth];
+    }
+
+    Sample probe();
+
+    // draws one of the options of the covered column at depth uniformly and
+    // returns their number.
+    count_t draw_option(int column, Level &level);
+
+    // draws an option of node_id uniformly: its upper choice and a lower
+    // path.
+    void draw_in_node(node_t node_id, Level &level);
+
+    // draws an option of the covered column by the scores of its edges and
+    // returns the inverse of its probability.
+    double draw_scored_option(int column, Level &level);
+
+    // an edge of a branching: edge is 2 * node + 1 for the hi edge of the
+    // node and 2 * node for its lo edge.
+    struct Branch {
+        double paths;  // to the end of the walk through the edge
+        size_t edge;
+        double score;  // paths times the score of the edge
+    };
+
+    /**
+     * draws one of branches_, which has paths through at least one, and
+     * multiplies ratio by its probability under the path counts alone over
+     * its probability.
+     */
+    size_t draw_branch(double &ratio);
+
+    // the mean count below the options through edge, or -1 if unknown.
+    double edge_score(size_t edge) const {
+        return score_n_[edge] > 0 ? score_sum_[edge] / score_n_[edge] : -1.0;
+    }
+
+    // a uniform random number below n.
+    count_t random_below(count_t n);
+
+    // a probe of count() with exact subtrees of up to subtree_nodes nodes.
+    double count_probe(uint64_t subtree_nodes);
+
+    /**
+     * Adds the solutions below the current node, at depth, to count if the
+     * subtree has at most budget nodes; budget is decreased by the nodes
+     * searched. Returns false, with the structure as on entry, otherwise.
+     */
+    bool count_exact(int depth, uint64_t &budget, double &count);
+
+    // the probes must not show in the counters of the structure.
+    void save_counters();
+    void restore_counters();
+
+    ZddWithLinks<L> &zdd_;
+    std::mt19937_64 rng_;
+    std::deque<Level> levels_;
+    vector<column_t> upper_buf_;
+    vector<column_t> lower_buf_;
+    vector<vector<column_t>> solution_;  // for count_leaf_solutions
+    bool root_exact_;  // the last count probe counted the whole tree
+    bool learning_;    // count probes add to the scores
+    vector<double> score_sum_;  // by edge, see Branch
+    vector<uint64_t> score_n_;
+    vector<Branch> branches_;
+    count128_t saved_solutions_;
+    std::array<uint64_t, 6> saved_counters_;
+};
+
+#endif  // SEARCH_ESTIMATOR_H_
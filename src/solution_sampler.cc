@@ -0,0 +1,192 @@
+#include "solution_sampler.h"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace std;
+
+template <typename L>
+SolutionSampler<L>::SolutionSampler(ZddWithLinks<L> &zdd, uint64_t seed,
+                                    size_t max_bytes)
+    : zdd_(zdd),
+      rng_(seed),
+      max_bytes_(max_bytes),
+      nodes_(),
+      bytes_(0),
+      depth_column_(),
+      depth_option_(),
+      lower_buf_(),
+      search_solution_(),
+      num_counted_options_(0) {}
+
+template <typename L>
+size_t SolutionSampler<L>::KeyHash::operator()(
+    const SubproblemCache::Key &key) const noexcept {
+    uint64_t h = 0x9e3779b97f4a7c15ULL;
+    for (uint64_t word : key) {
+        h ^= word + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+        h *= 0xbf58476d1ce4e5b9ULL;
+    }
+    return h ^ (h >> 31);
+}
+
+template <typename L>
+count128_t SolutionSampler<L>::num_solutions() {
+    if (zdd_.header_[0].right == 0) return 1;  // the empty solution
+    const auto &prefix = node_counts(0).prefix;
+    return prefix.empty() ? 0 : prefix.back();
+}
+
+template <typename L>
+bool SolutionSampler<L>::sample(Solution &solution) {
+    solution.clear();
+    const count128_t total = num_solutions();
+    if (total == 0) return false;
+    count128_t rank = random_below(total);
+
+    int depth = 0;
+    while (zdd_.header_[0].right != 0) {
+        const NodeCounts &counts = node_counts(depth);
+        const int column = counts.column;
+        const auto &prefix = counts.prefix;
+        const size_t index =
+            upper_bound(prefix.cbegin(), prefix.cend(), rank) -
+            prefix.cbegin();
+        assert(index < prefix.size());  // the rank is below the node's count
+        if (index > 0) {
+            rank -= prefix[index - 1];
+        }
+
+        reserve_depth(depth);
+        depth_column_[depth].assign(1, (column_t)column);
+        zdd_.batch_cover(depth_column_[depth].cbegin(),
+                         depth_column_[depth].cend());
+        auto &option = depth_option_[depth];
+        unrank_option(column, index, option);
+        zdd_.batch_cover(option.cbegin(), option.cend());
+
+        solution.push_back(option);
+        auto &columns = solution.back();
+        columns.insert(lower_bound(columns.begin(), columns.end(), column),
+                       (column_t)column);
+        depth++;
+    }
+
+    for (depth--; depth >= 0; depth--) {
+        zdd_.batch_uncover(depth_option_[depth].cbegin(),
+                           depth_option_[depth].cend());
+        zdd_.batch_uncover(depth_column_[depth].cbegin(),
+                           depth_column_[depth].cend());
+    }
+    return true;
+}
+
+template <typename L>
+const typename SolutionSampler<L>::NodeCounts &SolutionSampler<L>::node_counts(
+    int depth) {
+    const auto found = nodes_.find(zdd_.uncovered_columns_key());
+    if (found != nodes_.end()) return found->second;
+
+    // count_below reuses the key buffer.
+    SubproblemCache::Key key = zdd_.uncovered_columns_key();
+    NodeCounts counts;
+    int remain_cols;
+    counts.column = zdd_.choose_column(remain_cols);
+    if (counts.column > 0) {
+        // the options in the order of next_option.
+        reserve_depth(depth);
+        auto &option = depth_option_[depth];
+        depth_column_[depth].assign(1, (column_t)counts.column);
+        zdd_.batch_cover(depth_column_[depth].cbegin(),
+                         depth_column_[depth].cend());
+        count128_t sum = 0;
+        for (node_t node_id = zdd_.header_[counts.column].down;
+             node_id >= 0;) {
+            const Node &node = zdd_.table_[node_id];
+            const node_t next_node_id = node.down;
+            const count_t up_end = node.count_upper;
+            const count_t down_end = node.count_hi;
+            for (count_t up_id = 0; up_id < up_end; up_id++) {
+                for (count_t down_id = 0; down_id < down_end; down_id++) {
+                    zdd_.compute_upper_choice(node_id, up_id, option);
+                    reverse(option.begin(), option.end());
+                    zdd_.compute_lower_choice(node.hi, down_id, lower_buf_);
+                    option.insert(option.end(), lower_buf_.cbegin(),
+                                  lower_buf_.cend());
+                    zdd_.batch_cover(option.cbegin(), option.cend());
+                    sum += count_below(depth + 1);
+                    zdd_.batch_uncover(option.cbegin(), option.cend());
+                    counts.prefix.push_back(sum);
+                    num_counted_options_++;
+                }
+            }
+            node_id = next_node_id;
+        }
+        zdd_.batch_uncover(depth_column_[depth].cbegin(),
+                           depth_column_[depth].cend());
+    }
+
+    const size_t bytes = key.size() * sizeof(uint64_t) +
+                         counts.prefix.size() * sizeof(count128_t) +
+                         sizeof(key) + sizeof(counts) + 4 * sizeof(void *);
+    if (bytes_ + bytes > max_bytes_) {
+        nodes_.clear();
+        bytes_ = 0;
+    }
+    bytes_ += bytes;
+    return nodes_.emplace(std::move(key), std::move(counts)).first->second;
+}
+
+template <typename L>
+void SolutionSampler<L>::reserve_depth(int depth) {
+    if ((size_t)depth >= depth_column_.size()) {
+        depth_column_.resize(depth + 1);
+        depth_option_.resize(depth + 1);
+    }
+}
+
+template <typename L>
+count128_t SolutionSampler<L>::count_below(int depth) {
+    // search finds the count in the subproblem cache or counts the subtree
+    // and stores it.
+    const count128_t num_solutions = zdd_.num_solutions;
+    zdd_.search(search_solution_, depth);
+    return zdd_.num_solutions - num_solutions;
+}
+
+template <typename L>
+count128_t SolutionSampler<L>::random_below(count128_t n) {
+    if (n - 1 <= UINT64_MAX) {
+        return uniform_int_distribution<uint64_t>(0, (uint64_t)(n - 1))(rng_);
+    }
+    // rejection below the largest multiple of n, as uniform_int_distribution
+    // does for 64 bits: 2^128 mod n values are drawn again.
+    const count128_t reject = -n % n;
+    count128_t r;
+    do {
+        r = (count128_t)rng_() << 64 | rng_();
+    } while (r < reject);
+    return r % n;
+}
+
+template <typename L>
+void SolutionSampler<L>::unrank_option(int column, count_t index,
+                                       vector<column_t> &option) {
+    const auto &table = zdd_.table_;
+    node_t node_id = zdd_.header_[column].down;
+    for (;;) {
+        const count_t num_options =
+            table[node_id].count_upper * table[node_id].count_hi;
+        if (index < num_options) break;
+        index -= num_options;
+        node_id = table[node_id].down;
+    }
+    const Node &node = table[node_id];
+    zdd_.compute_upper_choice(node_id, index / node.count_hi, option);
+    reverse(option.begin(), option.end());
+    zdd_.compute_lower_choice(node.hi, index % node.count_hi, lower_buf_);
+    option.insert(option.end(), lower_buf_.cbegin(), lower_buf_.cend());
+}
+
+#define INSTANTIATE(L) template class SolutionSampler<L>;
+FOR_EACH_LAYOUT(INSTANTIATE)
@@ -0,0 +1,100 @@
+#ifndef SOLUTION_SAMPLER_H_
+#define SOLUTION_SAMPLER_H_
+
+#include <cstdint>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "dancing_on_zdd.h"
+#include "subproblem_cache.h"
+
+/**
+ * Draws exactly uniform solutions of a loaded instance.
+ *  At every search tree node the solutions below it are split among the
+ *  options of the column the search would choose, in the order of
+ *  next_option. A sample draws a rank below the number of solutions of
+ *  the root; at each node it finds the option whose solutions hold the
+ *  rank from the prefix sums of the options' counts, unranks it into a
+ *  node, an upper choice and a lower choice as compute_upper_choice and
+ *  compute_lower_choice do, covers it and goes on with the rest of the
+ *  rank below it. Each solution has one rank at the root, so the solutions
+ *  are drawn uniformly.
+ *
+ *  The prefix sums of a node are computed when a sample first reaches it,
+ *  counting the solutions below each option with ZddWithLinks::search and
+ *  the subproblem cache of zdd, which must be set. They are kept by the set
+ *  of uncovered columns, like the subproblem cache, so later samples
+ *  through the node only search the sums and unrank one option.
+ *  The structure must be at rest and is left at rest.
+ */
+template <typename L>
+class SolutionSampler {
+   public:
+    using count_t = typename L::count_t;
+    using column_t = typename L::column_t;
+    using node_t = typename L::node_t;
+    using Solution = typename ZddWithLinks<L>::Solution;
+    using Node = typename ZddWithLinks<L>::Node;
+
+    // the prefix sums are dropped when they grow beyond max_bytes.
+    explicit SolutionSampler(ZddWithLinks<L> &zdd, uint64_t seed = 1,
+                             size_t max_bytes = DEFAULT_MAX_BYTES);
+    SolutionSampler(const SolutionSampler &obj) = delete;
+
+    // the number of solutions of the instance.
+    count128_t num_solutions();
+
+    /**
+     * Draws a solution as its options, each the sorted list of its columns,
+     * ordered as the search covers them. Returns false, leaving solution
+     * empty, if the instance has no solution.
+     */
+    bool sample(Solution &solution);
+
+    // options whose solutions were counted for the prefix sums.
+    uint64_t num_counted_options() const { return num_counted_options_; }
+    size_t num_nodes() const { return nodes_.size(); }
+
+    static constexpr size_t DEFAULT_MAX_BYTES = 256UL << 20;
+
+   private:
+    // the chosen column of a search tree node and the solutions below its
+    // first i + 1 options.
+    struct NodeCounts {
+        int column;
+        vector<count128_t> prefix;
+    };
+
+    struct KeyHash {
+        size_t operator()(const SubproblemCache::Key &key) const noexcept;
+    };
+
+    // the counts of the current node, at depth; computed if not kept.
+    const NodeCounts &node_counts(int depth);
+
+    // grows the buffers of the depths to depth.
+    void reserve_depth(int depth);
+
+    // counts the solutions below the current node, at depth.
+    count128_t count_below(int depth);
+
+    // a uniform random number below n.
+    count128_t random_below(count128_t n);
+
+    // unranks the index-th option of column into option, without column.
+    void unrank_option(int column, count_t index, vector<column_t> &option);
+
+    ZddWithLinks<L> &zdd_;
+    std::mt19937_64 rng_;
+    const size_t max_bytes_;
+    std::unordered_map<SubproblemCache::Key, NodeCounts, KeyHash> nodes_;
+    size_t bytes_;
+    vector<vector<column_t>> depth_column_;  // the covered column per depth
+    vector<vector<column_t>> depth_option_;  // the covered option per depth
+    vector<column_t> lower_buf_;
+    Solution search_solution_;  // for search
+    uint64_t num_counted_options_;
+};
+
+#endif  // SOLUTION_SAMPLER_H_
@@ -0,0 +1,197 @@
+#include "solution_writer.h"
+
+#include <chrono>
+#include <stdexcept>
+
+using namespace std;
+
+// the writer hands its buffer to the file when it grows beyond this.
+constexpr size_t WRITE_BUFFER_BYTES = 1UL << 20;
+
+SolutionWriter::SolutionWriter(const string &file_name, Format format,
+                               int num_var, size_t queue_words)
+    : format_(format),
+      num_var_(num_var),
+      file_(fopen(file_name.c_str(), "wb")),
+      queue_(),
+      mask_(queue_words - 1),
+      tail_(0),
+      tail_cache_(0),
+      head_cache_(0),
+      num_stalls_(0),
+      head_(0),
+      buffer_(),
+      current_(),
+      owner_(num_var <= UINT16_MAX ? num_var + 1 : 0, 0),
+      wide_owner_(num_var <= UINT16_MAX ? 0 : num_var + 1, 0),
+      num_written_(0),
+      num_bytes_(0),
+      failed_(false),
+      done_(false),
+      thread_() {
+    if (queue_words == 0 || (queue_words & mask_) != 0) {
+        throw std::invalid_argument("queue size must be a power of two");
+    }
+    if (file_ == nullptr) {
+        throw std::runtime_error("can't open " + file_name);
+    }
+    queue_.reset(new uint32_t[queue_words]);
+    buffer_.reserve(2 * WRITE_BUFFER_BYTES);
+
+    if (format_ != Format::Ndjson) {
+        buffer_ += format_ == Format::Binary ? "D3XB" : "D3XD";
+        const uint32_t n = num_var_;
+        buffer_.append(reinterpret_cast<const char *>(&n), sizeof(n));
+    }
+    thread_ = thread(&SolutionWriter::writer_loop, this);
+}
+
+SolutionWriter::~SolutionWriter() {
+    if (thread_.joinable()) {
+        done_ = true;
+        thread_.join();
+    }
+    if (file_ != nullptr) {
+        fclose(file_);
+    }
+}
+
+SolutionWriter::Format SolutionWriter::parse_format(const string &name) {
+    if (name == "ndjson") return Format::Ndjson;
+    if (name == "binary") return Format::Binary;
+    if (name == "delta") return Format::Delta;
+    throw std::invalid_argument("unknown solution format: " + name);
+}
+
+void SolutionWriter::reserve(size_t num_words) {
+    if (num_words > mask_ + 1) {
+        throw std::runtime_error("solution does not fit in the queue");
+    }
+    if (tail_cache_ + num_words - head_cache_ <= mask_ + 1) return;
+    head_cache_ = head_.load(std::memory_order_acquire);
+    if (tail_cache_ + num_words - head_cache_ <= mask_ + 1) return;
+
+    num_stalls_++;
+    do {
+        this_thread::yield();
+        head_cache_ = head_.load(std::memory_order_acquire);
+    } while (tail_cache_ + num_words - head_cache_ > mask_ + 1);
+}
+
+void SolutionWriter::finish() {
+    if (thread_.joinable()) {
+        done_ = true;
+        thread_.join();
+    }
+    const bool closed = file_ == nullptr || fclose(file_) == 0;
+    file_ = nullptr;
+    if (failed_ || !closed) {
+        throw std::runtime_error("failed to write the solutions");
+    }
+}
+
+void SolutionWriter::writer_loop() {
+    uint64_t head = 0;
+    for (;;) {
+        // read done_ first: a tail published before done_ is then seen.
+        const bool done = done_.load(std::memory_order_acquire);
+        const uint64_t tail = tail_.load(std::memory_order_acquire);
+        if (head == tail) {
+            if (done) break;
+            flush_buffer();
+            this_thread::sleep_for(chrono::microseconds(100));
+            continue;
+        }
+        while (head != tail) {
+            const size_t shared = queue_[head++ & mask_];
+            const size_t num_new = queue_[head++ & mask_];
+            current_.resize(shared + num_new);
+            for (size_t i = shared; i < current_.size(); i++) {
+                current_[i].resize(queue_[head++ & mask_]);
+                for (auto &col : current_[i]) {
+                    col = queue_[head++ & mask_];
+                }
+            }
+            write_solution(shared);
+            if (buffer_.size() >= WRITE_BUFFER_BYTES) {
+                head_.store(head, std::memory_order_release);
+                flush_buffer();
+            }
+        }
+        head_.store(head, std::memory_order_release);
+    }
+    flush_buffer();
+}
+
+void SolutionWriter::write_solution(size_t shared) {
+    const auto &solution = current_;
+    num_written_++;
+    switch (format_) {
+        case Format::Ndjson: {
+            buffer_ += '[';
+            for (size_t i = 0; i < solution.size(); i++) {
+                buffer_ += i ? ",[" : "[";
+                for (size_t j = 0; j < solution[i].size(); j++) {
+                    if (j) buffer_ += ',';
+                    buffer_ += to_string(solution[i][j]);
+                }
+                buffer_ += ']';
+            }
+            buffer_ += "]\n";
+            break;
+        }
+        case Format::Binary: {
+            if (wide_owner_.empty()) {
+                write_owners(owner_);
+            } else {
+                write_owners(wide_owner_);
+            }
+            break;
+        }
+        case Format::Delta: {
+            write_varint(shared);
+            write_varint(solution.size() - shared);
+            for (size_t i = shared; i < solution.size(); i++) {
+                write_varint(solution[i].size());
+                uint32_t prev_col = 0;
+                for (const auto col : solution[i]) {
+                    write_varint(col - prev_col);
+                    prev_col = col;
+                }
+            }
+            break;
+        }
+    }
+}
+
+template <typename Word>
+void SolutionWriter::write_owners(vector<Word> &owner) {
+    const auto &solution = current_;
+    for (size_t i = 0; i < solution.size(); i++) {
+        for (const auto col : solution[i]) {
+            owner[col] = i + 1;
+        }
+    }
+    buffer_.append(reinterpret_cast<const char *>(&owner[1]),
+                   num_var_ * sizeof(Word));
+}
+
+void SolutionWriter::write_varint(uint64_t value) {
+    while (value >= 0x80) {
+        buffer_ += (char)((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    buffer_ += (char)value;
+}
+
+void SolutionWriter::flush_buffer() {
+    if (buffer_.empty()) return;
+    // after a failure the queue is still drained, so the search never
+    // waits for a writer that stopped.
+    if (!failed_ &&
+        fwrite(buffer_.data(), 1, buffer_.size(), file_) != buffer_.size()) {
+        failed_ = true;
+    }
+    num_bytes_ += buffer_.size();
+    buffer_.clear();
+}
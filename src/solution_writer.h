@@ -0,0 +1,134 @@
+#ifndef SOLUTION_WRITER_H_
+#define SOLUTION_WRITER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Writes the solutions of an enumeration to a file from a background thread.
+ *  The search thread copies the options in which each solution differs
+ *  from the previous one into a single-producer, single-consumer ring
+ *  buffer of 32-bit words and returns; formatting and file I/O happen in
+ *  the writer thread. The search only waits when the writer has fallen a
+ *  whole queue behind, which is counted in num_stalls().
+ *  A solution is a list of options, each a sorted list of columns.
+ *
+ *  Formats:
+ *  - Ndjson: one JSON array of options per line, e.g. [[1,4],[2,3]].
+ *  - Binary: the header "D3XB" and the number of columns n as a 32-bit
+ *    integer, then n words per solution: word c - 1 is the (1-based)
+ *    position of the option covering column c. The words are 16-bit if
+ *    n < 65536 and 32-bit otherwise. Little endian.
+ *  - Delta: the header "D3XD" and n, then per solution the varints k
+ *    (options shared with the previous solution), m (new options) and, for
+ *    each new option, its size and its columns as gaps from the previous
+ *    column (the first from 0). Solutions of a depth-first search share
+ *    long prefixes, so most records are a few bytes.
+ */
+class SolutionWriter {
+   public:
+    enum class Format { Ndjson, Binary, Delta };
+
+    // throws std::runtime_error if the file can't be opened.
+    SolutionWriter(const std::string &file_name, Format format, int num_var,
+                   size_t queue_words = DEFAULT_QUEUE_WORDS);
+    SolutionWriter(const SolutionWriter &obj) = delete;
+    ~SolutionWriter();
+
+    /**
+     * Queues the solution made of the first size options of solution, of
+     * which the first shared are those of the previous solution; only the
+     * others are copied. Called by one search thread only.
+     */
+    template <typename Column>
+    void push(const std::vector<std::vector<Column>> &solution, size_t size,
+              size_t shared);
+
+    /**
+     * Waits until every queued solution is written and closes the file.
+     * Throws std::runtime_error if writing failed.
+     */
+    void finish();
+
+    uint64_t num_written() const { return num_written_; }
+    uint64_t num_stalls() const { return num_stalls_; }
+    uint64_t num_bytes() const { return num_bytes_; }
+
+    // "ndjson", "binary" or "delta"; throws std::invalid_argument otherwise.
+    static Format parse_format(const std::string &name);
+
+    static constexpr size_t DEFAULT_QUEUE_WORDS = 1UL << 23;  // 32 MB
+
+   private:
+    void put(uint32_t word) {
+        queue_[tail_cache_++ & mask_] = word;
+    }
+
+    // waits until num_words words are free in the queue.
+    void reserve(size_t num_words);
+
+    void writer_loop();
+    // writes current_, whose first shared options are those of the
+    // previous solution.
+    void write_solution(size_t shared);
+    // Binary: the option positions of the columns of current_ in words of
+    // the width of owner.
+    template <typename Word>
+    void write_owners(std::vector<Word> &owner);
+    void write_varint(uint64_t value);
+    void flush_buffer();
+
+    const Format format_;
+    const int num_var_;
+    FILE *file_;
+    std::unique_ptr<uint32_t[]> queue_;
+    const size_t mask_;
+
+    // written by the search thread.
+    alignas(64) std::atomic<uint64_t> tail_;
+    uint64_t tail_cache_;  // tail_ including the record being written
+    uint64_t head_cache_;  // last head_ seen by the search thread
+    uint64_t num_stalls_;
+
+    // written by the writer thread.
+    alignas(64) std::atomic<uint64_t> head_;
+    std::string buffer_;
+    std::vector<std::vector<uint32_t>> current_;
+    std::vector<uint16_t> owner_;       // Binary, n < 65536
+    std::vector<uint32_t> wide_owner_;  // Binary, larger n
+    uint64_t num_written_;
+    uint64_t num_bytes_;
+    bool failed_;
+
+    std::atomic<bool> done_;
+    std::thread thread_;
+};
+
+template <typename Column>
+inline void SolutionWriter::push(
+    const std::vector<std::vector<Column>> &solution, size_t size,
+    size_t shared) {
+    // record: the shared and the new options, then each new option's size
+    // and columns.
+    size_t num_words = 2;
+    for (size_t i = shared; i < size; i++) {
+        num_words += 1 + solution[i].size();
+    }
+    reserve(num_words);
+    put((uint32_t)shared);
+    put((uint32_t)(size - shared));
+    for (size_t i = shared; i < size; i++) {
+        put((uint32_t)solution[i].size());
+        for (const auto col : solution[i]) {
+            put(col);
+        }
+    }
+    tail_.store(tail_cache_, std::memory_order_release);
+}
+
+#endif  // SOLUTION_WRITER_H_
@@ -0,0 +1,81 @@
+#include "subproblem_cache.h"
+
+using namespace std;
+
+SubproblemCache::SubproblemCache(const Config &config)
+    : config_(config),
+      map_(),
+      lists_(1),
+      bytes_(0),
+      num_hits_(0ULL),
+      num_misses_(0ULL),
+      num_evictions_(0ULL),
+      num_saved_nodes_(0ULL) {}
+
+size_t SubproblemCache::KeyHash::operator()(const Key &key) const noexcept {
+    uint64_t h = 0x9e3779b97f4a7c15ULL;
+    for (uint64_t word : key) {
+        h ^= word + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+        h *= 0xbf58476d1ce4e5b9ULL;
+    }
+    return h ^ (h >> 31);
+}
+
+size_t SubproblemCache::entry_bytes(const Key &key) const {
+    // key words, the map node with its bucket and the list node.
+    return key.size() * sizeof(uint64_t) + sizeof(Key) + sizeof(Value) +
+           4 * sizeof(void *) + 3 * sizeof(void *);
+}
+
+const SubproblemCache::Result *SubproblemCache::find(const Key &key) {
+    auto it = map_.find(key);
+    if (it == map_.end()) {
+        num_misses_++;
+        return nullptr;
+    }
+    num_hits_++;
+    Value &value = it->second;
+    num_saved_nodes_ += value.result.num_nodes - 1;
+    auto &list = lists_[list_of(value.depth)];
+    list.splice(list.begin(), list, value.pos);
+    return &value.result;
+}
+
+void SubproblemCache::insert(const Key &key, int depth, const Result &result) {
+    if (result.num_nodes < config_.min_subtree_nodes) {
+        return;
+    }
+    const size_t bytes = entry_bytes(key);
+    if (bytes > config_.max_bytes) {
+        return;
+    }
+    while (bytes_ + bytes > config_.max_bytes && !map_.empty()) {
+        evict_one();
+    }
+
+    auto inserted = map_.emplace(key, Value{result, depth, {}});
+    if (!inserted.second) {
+        return;  // already known
+    }
+    const size_t l = list_of(depth);
+    if (lists_.size() <= l) {
+        lists_.resize(l + 1);
+    }
+    lists_[l].push_front(&inserted.first->first);
+    inserted.first->second.pos = lists_[l].begin();
+    bytes_ += bytes;
+}
+
+void SubproblemCache::evict_one() {
+    // the least recently used entry of the deepest non-empty list.
+    size_t l = lists_.size();
+    while (l > 0 && lists_[l - 1].empty()) l--;
+    if (l == 0) return;
+    auto &list = lists_[l - 1];
+
+    auto it = map_.find(*list.back());
+    list.pop_back();
+    bytes_ -= entry_bytes(it->first);
+    map_.erase(it);
+    num_evictions_++;
+}
@@ -0,0 +1,87 @@
+#ifndef SUBPROBLEM_CACHE_H_
+#define SUBPROBLEM_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include "count_types.h"
+
+/**
+ * Bounded cache of subproblem results of a counting search.
+ *  A key is the bitset of the uncovered columns at a search tree node. The
+ *  remaining options only depend on that set, so every node reaching the
+ *  same set has the same number of solutions below it. Entries are evicted
+ *  when the cache grows beyond its memory limit, either least recently used
+ *  first (Lru) or from the deepest search level first (Depth), keeping the
+ *  entries that stand for the largest subtrees.
+ */
+class SubproblemCache {
+   public:
+    enum class Eviction { Lru, Depth };
+
+    struct Config {
+        size_t max_bytes = 256UL << 20;
+        Eviction eviction = Eviction::Lru;
+        // subtrees with fewer search tree nodes are not worth an entry.
+        uint64_t min_subtree_nodes = 2;
+    };
+
+    using Key = std::vector<uint64_t>;
+
+    struct Result {
+        count128_t num_solutions;
+        uint64_t num_nodes;  // search tree nodes of the subtree, root included
+        int64_t family = -1;  // OutputZdd node of the solutions, if built
+    };
+
+    explicit SubproblemCache(const Config &config);
+    SubproblemCache(const SubproblemCache &obj) = delete;
+
+    /**
+     * @return the stored result of key or nullptr. A hit makes the entry the
+     * most recently used one of its list.
+     */
+    const Result *find(const Key &key);
+
+    void insert(const Key &key, int depth, const Result &result);
+
+    uint64_t num_hits() const { return num_hits_; }
+    uint64_t num_misses() const { return num_misses_; }
+    uint64_t num_evictions() const { return num_evictions_; }
+    // search tree nodes not visited thanks to hits.
+    uint64_t num_saved_nodes() const { return num_saved_nodes_; }
+    size_t size() const { return map_.size(); }
+    size_t bytes() const { return bytes_; }
+
+   private:
+    struct KeyHash {
+        size_t operator()(const Key &key) const noexcept;
+    };
+
+    struct Value {
+        Result result;
+        int depth;
+        std::list<const Key *>::iterator pos;  // in lists_[list_of(depth)]
+    };
+
+    size_t list_of(int depth) const {
+        return config_.eviction == Eviction::Lru ? 0 : depth;
+    }
+    size_t entry_bytes(const Key &key) const;
+    void evict_one();
+
+    const Config config_;
+    std::unordered_map<Key, Value, KeyHash> map_;
+    // most recently used first; one list per depth with Eviction::Depth.
+    std::vector<std::list<const Key *>> lists_;
+    size_t bytes_;
+    uint64_t num_hits_;
+    uint64_t num_misses_;
+    uint64_t num_evictions_;
+    uint64_t num_saved_nodes_;
+};
+
+#endif  // SUBPROBLEM_CACHE_H_
@@ -79,6 +79,11 @@ public:
         return true;
     }
 
+    bool isRunning() const
+    {
+        return running;
+    }
+
     void reset()
     {
         // std::lock_guard<std::mutex> lock(mtx);
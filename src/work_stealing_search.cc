@@ -0,0 +1,207 @@
+#include "work_stealing_search.h"
+
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+#include "dp_manager.h"
+
+using namespace std;
+
+template <typename L>
+WorkStealingSearch<L>::WorkStealingSearch(ZddWithLinks<L> &master,
+                                          int num_workers, int steal_depth)
+    : master_(master),
+      num_workers_(max(num_workers, 1)),
+      steal_depth_(max(steal_depth, 1)),
+      workers_(),
+      num_idle_(0),
+      cancelled_(false),
+      num_steals_(0ULL),
+      error_mtx_(),
+      error_() {
+    for (int i = 0; i < num_workers_; i++) {
+        auto worker = make_unique<Worker>();
+        worker->frames.resize(steal_depth_);
+        workers_.emplace_back(std::move(worker));
+    }
+}
+
+template <typename L>
+void WorkStealingSearch<L>::make_replica(int worker_id) {
+    Worker &worker = *workers_[worker_id];
+    pmr::memory_resource *resource = pmr::get_default_resource();
+    if (auto master_arena = dynamic_cast<const Arena *>(master_.resource())) {
+        worker.arena = make_unique<Arena>(master_arena->options());
+        resource = worker.arena.get();
+    }
+    worker.zdd = make_unique<ZddWithLinks<L>>(master_, resource);
+
+    ZddWithLinks<L> &zdd = *worker.zdd;
+    zdd.work_stealing_ = this;
+    zdd.worker_id_ = worker_id;
+    zdd.steal_depth_ = steal_depth_;
+    zdd.set_cancel_flag(&cancelled_);
+    zdd.stopwatch.setTimeBound(master_.stopwatch.getTimeBound());
+    if (master_.stopwatch.isRunning()) {
+        zdd.stopwatch.markStartTime();
+    }
+}
+
+template <typename L>
+void WorkStealingSearch<L>::run() {
+    // worker 0 starts from the root, all the others start idle.
+    num_idle_ = num_workers_ - 1;
+    cancelled_ = false;
+
+    vector<thread> threads;
+    for (int i = 0; i < num_workers_; i++) {
+        threads.emplace_back(&WorkStealingSearch::worker_loop, this, i);
+    }
+    for (auto &th : threads) {
+        th.join();
+    }
+
+    for (auto &worker : workers_) {
+        if (!worker->zdd) continue;  // failed to build its replica
+        const ZddWithLinks<L> &zdd = *worker->zdd;
+        master_.num_search_tree_nodes += zdd.num_search_tree_nodes;
+        master_.num_solutions += zdd.num_solutions;
+        master_.num_updates += zdd.num_updates;
+        master_.num_head_updates += zdd.num_head_updates;
+        master_.num_inactive_updates += zdd.num_inactive_updates;
+        master_.num_hides += zdd.num_hides;
+        master_.num_failure_backtracks += zdd.num_failure_backtracks;
+        if (zdd.first_solution_time_ >= 0 &&
+            (master_.first_solution_time_ < 0 ||
+             zdd.first_solution_time_ < master_.first_solution_time_)) {
+            master_.first_solution_time_ = zdd.first_solution_time_;
+        }
+    }
+
+    if (!error_.empty()) {
+        throw std::runtime_error(error_);
+    }
+}
+
+template <typename L>
+bool WorkStealingSearch<L>::publish_frame(int worker_id, int depth,
+                                          bool has_more) {
+    Worker &worker = *workers_[worker_id];
+    const ZddWithLinks<L> &zdd = *worker.zdd;
+    lock_guard<mutex> lock(worker.mtx);
+
+    Frame &frame = worker.frames[depth];
+    if (frame.stolen) {
+        return false;
+    }
+    frame.active = true;
+    frame.open = has_more;
+    zdd.save_frame(depth, frame.state);
+    return true;
+}
+
+template <typename L>
+void WorkStealingSearch<L>::close_frame(int worker_id, int depth) {
+    Worker &worker = *workers_[worker_id];
+    lock_guard<mutex> lock(worker.mtx);
+
+    Frame &frame = worker.frames[depth];
+    frame.active = false;
+    frame.open = false;
+    frame.stolen = false;
+}
+
+template <typename L>
+int WorkStealingSearch<L>::steal(int thief_id) {
+    vector<Frame> path;
+
+    for (int i = 1; i < num_workers_ && path.empty(); i++) {
+        Worker &victim = *workers_[(thief_id + i) % num_workers_];
+        lock_guard<mutex> lock(victim.mtx);
+
+        for (int depth = 0;
+             depth < steal_depth_ && victim.frames[depth].active; depth++) {
+            Frame &frame = victim.frames[depth];
+            if (!frame.open) continue;
+
+            frame.open = false;
+            frame.stolen = true;
+            // the thief becomes busy while the victim is known to be busy.
+            num_idle_--;
+            path.assign(victim.frames.begin(),
+                        victim.frames.begin() + depth + 1);
+            break;
+        }
+    }
+    if (path.empty()) {
+        return -1;
+    }
+    num_steals_++;
+
+    Worker &thief = *workers_[thief_id];
+    lock_guard<mutex> lock(thief.mtx);
+    thief.split.depth = 0;
+    thief.split.frames.resize(path.size());
+    for (size_t depth = 0; depth < path.size(); depth++) {
+        Frame &frame = path[depth];
+        frame.open = false;
+        frame.stolen = false;
+
+        thief.split.frames[depth] = frame.state;
+        thief.frames[depth] = std::move(frame);
+    }
+    return path.size() - 1;
+}
+
+template <typename L>
+void WorkStealingSearch<L>::run_stolen(int thief_id, int depth) {
+    Worker &thief = *workers_[thief_id];
+    ZddWithLinks<L> &zdd = *thief.zdd;
+    typename ZddWithLinks<L>::Solution solution;
+
+    // the stolen frame is closed by the search, those above it here.
+    zdd.start_split(thief.split);
+    zdd.resume_search(solution);
+    for (int d = depth - 1; d >= 0; d--) {
+        close_frame(thief_id, d);
+    }
+}
+
+template <typename L>
+void WorkStealingSearch<L>::worker_loop(int worker_id) {
+    try {
+        if (!workers_[worker_id]->zdd) {
+            make_replica(worker_id);
+        }
+        if (worker_id == 0) {
+            typename ZddWithLinks<L>::Solution solution;
+            workers_[worker_id]->zdd->search(solution, 0);
+            num_idle_++;
+        }
+
+        int num_failed_steals = 0;
+        while (!cancelled_ && num_idle_ < num_workers_) {
+            int depth = steal(worker_id);
+            if (depth >= 0) {
+                run_stolen(worker_id, depth);
+                num_idle_++;
+                num_failed_steals = 0;
+            } else if (++num_failed_steals < 64) {
+                this_thread::yield();
+            } else {
+                this_thread::sleep_for(chrono::microseconds(100));
+            }
+        }
+    } catch (const std::exception &e) {
+        // time limit, cancellation or out of memory.
+        lock_guard<mutex> lock(error_mtx_);
+        if (error_.empty()) {
+            error_ = e.what();
+        }
+        cancelled_ = true;
+    }
+}
+
+#define INSTANTIATE(L) template class WorkStealingSearch<L>;
+FOR_EACH_LAYOUT(INSTANTIATE)
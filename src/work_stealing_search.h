@@ -0,0 +1,99 @@
+#ifndef WORK_STEALING_SEARCH_H_
+#define WORK_STEALING_SEARCH_H_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "arena.h"
+#include "dancing_on_zdd.h"
+
+constexpr int DEFAULT_STEAL_DEPTH = 12;  // frames shallower than this can be stolen.
+
+/**
+ * Multi-threaded search over replicas of a ZddWithLinks.
+ *  Every worker owns a replica of the dancing structure and publishes the
+ *  frames of its search shallower than steal_depth. A frame is the column
+ *  chosen at a depth together with the option currently covered for it
+ *  (node_id, up_id and the lower choice trace). An idle worker takes the
+ *  remaining options of the shallowest open frame of a busy worker, replays
+ *  the covers leading to that frame on its own replica and continues the
+ *  enumeration from there. Every search tree node is visited by exactly one
+ *  worker, so the merged counters equal those of the serial search.
+ *  If the master lives in an Arena, every worker builds its replica in an
+ *  arena of its own from its own thread, so that the pages of a replica are
+ *  placed near the thread using them.
+ */
+template <typename L>
+class WorkStealingSearch {
+   public:
+    using FrameState = typename ZddWithLinks<L>::FrameState;
+    using SearchSplit = typename ZddWithLinks<L>::SearchSplit;
+
+    WorkStealingSearch(ZddWithLinks<L> &master, int num_workers,
+                       int steal_depth = DEFAULT_STEAL_DEPTH);
+    WorkStealingSearch(const WorkStealingSearch &obj) = delete;
+
+    /**
+     * Runs the search and adds the counters of all workers to the master.
+     * Throws std::runtime_error when a worker exceeds the time limit.
+     */
+    void run();
+
+    uint64_t num_steals() const { return num_steals_; }
+
+    /**
+     * Publishes the option covered at depth by worker_id.
+     * @return false if the remaining options of the frame have been stolen;
+     * the caller must then uncover the option and leave the frame.
+     */
+    bool publish_frame(int worker_id, int depth, bool has_more);
+
+    // marks the frame at depth as finished.
+    void close_frame(int worker_id, int depth);
+
+   private:
+    struct Frame {
+        bool active = false;  // the worker is inside this frame.
+        bool open = false;    // the frame may have options left to steal.
+        bool stolen = false;  // the remaining options were taken.
+        FrameState state;
+    };
+
+    struct Worker {
+        unique_ptr<Arena> arena;
+        unique_ptr<ZddWithLinks<L>> zdd;
+        std::mutex mtx;
+        vector<Frame> frames;
+        SearchSplit split;  // the stolen frames
+    };
+
+    void worker_loop(int worker_id);
+
+    // builds the replica of worker_id; called from the worker's thread.
+    void make_replica(int worker_id);
+
+    /**
+     * Takes the shallowest open frame of some other worker and sets up the
+     * thief's frames and its split. Returns the depth of the stolen frame,
+     * or -1 if no work was found.
+     */
+    int steal(int thief_id);
+
+    // replays the stolen frame at depth and enumerates its remaining options.
+    void run_stolen(int thief_id, int depth);
+
+    ZddWithLinks<L> &master_;
+    const int num_workers_;
+    const int steal_depth_;
+    vector<unique_ptr<Worker>> workers_;
+    std::atomic<int> num_idle_;
+    std::atomic<bool> cancelled_;
+    std::atomic<uint64_t> num_steals_;
+    std::mutex error_mtx_;
+    std::string error_;
+};
+
+#endif  // WORK_STEALING_SEARCH_H_
@@ -0,0 +1,213 @@
+#include "zdd_loader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+#include "dancing_on_zdd.h"
+#include "parallel_for.h"
+
+using namespace std;
+
+// node ids spanning at most this many slots per node use a direct table.
+constexpr int64_t DENSE_ID_SPAN_PER_NODE = 4;
+
+ZddLoader::ZddLoader(const string &file_name, int num_threads)
+    : file_name_(file_name), num_vars_(0), num_options_(0), nodes_() {
+    ifstream ifs(file_name, ios::binary);
+    if (!ifs) {
+        throw std::runtime_error("can't open " + file_name);
+    }
+    string text;
+    ifs.seekg(0, ios::end);
+    text.resize(ifs.tellg());
+    ifs.seekg(0, ios::beg);
+    ifs.read(&text[0], text.size());
+    if (!ifs) {
+        throw std::runtime_error("can't read " + file_name);
+    }
+
+    // cut the text at line ends, one chunk per thread.
+    num_threads = max(num_threads, 1);
+    vector<size_t> cuts(1, 0);
+    for (int t = 1; t < num_threads; t++) {
+        size_t pos = max(text.size() * t / num_threads, cuts.back());
+        pos = text.find('\n', pos);
+        cuts.push_back(pos == string::npos ? text.size() : pos + 1);
+    }
+    cuts.push_back(text.size());
+
+    vector<vector<RawNode>> chunks(num_threads);
+    vector<string> errors(num_threads);
+    vector<thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&, t]() {
+            try {
+                parse_chunk(text, cuts[t], cuts[t + 1], chunks[t]);
+            } catch (const std::runtime_error &e) {
+                errors[t] = e.what();
+            }
+        });
+    }
+    for (auto &th : threads) {
+        th.join();
+    }
+    for (const auto &error : errors) {
+        if (!error.empty()) throw std::runtime_error(error);
+    }
+
+    vector<RawNode> raw;
+    size_t num_nodes = 0;
+    for (const auto &chunk : chunks) num_nodes += chunk.size();
+    raw.reserve(num_nodes);
+    for (auto &chunk : chunks) {
+        raw.insert(raw.end(), chunk.begin(), chunk.end());
+        vector<RawNode>().swap(chunk);
+    }
+    resolve(text, raw, num_threads);
+}
+
+// parses a non-negative decimal integer at p, up to INT64_MAX.
+static bool parse_int(const char *&p, const char *end, int64_t &value) {
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    if (p == end || *p < '0' || *p > '9') return false;
+    value = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        const int digit = *p - '0';
+        if (value > (INT64_MAX - digit) / 10) return false;
+        value = value * 10 + digit;
+        p++;
+    }
+    return true;
+}
+
+// parses a child: B, T or a node id.
+static bool parse_child(const char *&p, const char *end, int64_t &value) {
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    if (p < end && (*p == 'B' || *p == 'T')) {
+        value = *p == 'B' ? DD_ZERO_TERM : DD_ONE_TERM;
+        p++;
+        return true;
+    }
+    return parse_int(p, end, value);
+}
+
+void ZddLoader::parse_chunk(const string &text, size_t begin, size_t end,
+                            vector<RawNode> &out) const {
+    const char *const base = text.data();
+    size_t pos = begin;
+    while (pos < end) {
+        size_t eol = text.find('\n', pos);
+        if (eol == string::npos || eol > end) eol = end;
+        const char *p = base + pos;
+        const char *line_end = base + eol;
+        if (line_end > p && line_end[-1] == '\r') line_end--;
+
+        if (p < line_end && *p != '.' && *p != '#') {
+            RawNode node;
+            int64_t var;
+            node.line_pos = pos;
+            if (!parse_int(p, line_end, node.nid) ||
+                !parse_int(p, line_end, var) ||
+                !parse_child(p, line_end, node.lo) ||
+                !parse_child(p, line_end, node.hi) || var < 1 ||
+                var > INT32_MAX) {
+                bad_line(text, pos);
+            }
+            node.var = var;
+            out.push_back(node);
+        }
+        pos = eol + 1;
+    }
+}
+
+void ZddLoader::resolve(const string &text, const vector<RawNode> &raw,
+                        int num_threads) {
+    const size_t n = raw.size();
+    int64_t min_nid = INT64_MAX, max_nid = -1;
+    int max_var = 0;
+    for (const auto &node : raw) {
+        min_nid = min(min_nid, node.nid);
+        max_nid = max(max_nid, node.nid);
+        max_var = max(max_var, node.var);
+    }
+
+    vector<char> var_used(max_var + 1, 0);
+    for (const auto &node : raw) var_used[node.var] = 1;
+    num_vars_ = count(var_used.begin(), var_used.end(), 1);
+
+    // node id -> position in file order.
+    const bool dense =
+        n > 0 && max_nid - min_nid < DENSE_ID_SPAN_PER_NODE * (int64_t)n + 1024;
+    vector<int64_t> dense_index;
+    vector<pair<int64_t, int64_t>> sparse_index;
+    if (dense) {
+        dense_index.assign(max_nid - min_nid + 1, -1);
+        for (size_t i = 0; i < n; i++) {
+            int64_t &slot = dense_index[raw[i].nid - min_nid];
+            if (slot >= 0) bad_line(text, raw[i].line_pos);  // defined twice
+            slot = i;
+        }
+    } else {
+        sparse_index.resize(n);
+        for (size_t i = 0; i < n; i++) sparse_index[i] = {raw[i].nid, (int64_t)i};
+        sort(sparse_index.begin(), sparse_index.end());
+        for (size_t i = 1; i < n; i++) {
+            if (sparse_index[i].first == sparse_index[i - 1].first) {
+                bad_line(text, raw[sparse_index[i].second].line_pos);
+            }
+        }
+    }
+    auto index_of = [&](int64_t nid) -> int64_t {
+        if (nid < 0) return nid;  // terminal
+        if (dense) {
+            if (nid < min_nid || nid > max_nid) return INT64_MAX;
+            const int64_t i = dense_index[nid - min_nid];
+            return i < 0 ? INT64_MAX : i;
+        }
+        auto it = lower_bound(sparse_index.begin(), sparse_index.end(),
+                              make_pair(nid, INT64_MIN));
+        if (it == sparse_index.end() || it->first != nid) return INT64_MAX;
+        return it->second;
+    };
+
+    nodes_.resize(n);
+    atomic<size_t> first_bad(n);
+    parallel_for(0, n, num_threads, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++) {
+            const int64_t hi_id = index_of(raw[i].hi);
+            const int64_t lo_id = index_of(raw[i].lo);
+            // children must be defined on earlier lines.
+            if (hi_id >= (int64_t)i || lo_id >= (int64_t)i) {
+                size_t bad = first_bad;
+                while (i < bad && !first_bad.compare_exchange_weak(bad, i)) {
+                }
+                return;
+            }
+            nodes_[i] = {hi_id, lo_id, (uint32_t)raw[i].var};
+        }
+    });
+    if (first_bad < n) {
+        bad_line(text, raw[first_bad].line_pos);
+    }
+
+    // children come first, so one pass in file order counts the paths.
+    vector<count128_t> paths(n);
+    auto paths_of = [&](int64_t id) -> count128_t {
+        return id >= 0 ? paths[id] : id == DD_ONE_TERM ? 1 : 0;
+    };
+    for (size_t i = 0; i < n; i++) {
+        paths[i] = saturating_add(paths_of(nodes_[i].hi),
+                                  paths_of(nodes_[i].lo));
+    }
+    num_options_ = n > 0 ? paths[n - 1] : 0;
+}
+
+void ZddLoader::bad_line(const string &text, size_t pos) const {
+    size_t eol = text.find('\n', pos);
+    if (eol == string::npos) eol = text.size();
+    throw std::runtime_error("bad node line in " + file_name_ + ": " +
+                             text.substr(pos, eol - pos));
+}
@@ -0,0 +1,62 @@
+#ifndef ZDD_LOADER_H_
+#define ZDD_LOADER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "count_types.h"
+
+/**
+ * Parallel parser of zdd files in the Graphillion format.
+ *  The file is read at once and cut into one chunk of lines per thread.
+ *  Node ids are then resolved to positions in file order, which is the
+ *  order ZddWithLinks::load_zdd_from_file stores the nodes in. Unlike that
+ *  loader, a reference to a node that is not defined on an earlier line or
+ *  a node id defined twice is an error.
+ */
+class ZddLoader {
+   public:
+    struct ParsedNode {
+        int64_t hi;  // positions of any layout's node ids
+        int64_t lo;
+        uint32_t var;
+    };
+
+    /**
+     * reads and parses file_name with num_threads threads. Throws
+     * std::runtime_error for an unreadable or malformed file.
+     */
+    ZddLoader(const std::string &file_name, int num_threads);
+
+    // number of distinct variables, as get_num_vars_from_zdd_file counts.
+    int num_vars() const { return num_vars_; }
+
+    // number of 1-paths of the root, the last node; COUNT128_MAX if more.
+    count128_t num_options() const { return num_options_; }
+
+    const std::vector<ParsedNode> &nodes() const { return nodes_; }
+
+   private:
+    // a node line before its ids are resolved.
+    struct RawNode {
+        int64_t nid;
+        int64_t hi;  // node id, or DD_ONE_TERM / DD_ZERO_TERM
+        int64_t lo;
+        int32_t var;
+        size_t line_pos;  // offset of the line in the file, for errors
+    };
+
+    void parse_chunk(const std::string &text, size_t begin, size_t end,
+                     std::vector<RawNode> &out) const;
+    void resolve(const std::string &text, const std::vector<RawNode> &raw,
+                 int num_threads);
+    [[noreturn]] void bad_line(const std::string &text, size_t pos) const;
+
+    const std::string file_name_;
+    int num_vars_;
+    count128_t num_options_;
+    std::vector<ParsedNode> nodes_;
+};
+
+#endif  // ZDD_LOADER_H_
@@ -0,0 +1,90 @@
+// Differential test of the vector scans of min_count_column against the
+// scalar loop, on random arrays of every length up to a few vector widths:
+// ties on the minimum count, counts with the sign bit set (SSE2 compares
+// them signed) and zero counts.
+
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "column_select.h"
+
+using namespace std;
+
+static int num_failures = 0;
+
+// compares the scan isa with the scalar loop on counts and columns.
+static void check(const char *isa, const vector<uint32_t> &counts,
+                  const vector<uint32_t> &columns, bool last_tie) {
+    const size_t n = counts.size();
+    const uint32_t expected = min_count_column<uint32_t>(
+        counts.data(), columns.data(), n, last_tie);
+    uint32_t got = 0;
+    if (!min_count_column_with(isa, counts.data(), columns.data(), n,
+                               last_tie, got)) {
+        return;
+    }
+    if (got != expected && num_failures++ < 10) {
+        fprintf(stderr, "%s: n %zu, last_tie %d: column %u, expected %u\n",
+                isa, n, (int)last_tie, got, expected);
+    }
+    const uint32_t dispatched =
+        min_count_column(counts.data(), columns.data(), n, last_tie);
+    if (dispatched != expected && num_failures++ < 10) {
+        fprintf(stderr, "dispatch: n %zu, last_tie %d: column %u, expected %u\n",
+                n, (int)last_tie, dispatched, expected);
+    }
+}
+
+int main() {
+    mt19937_64 rng(1);
+    const char *isas[] = {"scalar", "sse2", "avx2"};
+    for (const char *isa : isas) {
+        uint32_t column;
+        const uint32_t one = 1;
+        printf("%s: %s\n", isa,
+               min_count_column_with(isa, &one, &one, 1, false, column)
+                   ? "tested"
+                   : "not available");
+    }
+
+    for (int round = 0; round < 200; round++) {
+        for (size_t n = 1; n <= 4 * 8 + 7; n++) {
+            // distinct columns in random order, like the active columns.
+            vector<uint32_t> columns(n);
+            iota(columns.begin(), columns.end(), 1);
+            shuffle(columns.begin(), columns.end(), rng);
+            for (auto &col : columns) col = col * 3 + (uint32_t)(rng() % 3);
+
+            vector<uint32_t> counts(n);
+            const int kind = round % 4;
+            for (auto &count : counts) {
+                if (kind == 0) {
+                    count = 1 + rng() % 3;  // many ties
+                } else if (kind == 1) {
+                    count = 0x7ffffffeu + rng() % 4;  // around the sign bit
+                } else if (kind == 2) {
+                    count = 0xfffffff0u + rng() % 16;  // sign bit set
+                } else {
+                    count = (uint32_t)rng();
+                }
+            }
+            if (round % 7 == 0) counts[rng() % n] = 0;
+            // the minimum in the tail after the last full vector.
+            if (round % 5 == 0) counts[n - 1] = 0x00000001u;
+
+            for (const char *isa : isas) {
+                check(isa, counts, columns, false);
+                check(isa, counts, columns, true);
+            }
+        }
+    }
+
+    if (num_failures > 0) {
+        fprintf(stderr, "%d mismatches\n", num_failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,221 @@
+// Round trip of --output-zdd: the family of solutions written by the search
+// must load as an input zdd, and through its "# var option" lines each of
+// its sets must be an exact cover by options of the instance.
+//
+// usage: output_zdd_test data_dir
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "dancing_on_zdd.h"
+#include "dp_manager.h"
+#include "output_zdd.h"
+#include "subproblem_cache.h"
+#include "zdd_loader.h"
+
+using namespace std;
+
+static int num_failures = 0;
+
+#define CHECK(cond)                                                   \
+    do {                                                              \
+        if (!(cond)) {                                                \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__,    \
+                    __LINE__, #cond);                                 \
+            num_failures++;                                           \
+        }                                                             \
+    } while (0)
+
+using Option = vector<int>;   // sorted columns
+using Cover = set<uint64_t>;  // option numbers
+
+// the sets of a loaded zdd file in the order of OptionIndex: the hi branch
+// before the lo branch. var_map renames the variables.
+static vector<vector<uint64_t>> read_sets(const ZddLoader &loader,
+                                          const map<int, uint64_t> &var_map) {
+    const auto &nodes = loader.nodes();
+    vector<vector<uint64_t>> sets;
+    vector<uint64_t> path;
+    auto walk = [&](auto &&self, int64_t id) -> void {
+        if (id == DD_ZERO_TERM) return;
+        if (id == DD_ONE_TERM) {
+            sets.push_back(path);
+            return;
+        }
+        const auto &node = nodes[id];
+        const auto it = var_map.find(node.var);
+        path.push_back(it == var_map.end() ? node.var : it->second);
+        self(self, node.hi);
+        path.pop_back();
+        self(self, node.lo);
+    };
+    if (!nodes.empty()) walk(walk, nodes.size() - 1);
+    return sets;
+}
+
+// the "# var option" lines of an output file.
+static map<int, uint64_t> read_var_map(const string &file_name) {
+    map<int, uint64_t> var_map;
+    ifstream ifs(file_name);
+    string line;
+    while (getline(ifs, line)) {
+        if (line.empty() || line[0] != '#') continue;
+        istringstream iss(line.substr(1));
+        int var;
+        uint64_t option;
+        iss >> var >> option;
+        CHECK(var == (int)var_map.size() + 1);
+        var_map[var] = option;
+    }
+    return var_map;
+}
+
+/**
+ * solves in_file with the output zdd, reads the output back and checks it
+ * against the options of in_file.
+ * @return the solutions, as sets of option numbers.
+ */
+static set<Cover> check_round_trip(const string &in_file) {
+    ZddLoader loader(in_file, 1);
+    const int num_cols = loader.num_vars();
+    vector<Option> options;
+    for (const auto &set : read_sets(loader, {})) {
+        options.emplace_back(set.begin(), set.end());
+    }
+
+    ZddWithLinks<Layout64> zdd(num_cols);
+    zdd.load_zdd(loader, 1);
+    SubproblemCache cache(SubproblemCache::Config{});
+    OutputZdd output;
+    zdd.set_subproblem_cache(&cache);
+    zdd.set_output_zdd(&output);
+    ZddWithLinks<Layout64>::Solution solution;
+    zdd.search(solution, 0);
+    zdd.set_subproblem_cache(nullptr);
+    zdd.set_output_zdd(nullptr);
+
+    const string out_file = "output_zdd_test.out.zdd";
+    {
+        ofstream ofs(out_file);
+        output.write(ofs, zdd.output_root());
+    }
+    if (zdd.num_solutions == 0) {
+        // the empty family is the terminal alone, which is not an instance.
+        ifstream ifs(out_file);
+        const string text((istreambuf_iterator<char>(ifs)),
+                          istreambuf_iterator<char>());
+        CHECK(text == "B\n.\n");
+        remove(out_file.c_str());
+        return {};
+    }
+    const auto var_map = read_var_map(out_file);
+    ZddLoader out_loader(out_file, 1);
+    CHECK(out_loader.num_vars() == (int)var_map.size());
+    CHECK(out_loader.num_options() == zdd.num_solutions);
+
+    set<Cover> covers;
+    for (const auto &set : read_sets(out_loader, var_map)) {
+        vector<int> hits(num_cols + 1, 0);
+        for (uint64_t option : set) {
+            CHECK(option < options.size());
+            if (option >= options.size()) continue;
+            for (int col : options[option]) hits[col]++;
+        }
+        CHECK(all_of(hits.begin() + 1, hits.end(),
+                     [](int h) { return h == 1; }));
+        covers.emplace(set.begin(), set.end());
+    }
+    CHECK(covers.size() == zdd.num_solutions);
+    remove(out_file.c_str());
+    fprintf(stderr, "%s: %zu solutions\n", in_file.c_str(), covers.size());
+    return covers;
+}
+
+// the exact covers of columns 1..num_cols by options, by brute force.
+static set<Cover> exact_covers(const vector<Option> &options, int num_cols) {
+    set<Cover> covers;
+    const size_t n = options.size();
+    for (uint64_t mask = 0; mask < (1ULL << n); mask++) {
+        vector<int> hits(num_cols + 1, 0);
+        for (size_t k = 0; k < n; k++) {
+            if (mask >> k & 1) {
+                for (int col : options[k]) hits[col]++;
+            }
+        }
+        if (all_of(hits.begin() + 1, hits.end(),
+                   [](int h) { return h == 1; })) {
+            Cover cover;
+            for (size_t k = 0; k < n; k++) {
+                if (mask >> k & 1) cover.insert(k);
+            }
+            covers.insert(cover);
+        }
+    }
+    return covers;
+}
+
+// the order of OptionIndex: at the first column in only one of the two
+// options, the option having it comes first.
+static bool option_less(const Option &a, const Option &b) {
+    for (size_t i = 0; i < a.size() && i < b.size(); i++) {
+        if (a[i] != b[i]) return a[i] < b[i];
+    }
+    return a.size() > b.size();
+}
+
+// writes the zdd of options over columns 1..n to file_name.
+static void write_instance(const vector<Option> &options,
+                           const string &file_name) {
+    OutputZdd zdd;
+    OutputZdd::node_t family = OutputZdd::ZERO;
+    for (const Option &option : options) {
+        OutputZdd::node_t set = OutputZdd::ONE;
+        for (auto it = option.rbegin(); it != option.rend(); ++it) {
+            set = zdd.change(set, *it);
+        }
+        family = zdd.unite(family, set);
+    }
+    ofstream ofs(file_name);
+    zdd.write(ofs, family);
+}
+
+// checks the round trip of a small instance against brute force.
+static void check_small(vector<Option> options, int num_cols) {
+    sort(options.begin(), options.end(), option_less);
+    const string in_file = "output_zdd_test.zdd";
+    write_instance(options, in_file);
+    CHECK(check_round_trip(in_file) == exact_covers(options, num_cols));
+    remove(in_file.c_str());
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s data_dir\n", argv[0]);
+        return 2;
+    }
+    const string data_dir = argv[1];
+
+    check_small({{1, 2}, {3, 4}, {5, 6}, {1, 3}, {2, 4}, {1, 2, 3, 4}, {5},
+                 {6}, {2, 5}, {4, 6}, {1}, {3}, {2, 3}, {1, 4}},
+                6);
+    // no solution: the output is the empty family.
+    check_small({{1, 2}, {2, 3}}, 3);
+
+    // sparse option numbers: few of many options in each solution.
+    check_round_trip(data_dir + "/kts15-ptpt-0007.zdd");
+    check_round_trip(data_dir + "/bell-08.zdd");
+    check_round_trip(data_dir + "/grafo215.20.zdd");
+
+    if (num_failures > 0) {
+        fprintf(stderr, "%d checks failed\n", num_failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,117 @@
+// Pausing and splitting the search: a search paused every few search tree
+// nodes with resume_search(solution, max_nodes), and a search whose open
+// frames are split off by split_search and searched by replicas with
+// start_split (splits of splits included), must visit the same search tree
+// as the plain search and leave every structure at rest.
+//
+// usage: search_split_test data_dir
+
+#include <cstdio>
+#include <string>
+
+#include "dancing_on_zdd.h"
+#include "dp_manager.h"
+#include "zdd_loader.h"
+
+using namespace std;
+
+static int num_failures = 0;
+
+#define CHECK(cond)                                                   \
+    do {                                                              \
+        if (!(cond)) {                                                \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__,    \
+                    __LINE__, #cond);                                 \
+            num_failures++;                                           \
+        }                                                             \
+    } while (0)
+
+using Zdd = ZddWithLinks<Layout32>;
+
+struct Totals {
+    uint64_t nodes = 0;
+    count128_t solutions = 0;
+    int splits = 0;
+
+    void add(const Zdd &zdd) {
+        nodes += zdd.num_search_tree_nodes;
+        solutions += zdd.num_solutions;
+    }
+};
+
+/**
+ * runs the started search of zdd, pausing it every budget nodes and
+ * handing the split-off options to replicas of master, which are searched
+ * the same way while depth_left > 0.
+ */
+static void run_split(Zdd &zdd, const Zdd &master, uint64_t budget,
+                      int depth_left, Totals &totals) {
+    Zdd::Solution solution;
+    while (!zdd.resume_search(solution, budget)) {
+        if (depth_left == 0) continue;
+        Zdd::SearchSplit split;
+        if (!zdd.split_search(split)) continue;
+        totals.splits++;
+        Zdd replica(master);
+        replica.start_split(split);
+        run_split(replica, master, budget, depth_left - 1, totals);
+    }
+    totals.add(zdd);
+    CHECK(zdd == master);
+}
+
+static void check_instance(const string &file_name, const string &config) {
+    ZddLoader loader(file_name, 1);
+    Zdd master(loader.num_vars());
+    master.load_zdd(loader, 1);
+    master.set_search_config(SearchConfig::parse(config));
+
+    Zdd::Solution solution;
+    Zdd plain(master);
+    plain.search(solution, 0);
+
+    // paused every 37 nodes: the same search, step by step.
+    Zdd paused(master);
+    paused.start_search(0);
+    int num_pauses = 0;
+    while (!paused.resume_search(solution, 37)) num_pauses++;
+    CHECK(num_pauses > 0);
+    CHECK(paused.num_search_tree_nodes == plain.num_search_tree_nodes);
+    CHECK(paused.num_solutions == plain.num_solutions);
+    CHECK(paused.num_updates == plain.num_updates);
+    CHECK(paused == master);
+
+    // split at every pause, and the splits split again.
+    for (uint64_t budget : {1, 50, 1000}) {
+        Totals totals;
+        Zdd root(master);
+        root.start_search(0);
+        run_split(root, master, budget, 3, totals);
+        CHECK(totals.splits > 0);
+        CHECK(totals.nodes == plain.num_search_tree_nodes);
+        CHECK(totals.solutions == plain.num_solutions);
+        fprintf(stderr, "%s %s: budget %llu, %d splits\n", file_name.c_str(),
+                config.c_str(), (unsigned long long)budget, totals.splits);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s data_dir\n", argv[0]);
+        return 2;
+    }
+    const string data_dir = argv[1];
+
+    // the ranked orders resume a split frame from its saved positions.
+    for (const char *config : {"first", "first-count-look", "last-up-desc"}) {
+        check_instance(data_dir + "/bell-08.zdd", config);
+        check_instance(data_dir + "/kts15-ptpt-0007.zdd", config);
+        check_instance(data_dir + "/grafo215.20.zdd", config);
+    }
+
+    if (num_failures > 0) {
+        fprintf(stderr, "%d checks failed\n", num_failures);
+        return 1;
+    }
+    return 0;
+}
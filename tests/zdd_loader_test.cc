@@ -0,0 +1,151 @@
+// Node ids of any size up to INT64_MAX: a zdd file whose ids are at or above
+// 2^31, densely or sparsely spread, must load to the same nodes as the file
+// with small ids and give the same solutions; ids past INT64_MAX and
+// variables past INT32_MAX are errors.
+//
+// usage: zdd_loader_test data_dir
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "dancing_on_zdd.h"
+#include "dp_manager.h"
+#include "zdd_loader.h"
+
+using namespace std;
+
+static int num_failures = 0;
+
+#define CHECK(cond)                                                   \
+    do {                                                              \
+        if (!(cond)) {                                                \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__,    \
+                    __LINE__, #cond);                                 \
+            num_failures++;                                           \
+        }                                                             \
+    } while (0)
+
+static const string TMP_FILE = "zdd_loader_test.zdd";
+
+static void write_file(const string &file_name, const string &text) {
+    ofstream ofs(file_name);
+    ofs << text;
+}
+
+// a child of a node line, with its node id mapped by rename.
+template <typename Rename>
+static string child(const string &id, Rename rename) {
+    if (id == "B" || id == "T") return id;
+    return to_string(rename(stoll(id)));
+}
+
+// the text of file_name with every node id mapped by rename.
+template <typename Rename>
+static string renamed(const string &file_name, Rename rename) {
+    ifstream ifs(file_name);
+    ostringstream out;
+    string line;
+    while (getline(ifs, line)) {
+        if (line.empty() || line[0] == '.' || line[0] == '#') {
+            out << line << "\n";
+            continue;
+        }
+        istringstream iss(line);
+        string nid, var, lo, hi;
+        iss >> nid >> var >> lo >> hi;
+        out << rename(stoll(nid)) << " " << var << " " << child(lo, rename)
+            << " " << child(hi, rename) << "\n";
+    }
+    return out.str();
+}
+
+// the solutions of the instance in file_name.
+static count128_t solve(const string &file_name) {
+    ZddLoader loader(file_name, 1);
+    ZddWithLinks<Layout32> zdd(loader.num_vars());
+    zdd.load_zdd(loader, 1);
+    ZddWithLinks<Layout32>::Solution solution;
+    zdd.search(solution, 0);
+    return zdd.num_solutions;
+}
+
+static bool same_nodes(const ZddLoader &a, const ZddLoader &b) {
+    if (a.nodes().size() != b.nodes().size()) return false;
+    for (size_t i = 0; i < a.nodes().size(); i++) {
+        const auto &x = a.nodes()[i];
+        const auto &y = b.nodes()[i];
+        if (x.hi != y.hi || x.lo != y.lo || x.var != y.var) return false;
+    }
+    return true;
+}
+
+// loads text with 1 and 4 threads and checks it against reference_file.
+static void check_same(const string &text, const string &reference_file) {
+    write_file(TMP_FILE, text);
+    const ZddLoader reference(reference_file, 1);
+    for (int num_threads : {1, 4}) {
+        const ZddLoader loader(TMP_FILE, num_threads);
+        CHECK(loader.num_vars() == reference.num_vars());
+        CHECK(loader.num_options() == reference.num_options());
+        CHECK(same_nodes(loader, reference));
+    }
+    CHECK(solve(TMP_FILE) == solve(reference_file));
+}
+
+static bool loads(const string &text) {
+    write_file(TMP_FILE, text);
+    try {
+        ZddLoader loader(TMP_FILE, 1);
+    } catch (const runtime_error &) {
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s data_dir\n", argv[0]);
+        return 2;
+    }
+    const string data_dir = argv[1];
+
+    // two options {1} and {2}: one exact cover of the two columns.
+    write_file("zdd_loader_test.small.zdd", "1 2 B T\n2 1 1 T\n.\n");
+    check_same("3000000000 2 B T\n3000000001 1 3000000000 T\n.\n",
+               "zdd_loader_test.small.zdd");
+    CHECK(solve(TMP_FILE) == 1);
+    remove("zdd_loader_test.small.zdd");
+
+    for (const char *name : {"bell-08.zdd", "kts15-ptpt-0007.zdd"}) {
+        const string file_name = data_dir + "/" + name;
+        // dense: shifted past 2^31 and 2^32.
+        for (int shift : {31, 32}) {
+            check_same(renamed(file_name,
+                               [shift](int64_t id) {
+                                   return id + (1LL << shift);
+                               }),
+                       file_name);
+        }
+        // sparse: spread up to near INT64_MAX.
+        check_same(renamed(file_name,
+                           [](int64_t id) {
+                               return INT64_MAX - (1LL << 40) + id * 1000003;
+                           }),
+                   file_name);
+    }
+
+    CHECK(loads("9223372036854775807 1 B T\n.\n"));
+    CHECK(!loads("9223372036854775808 1 B T\n.\n"));
+    CHECK(!loads("99999999999999999999 1 B T\n.\n"));
+    CHECK(!loads("1 2147483648 B T\n.\n"));
+    remove(TMP_FILE.c_str());
+
+    if (num_failures > 0) {
+        fprintf(stderr, "%d checks failed\n", num_failures);
+        return 1;
+    }
+    return 0;
+}